@@ -114,6 +114,10 @@ BDATA			fpass;
 %token		PCAP_ENCRYPT	"encrypted ike pcap dump file"
 %token		RETRY_COUNT	"retry count"
 %token		RETRY_DELAY	"retry delay"
+%token		IKE_WORKERS	"ike workers"
+%token		TIMER_WORKERS	"timer workers"
+%token		DH_POOL_DEPTH	"dh pool depth"
+%token		XAUTH_WORKERS	"xauth workers"
 
 %token		NETGROUP	"netgroup section"
 
@@ -127,6 +131,9 @@ BDATA			fpass;
 %token		LD_ATTR_USER	"user attribute"
 %token		LD_ATTR_GROUP	"group attribute"
 %token		LD_ATTR_MEMBER	"member attribute"
+%token		LD_AUTH_LIMIT	"auth limit"
+%token		LD_CONN_MAX	"connection maximum"
+%token		LD_CACHE_LIFE	"cache lifetime"
 
 %token		XCONF_LOCAL	"xconfig local section"
 %token		NETWORK4	"network4"
@@ -404,6 +411,38 @@ daemon_line
 		iked.retry_count = $2;
 	}
 	EOS
+  |	IKE_WORKERS NUMBER
+	{
+		if( $2 > IKED_WORKERS_MAX )
+			error( @$, std::string( "ike worker count exceeds maximum" ) );
+		else
+			iked.ike_workers = $2;
+	}
+	EOS
+  |	TIMER_WORKERS NUMBER
+	{
+		if( $2 > IKED_WORKERS_MAX )
+			error( @$, std::string( "timer worker count exceeds maximum" ) );
+		else
+			iked.timer_workers = $2;
+	}
+	EOS
+  |	DH_POOL_DEPTH NUMBER
+	{
+		if( $2 > DH_POOL_MAX )
+			error( @$, std::string( "dh pool depth exceeds maximum" ) );
+		else
+			iked.dh_pool_depth = $2;
+	}
+	EOS
+  |	XAUTH_WORKERS NUMBER
+	{
+		if( $2 > IKED_WORKERS_MAX )
+			error( @$, std::string( "xauth worker count exceeds maximum" ) );
+		else
+			iked.xauth_workers = $2;
+	}
+	EOS
   ;
 
 /*
@@ -551,6 +590,30 @@ xauth_ldap_line
 #ifdef OPT_LDAP
 		iked.xauth_ldap.attr_member.set( *$2 );
 		delete $2;
+#endif
+	}
+	EOS
+  |	LD_AUTH_LIMIT NUMBER
+	{
+#ifdef OPT_LDAP
+		iked.xauth_ldap.conc_max = $2;
+#endif
+	}
+	EOS
+  |	LD_CONN_MAX NUMBER
+	{
+#ifdef OPT_LDAP
+		if( $2 > LDAP_CONN_MAX )
+			error( @$, std::string( "ldap connection maximum exceeds limit" ) );
+		else
+			iked.xauth_ldap.conn_max = $2;
+#endif
+	}
+	EOS
+  |	LD_CACHE_LIFE NUMBER
+	{
+#ifdef OPT_LDAP
+		iked.xauth_ldap.cache_life = $2;
 #endif
 	}
 	EOS
@@ -1025,6 +1088,10 @@ peer_line
 			true,
 			fpass ) != FILE_OK )
 			error( @$, std::string( "unable to load file " ) + $3->text() );
+
+		peer->cert_r_path.set( *$3 );
+		peer->cert_r_pass = fpass;
+
 		delete $3;
 	}
 	EOS
@@ -1039,6 +1106,9 @@ peer_line
 			fpass ) != FILE_OK )
 			error( @$, std::string( "unable to load file " ) + $3->text() );
 
+		peer->cert_r_path.set( *$3 );
+		peer->cert_r_pass = fpass;
+
 		delete $3;
 		delete $4;
 	}
@@ -1445,6 +1515,26 @@ proposal_line_isakmp
 				proposal.dhgr_id = IKE_GRP_GROUP18;
 				break;
 
+#ifdef DH_HAVE_ECP
+			case 19:
+				proposal.dhgr_id = IKE_GRP_GROUP19;
+				break;
+
+			case 20:
+				proposal.dhgr_id = IKE_GRP_GROUP20;
+				break;
+
+			case 21:
+				proposal.dhgr_id = IKE_GRP_GROUP21;
+				break;
+#else
+			case 19:
+			case 20:
+			case 21:
+				error( @$, std::string( "unsupported dhgrp id ( no ecp support )" ) );
+				break;
+#endif
+
 			default:
 				error( @$, std::string( "invalid dhgrp id" ) );
 				break;
@@ -1534,6 +1624,26 @@ proposal_line_ah
 				proposal.dhgr_id = IKE_GRP_GROUP18;
 				break;
 
+#ifdef DH_HAVE_ECP
+			case 19:
+				proposal.dhgr_id = IKE_GRP_GROUP19;
+				break;
+
+			case 20:
+				proposal.dhgr_id = IKE_GRP_GROUP20;
+				break;
+
+			case 21:
+				proposal.dhgr_id = IKE_GRP_GROUP21;
+				break;
+#else
+			case 19:
+			case 20:
+			case 21:
+				error( @$, std::string( "unsupported dhgrp id ( no ecp support )" ) );
+				break;
+#endif
+
 			default:
 				error( @$, std::string( "invalid dhgrp id" ) );
 				break;
@@ -1648,6 +1758,26 @@ proposal_line_esp
 				proposal.dhgr_id = IKE_GRP_GROUP18;
 				break;
 
+#ifdef DH_HAVE_ECP
+			case 19:
+				proposal.dhgr_id = IKE_GRP_GROUP19;
+				break;
+
+			case 20:
+				proposal.dhgr_id = IKE_GRP_GROUP20;
+				break;
+
+			case 21:
+				proposal.dhgr_id = IKE_GRP_GROUP21;
+				break;
+#else
+			case 19:
+			case 20:
+			case 21:
+				error( @$, std::string( "unsupported dhgrp id ( no ecp support )" ) );
+				break;
+#endif
+
 			default:
 				error( @$, std::string( "invalid dhgrp id" ) );
 				break;
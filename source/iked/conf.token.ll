@@ -137,6 +137,10 @@ if( yy_first_time )
 <SEC_DAEMON>pcap_encrypt	{ return( token::PCAP_ENCRYPT ); }
 <SEC_DAEMON>retry_delay		{ return( token::RETRY_DELAY ); }
 <SEC_DAEMON>retry_count		{ return( token::RETRY_COUNT ); }
+<SEC_DAEMON>ike_workers		{ return( token::IKE_WORKERS ); }
+<SEC_DAEMON>timer_workers	{ return( token::TIMER_WORKERS ); }
+<SEC_DAEMON>dh_pool		{ return( token::DH_POOL_DEPTH ); }
+<SEC_DAEMON>xauth_workers	{ return( token::XAUTH_WORKERS ); }
 <SEC_DAEMON>{ecb}		{ BEGIN SEC_ROOT; return( token::ECB ); }
 
 <SEC_ROOT>netgroup		{ BEGIN SEC_NETGROUP; return( token::NETGROUP ); }
@@ -148,6 +152,9 @@ if( yy_first_time )
 <SEC_XA_LDAP>version		{ return( token::LD_VERSION ); }
 <SEC_XA_LDAP>url		{ return( token::LD_URL ); }
 <SEC_XA_LDAP>base		{ return( token::LD_BASE ); }
+<SEC_XA_LDAP>auth_limit		{ return( token::LD_AUTH_LIMIT ); }
+<SEC_XA_LDAP>conn_max		{ return( token::LD_CONN_MAX ); }
+<SEC_XA_LDAP>cache_life		{ return( token::LD_CACHE_LIFE ); }
 <SEC_XA_LDAP>subtree		{ return( token::LD_SUBTREE ); }
 <SEC_XA_LDAP>enable		{ return( token::ENABLE ); }
 <SEC_XA_LDAP>disable		{ return( token::DISABLE ); }
@@ -41,18 +41,135 @@
 
 #include "crypto.h"
 
+static void dh_params_init();
+static void dh_params_done();
+
+//
+// openssl versions prior to 1.1.0 are only
+// thread safe when the application provides
+// locking and thread id callbacks
+//
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+
+static ITH_LOCK *	crypto_locks = NULL;
+
+static void crypto_lock( int mode, int type, const char * file, int line )
+{
+	if( mode & CRYPTO_LOCK )
+		crypto_locks[ type ].lock();
+	else
+		crypto_locks[ type ].unlock();
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10000000L
+
+static void crypto_thread_id( CRYPTO_THREADID * tid )
+{
+
+#ifdef WIN32
+
+	CRYPTO_THREADID_set_numeric( tid, ( unsigned long ) GetCurrentThreadId() );
+
+#endif
+
+#ifdef UNIX
+
+	CRYPTO_THREADID_set_numeric( tid, ( unsigned long ) pthread_self() );
+
+#endif
+
+}
+
+#else
+
+static unsigned long crypto_thread_id()
+{
+
+#ifdef WIN32
+
+	return ( unsigned long ) GetCurrentThreadId();
+
+#endif
+
+#ifdef UNIX
+
+	return ( unsigned long ) pthread_self();
+
+#endif
+
+}
+
+#endif
+
+static void crypto_locks_init()
+{
+	crypto_locks = new ITH_LOCK[ CRYPTO_num_locks() ];
+
+#if OPENSSL_VERSION_NUMBER >= 0x10000000L
+
+	CRYPTO_THREADID_set_callback( crypto_thread_id );
+
+#else
+
+	CRYPTO_set_id_callback( crypto_thread_id );
+
+#endif
+
+	CRYPTO_set_locking_callback( crypto_lock );
+}
+
+static void crypto_locks_done()
+{
+	CRYPTO_set_locking_callback( NULL );
+
+#if OPENSSL_VERSION_NUMBER >= 0x10000000L
+
+	CRYPTO_THREADID_set_callback( NULL );
+
+#else
+
+	CRYPTO_set_id_callback( NULL );
+
+#endif
+
+	if( crypto_locks != NULL )
+		delete [] crypto_locks;
+
+	crypto_locks = NULL;
+}
+
+#else
+
+static void crypto_locks_init()
+{
+}
+
+static void crypto_locks_done()
+{
+}
+
+#endif
+
 void crypto_init()
 {
+	crypto_locks_init();
+
 	OpenSSL_add_all_algorithms();
 	ERR_load_crypto_strings();
 
+	dh_params_init();
 }
 
 void crypto_done()
 {
+	dh_params_done();
+
 	ERR_free_strings();
 	EVP_cleanup();
 	CRYPTO_cleanup_all_ex_data();
+
+	crypto_locks_done();
 }
 
 static unsigned char group1[] =
@@ -370,99 +487,567 @@ static unsigned char group18[] =
 	0xFF, 0xFF, 0xFF, 0xFF
 };
 
-bool dh_init( long group, DH ** dh_data, long * dh_size )
+//
+// the group parameters are built once at
+// startup and copied into each new dh key
+//
+
+typedef struct _DH_GROUP
+{
+	long			group;
+	long			type;
+	unsigned char *	data;
+	size_t			size;
+	int				nid;
+
+	BIGNUM *		p;
+	EC_GROUP *		ecg;
+
+}DH_GROUP;
+
+static DH_GROUP dh_groups[ DH_GROUP_COUNT ] =
+{
+	{ 1, DH_TYPE_MODP, group1, sizeof( group1 ), 0, NULL, NULL },
+	{ 2, DH_TYPE_MODP, group2, sizeof( group2 ), 0, NULL, NULL },
+	{ 5, DH_TYPE_MODP, group5, sizeof( group5 ), 0, NULL, NULL },
+	{ 14, DH_TYPE_MODP, group14, sizeof( group14 ), 0, NULL, NULL },
+	{ 15, DH_TYPE_MODP, group15, sizeof( group15 ), 0, NULL, NULL },
+	{ 16, DH_TYPE_MODP, group16, sizeof( group16 ), 0, NULL, NULL },
+	{ 17, DH_TYPE_MODP, group17, sizeof( group17 ), 0, NULL, NULL },
+	{ 18, DH_TYPE_MODP, group18, sizeof( group18 ), 0, NULL, NULL },
+	{ 19, DH_TYPE_ECP, NULL, 32, NID_X9_62_prime256v1, NULL, NULL },
+	{ 20, DH_TYPE_ECP, NULL, 48, NID_secp384r1, NULL, NULL },
+	{ 21, DH_TYPE_ECP, NULL, 66, NID_secp521r1, NULL, NULL }
+};
+
+static BIGNUM * dh_g = NULL;
+
+static void dh_params_init()
+{
+	for( long slot = 0; slot < DH_GROUP_COUNT; slot++ )
+	{
+		DH_GROUP * group = &dh_groups[ slot ];
+
+		switch( group->type )
+		{
+			case DH_TYPE_MODP:
+				group->p = BN_bin2bn( group->data, ( int ) group->size, NULL );
+				break;
+
+#ifdef DH_HAVE_ECP
+
+			case DH_TYPE_ECP:
+				group->ecg = EC_GROUP_new_by_curve_name( group->nid );
+				break;
+
+#endif
+		}
+	}
+
+	dh_g = BN_new();
+	if( dh_g != NULL )
+		BN_set_word( dh_g, 2 );
+}
+
+static void dh_params_done()
+{
+	for( long slot = 0; slot < DH_GROUP_COUNT; slot++ )
+	{
+		DH_GROUP * group = &dh_groups[ slot ];
+
+		if( group->p != NULL )
+			BN_free( group->p );
+
+		group->p = NULL;
+
+#ifdef DH_HAVE_ECP
+
+		if( group->ecg != NULL )
+			EC_GROUP_free( group->ecg );
+
+		group->ecg = NULL;
+
+#endif
+	}
+
+	if( dh_g != NULL )
+		BN_free( dh_g );
+
+	dh_g = NULL;
+}
+
+static long dh_slot( long group )
+{
+	for( long slot = 0; slot < DH_GROUP_COUNT; slot++ )
+		if( dh_groups[ slot ].group == group )
+			return slot;
+
+	return -1;
+}
+
+// ecp public values contain both the x and y coordinates
+
+static long dh_pubsize( DH_KEY * dh_data )
+{
+	if( dh_data->type == DH_TYPE_ECP )
+		return dh_data->size * 2;
+
+	return dh_data->size;
+}
+
+// big number to fixed size big endian value
+
+static bool dh_bn2bin( const BIGNUM * bn, unsigned char * buff, long size )
+{
+	long bn_size = BN_num_bytes( bn );
+	if( bn_size > size )
+		return false;
+
+	memset( buff, 0, size - bn_size );
+	BN_bn2bin( bn, buff + size - bn_size );
+
+	return true;
+}
+
+static DH * dh_init_modp( DH_GROUP * group )
 {
+	if( ( group->p == NULL ) || ( dh_g == NULL ) )
+		return NULL;
+
 	DH * dh = DH_new();
 	if( dh == NULL )
-		return false;
+		return NULL;
 
 	dh->p = NULL;
 	dh->g = NULL;
 	dh->length = 0;
 
 	//
-	// set p ( prime ) value
+	// set p ( prime ) and g ( generator ) values
 	//
 
-	unsigned char * p_data = NULL;
-	size_t			p_size = 0;
-
-	dh->p = BN_new();
+	dh->p = BN_dup( group->p );
 	if( dh->p == NULL )
 		goto dh_failed;
 
-	switch( group )
+	dh->g = BN_dup( dh_g );
+	if( dh->g == NULL )
+		goto dh_failed;
+
+	//
+	// generate private and public DH values
+	//
+
+	if( !DH_generate_key( dh ) )
+		goto dh_failed;
+
+	return dh;
+
+	dh_failed:
+
+	DH_free( dh );
+
+	return NULL;
+}
+
+bool dh_init( long group, DH_KEY ** dh_data, long * dh_size )
+{
+	long slot = dh_slot( group );
+	if( slot < 0 )
+		return false;
+
+	DH_GROUP * dh_group = &dh_groups[ slot ];
+
+	DH_KEY * dh_key = new DH_KEY;
+	if( dh_key == NULL )
+		return false;
+
+	memset( dh_key, 0, sizeof( DH_KEY ) );
+
+	dh_key->type = dh_group->type;
+	dh_key->size = ( long ) dh_group->size;
+
+	switch( dh_group->type )
 	{
-		case 1:
-			if( !BN_bin2bn( group1, sizeof( group1 ), dh->p ) )
+		case DH_TYPE_MODP:
+		{
+			dh_key->dh = dh_init_modp( dh_group );
+			if( dh_key->dh == NULL )
 				goto dh_failed;
-			break;
 
-		case 2:
-			if( !BN_bin2bn( group2, sizeof( group2 ), dh->p ) )
-				goto dh_failed;
-			break;
+			dh_key->size = BN_num_bytes( dh_key->dh->p );
 
-		case 5:
-			if( !BN_bin2bn( group5, sizeof( group5 ), dh->p ) )
-				goto dh_failed;
 			break;
+		}
 
-		case 14:
-			if( !BN_bin2bn( group14, sizeof( group14 ), dh->p ) )
-				goto dh_failed;
-			break;
+#ifdef DH_HAVE_ECP
 
-		case 15:
-			if( !BN_bin2bn( group15, sizeof( group15 ), dh->p ) )
+		case DH_TYPE_ECP:
+		{
+			if( dh_group->ecg == NULL )
 				goto dh_failed;
-			break;
 
-		case 16:
-			if( !BN_bin2bn( group16, sizeof( group16 ), dh->p ) )
+			dh_key->ec = EC_KEY_new();
+			if( dh_key->ec == NULL )
 				goto dh_failed;
-			break;
 
-		case 17:
-			if( !BN_bin2bn( group17, sizeof( group17 ), dh->p ) )
+			if( !EC_KEY_set_group( dh_key->ec, dh_group->ecg ) )
 				goto dh_failed;
-			break;
 
-		case 18:
-			if( !BN_bin2bn( group18, sizeof( group18 ), dh->p ) )
+			if( !EC_KEY_generate_key( dh_key->ec ) )
 				goto dh_failed;
+
 			break;
+		}
+
+#endif
 
 		default:
 			goto dh_failed;
 	}
 
+	*dh_data = dh_key;
+	*dh_size = dh_pubsize( dh_key );
+
+	return true;
+
+	dh_failed:
+
+	dh_free( dh_key );
+
+	return false;
+}
+
+void dh_free( DH_KEY * dh_data )
+{
+	if( dh_data->dh != NULL )
+		DH_free( dh_data->dh );
+
+#ifdef DH_HAVE_ECP
+
+	if( dh_data->ec != NULL )
+		EC_KEY_free( dh_data->ec );
+
+#endif
+
+	delete dh_data;
+}
+
+bool dh_pubkey( DH_KEY * dh_data, BDATA & pubkey )
+{
+	switch( dh_data->type )
+	{
+		case DH_TYPE_MODP:
+		{
+			pubkey.size( dh_data->size );
+			return dh_bn2bin( dh_data->dh->pub_key, pubkey.buff(), dh_data->size );
+		}
+
+#ifdef DH_HAVE_ECP
+
+		case DH_TYPE_ECP:
+		{
+			const EC_GROUP * ecg = EC_KEY_get0_group( dh_data->ec );
+			const EC_POINT * ecp = EC_KEY_get0_public_key( dh_data->ec );
+
+			BIGNUM * x = BN_new();
+			BIGNUM * y = BN_new();
+
+			bool result =
+				( x != NULL ) && ( y != NULL ) &&
+				EC_POINT_get_affine_coordinates_GFp( ecg, ecp, x, y, NULL );
+
+			if( result )
+			{
+				pubkey.size( dh_data->size * 2 );
+
+				result =
+					dh_bn2bin( x, pubkey.buff(), dh_data->size ) &&
+					dh_bn2bin( y, pubkey.buff() + dh_data->size, dh_data->size );
+			}
+
+			BN_free( x );
+			BN_free( y );
+
+			return result;
+		}
+
+#endif
+	}
+
+	return false;
+}
+
+bool dh_prvkey( DH_KEY * dh_data, BDATA & prvkey )
+{
+	switch( dh_data->type )
+	{
+		case DH_TYPE_MODP:
+		{
+			prvkey.size( dh_data->size );
+			return dh_bn2bin( dh_data->dh->priv_key, prvkey.buff(), dh_data->size );
+		}
+
+#ifdef DH_HAVE_ECP
+
+		case DH_TYPE_ECP:
+		{
+			prvkey.size( dh_data->size );
+			return dh_bn2bin( EC_KEY_get0_private_key( dh_data->ec ), prvkey.buff(), dh_data->size );
+		}
+
+#endif
+	}
+
+	return false;
+}
+
+bool dh_compute( DH_KEY * dh_data, BDATA & pubkey, BDATA & shared )
+{
+	switch( dh_data->type )
+	{
+		case DH_TYPE_MODP:
+		{
+			BIGNUM * gx = BN_bin2bn( pubkey.buff(), ( int ) pubkey.size(), NULL );
+			if( gx == NULL )
+				return false;
+
+			shared.size( dh_data->size );
+			long result = DH_compute_key( shared.buff(), gx, dh_data->dh );
+			BN_free( gx );
+
+			if( result < 0 )
+				return false;
+
+			//
+			// fixup shared secret buffer alignment
+			//
+
+			if( dh_data->size > result )
+			{
+				shared.size( result );
+				shared.ins( 0, dh_data->size - result );
+			}
+
+			return true;
+		}
+
+#ifdef DH_HAVE_ECP
+
+		case DH_TYPE_ECP:
+		{
+			if( pubkey.size() != ( size_t ) dh_data->size * 2 )
+				return false;
+
+			const EC_GROUP * ecg = EC_KEY_get0_group( dh_data->ec );
+
+			BIGNUM * x = BN_bin2bn( pubkey.buff(), dh_data->size, NULL );
+			BIGNUM * y = BN_bin2bn( pubkey.buff() + dh_data->size, dh_data->size, NULL );
+			EC_POINT * ecp = EC_POINT_new( ecg );
+
+			//
+			// the peer point must be valid and
+			// on our curve before it is used
+			//
+
+			bool result =
+				( x != NULL ) && ( y != NULL ) && ( ecp != NULL ) &&
+				EC_POINT_set_affine_coordinates_GFp( ecg, ecp, x, y, NULL ) &&
+				( EC_POINT_is_on_curve( ecg, ecp, NULL ) > 0 );
+
+			if( result )
+			{
+				shared.size( dh_data->size );
+				result = ( ECDH_compute_key( shared.buff(), dh_data->size, ecp, dh_data->ec, NULL ) == dh_data->size );
+			}
+
+			if( ecp != NULL )
+				EC_POINT_free( ecp );
+
+			BN_free( x );
+			BN_free( y );
+
+			return result;
+		}
+
+#endif
+	}
+
+	return false;
+}
+
+//
+// dh key pool
+//
+
+_DH_POOL::_DH_POOL()
+{
+	memset( slots, 0, sizeof( slots ) );
+
+	depth = 0;
+	stop = false;
+
+	lock.name( "dh pool" );
+	cond.name( "dh pool" );
+	exit.name( "dh pool" );
+}
+
+bool _DH_POOL::init( long set_depth )
+{
+	if( set_depth <= 0 )
+		return true;
+
+	if( set_depth > DH_POOL_MAX )
+		set_depth = DH_POOL_MAX;
+
+	depth = set_depth;
+	stop = false;
+
+	if( !exec( NULL ) )
+	{
+		depth = 0;
+		return false;
+	}
+
+	return true;
+}
+
+void _DH_POOL::done()
+{
+	if( !depth )
+		return;
+
 	//
-	// set g ( generator ) value
+	// stop our refill thread
 	//
 
-	dh->g = BN_new();
-	if( dh->g == NULL )
-		goto dh_failed;
+	lock.lock();
+	stop = true;
+	lock.unlock();
 
-	if( !BN_set_word( dh->g, 2 ) )
-		goto dh_failed;
+	cond.alert();
+	exit.wait( -1 );
 
 	//
-	// generate private and public DH values
+	// free all unused keys
 	//
 
-	if( !DH_generate_key( dh ) )
-		goto dh_failed;
+	for( long slot = 0; slot < DH_GROUP_COUNT; slot++ )
+	{
+		while( slots[ slot ].count )
+			dh_free( slots[ slot ].keys[ --slots[ slot ].count ] );
+
+		slots[ slot ].active = false;
+	}
+
+	depth = 0;
+}
+
+bool _DH_POOL::get( long group, DH_KEY ** dh_data, long * dh_size )
+{
+	long slot = dh_slot( group );
+	if( ( slot < 0 ) || !depth )
+		return dh_init( group, dh_data, dh_size );
+
+	//
+	// take a pre-generated key if one
+	// is available and request a refill
+	//
+
+	lock.lock();
+
+	DH_POOL_SLOT * pool = &slots[ slot ];
+	DH_KEY * dh = NULL;
+
+	if( pool->count )
+	{
+		dh = pool->keys[ --pool->count ];
+		pool->hits++;
+	}
+	else
+		pool->misses++;
+
+	pool->active = true;
+
+	lock.unlock();
+
+	cond.alert();
+
+	if( dh == NULL )
+		return dh_init( group, dh_data, dh_size );
 
 	*dh_data = dh;
-	*dh_size = BN_num_bytes( dh->p );
+	*dh_size = dh_pubsize( dh );
 
 	return true;
+}
 
-	dh_failed:
+bool _DH_POOL::stats( long index, long & group, unsigned long & hits, unsigned long & misses )
+{
+	if( ( index < 0 ) || ( index >= DH_GROUP_COUNT ) )
+		return false;
 
-	DH_free( dh );
+	lock.lock();
 
-	return false;
+	group = dh_groups[ index ].group;
+	hits = slots[ index ].hits;
+	misses = slots[ index ].misses;
+
+	lock.unlock();
+
+	return true;
+}
+
+long _DH_POOL::func( void * arg )
+{
+	while( true )
+	{
+		cond.wait( -1 );
+		cond.reset();
+
+		//
+		// refill all active group pools
+		// up to the configured depth
+		//
+
+		lock.lock();
+
+		for( long slot = 0; ( slot < DH_GROUP_COUNT ) && !stop; slot++ )
+		{
+			DH_POOL_SLOT * pool = &slots[ slot ];
+
+			while( pool->active && ( pool->count < depth ) && !stop )
+			{
+				lock.unlock();
+
+				DH_KEY * dh;
+				long dh_size;
+
+				bool created = dh_init( dh_groups[ slot ].group, &dh, &dh_size );
+
+				lock.lock();
+
+				if( !created )
+					break;
+
+				if( pool->count < depth )
+					pool->keys[ pool->count++ ] = dh;
+				else
+					dh_free( dh );
+			}
+		}
+
+		bool halt = stop;
+
+		lock.unlock();
+
+		if( halt )
+			break;
+	}
+
+	ERR_remove_state( 0 );
+
+	exit.alert();
+
+	return 0;
 }
@@ -45,15 +45,101 @@
 #include "openssl/dh.h"
 #include "openssl/evp.h"
 #include "openssl/md5.h"
+#include "openssl/sha.h"
 #include "openssl/hmac.h"
 #include "openssl/pem.h"
 #include "openssl/pkcs12.h"
 #include "openssl/err.h"
 #include "openssl/rand.h"
+#include "libith.h"
+#include "libidb.h"
+
+#ifndef OPENSSL_NO_ECDH
+# include "openssl/ec.h"
+# include "openssl/ecdh.h"
+# define DH_HAVE_ECP
+#endif
 
 void crypto_init();
 void crypto_done();
 
-bool dh_init( long group, DH ** dh_data, long * dh_size );
+//
+// a dh key holds a modp or ecp key pair.
+// the size is the field size in bytes and
+// the shared secret is always padded to
+// this size
+//
+
+#define DH_TYPE_MODP	1
+#define DH_TYPE_ECP		2
+
+#ifndef DH_HAVE_ECP
+typedef struct ec_key_st EC_KEY;
+#endif
+
+typedef struct _DH_KEY
+{
+	long		type;
+	long		size;
+
+	DH *		dh;			// modp key
+	EC_KEY *	ec;			// ecp key
+
+}DH_KEY;
+
+bool dh_init( long group, DH_KEY ** dh_data, long * dh_size );
+void dh_free( DH_KEY * dh_data );
+
+bool dh_pubkey( DH_KEY * dh_data, BDATA & pubkey );
+bool dh_prvkey( DH_KEY * dh_data, BDATA & prvkey );
+bool dh_compute( DH_KEY * dh_data, BDATA & pubkey, BDATA & shared );
+
+//
+// the dh key pool holds pre-generated key
+// pairs for each group. a group pool is
+// activated the first time a key is requested
+// and refilled by a background thread
+//
+
+#define DH_GROUP_COUNT	11
+#define DH_POOL_MAX		64
+
+typedef struct _DH_POOL_SLOT
+{
+	DH_KEY *		keys[ DH_POOL_MAX ];
+	long			count;
+	bool			active;
+
+	unsigned long	hits;
+	unsigned long	misses;
+
+}DH_POOL_SLOT;
+
+typedef class _DH_POOL : public ITH_EXEC
+{
+	private:
+
+	ITH_LOCK		lock;
+	ITH_COND		cond;
+	ITH_COND		exit;
+
+	DH_POOL_SLOT	slots[ DH_GROUP_COUNT ];
+
+	long	depth;
+	bool	stop;
+
+	long	func( void * arg );
+
+	public:
+
+	_DH_POOL();
+
+	bool	init( long set_depth );
+	void	done();
+
+	bool	get( long group, DH_KEY ** dh_data, long * dh_size );
+	bool	stats( long index, long & group, unsigned long & hits, unsigned long & misses );
+
+}DH_POOL;
 
 #endif
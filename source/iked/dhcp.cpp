@@ -131,7 +131,7 @@ long _IKED::socket_dhcp_create( IDB_TUNNEL * tunnel )
 	// add tunnel dhcp event
 	//
 
-	tunnel->inc( true );
+	tunnel->inc();
 	tunnel->event_dhcp.delay = 1000;
 
 	ith_timer.add( &tunnel->event_dhcp );
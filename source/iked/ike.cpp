@@ -196,10 +196,10 @@ long _IKED::packet_ike_send( IDB_PH1 * ph1, IDB_XCH * xch, PACKET_IKE & packet,
 			packet_frag.done();
 
 			//
-			// transmit the packet
+			// queue the packet
 			//
 
-			packet_ike_xmit( ph1, xch, packet_frag, retry );
+			packet_ike_queue( ph1, xch, packet_frag );
 
 			//
 			// log the result
@@ -223,12 +223,18 @@ long _IKED::packet_ike_send( IDB_PH1 * ph1, IDB_XCH * xch, PACKET_IKE & packet,
 	else
 	{
 		//
-		// transmit the packet
+		// queue the packet
 		//
 
-		packet_ike_xmit( ph1, xch, packet, retry );
+		packet_ike_queue( ph1, xch, packet );
 	}
 
+	//
+	// transmit all queued packets
+	//
+
+	packet_ike_xmit( ph1, xch );
+
 	//
 	// potentially schedule resend
 	//
@@ -239,22 +245,8 @@ long _IKED::packet_ike_send( IDB_PH1 * ph1, IDB_XCH * xch, PACKET_IKE & packet,
 	return LIBIKE_OK;
 }
 
-long _IKED::packet_ike_xmit( IDB_PH1 * ph1, IDB_XCH * xch, PACKET_IKE & packet, bool retry )
+long _IKED::packet_ike_queue( IDB_PH1 * ph1, IDB_XCH * xch, PACKET_IKE & packet )
 {
-	//
-	// prepare for log output
-	//
-
-	char txtaddr_l[ LIBIKE_MAX_TEXTADDR ];
-	char txtaddr_r[ LIBIKE_MAX_TEXTADDR ];
-
-	text_addr( txtaddr_l, &ph1->tunnel->saddr_l, true );
-	text_addr( txtaddr_r, &ph1->tunnel->saddr_r, true );
-
-	char * encap_mode = encap_ike;
-	if( ph1->tunnel->natt_version != IPSEC_NATT_NONE )
-		encap_mode = encap_nat;
-
 	//
 	// encapsulate ike packet into UDP/IP packet
 	//
@@ -271,26 +263,69 @@ long _IKED::packet_ike_xmit( IDB_PH1 * ph1, IDB_XCH * xch, PACKET_IKE & packet,
 	// log the result
 	//
 
-	log.bin(
-		LLOG_DEBUG,
-		LLOG_DECODE,
-		packet_ip.buff(),
-		packet_ip.size(),
-		"-> : send %s packet %s -> %s",
-		encap_mode,
-		txtaddr_l,
-		txtaddr_r );
+	if( log.enabled( LLOG_DEBUG ) )
+	{
+		char txtaddr_l[ LIBIKE_MAX_TEXTADDR ];
+		char txtaddr_r[ LIBIKE_MAX_TEXTADDR ];
+
+		text_addr( txtaddr_l, &ph1->tunnel->saddr_l, true );
+		text_addr( txtaddr_r, &ph1->tunnel->saddr_r, true );
+
+		char * encap_mode = encap_ike;
+		if( ph1->tunnel->natt_version != IPSEC_NATT_NONE )
+			encap_mode = encap_nat;
+
+		log.bin(
+			LLOG_DEBUG,
+			LLOG_DECODE,
+			packet_ip.buff(),
+			packet_ip.size(),
+			"-> : send %s packet %s -> %s",
+			encap_mode,
+			txtaddr_l,
+			txtaddr_r );
+	}
+
+	//
+	// queue packet for send and resend
+	//
+
+	if( !xch->resend_queue( packet_ip ) )
+		return LIBIKE_MEMORY;
+
+	return LIBIKE_OK;
+}
 
+long _IKED::packet_ike_xmit( IDB_PH1 * ph1, IDB_XCH * xch )
+{
 	//
-	// send ike packet
+	// send all queued ike packets. a
+	// fragment train is sent as a batch
 	//
 
 	ETH_HEADER header;
 
+	xch->lock.lock();
+
 	long result = send_ip(
-					packet_ip,
+					xch->event_resend.ipqueue,
 					&header );
 
+	//
+	// dump for encoded packets
+	//
+
+	if( ( result == LIBIKE_OK ) && dump_encrypt )
+	{
+		long count = xch->event_resend.ipqueue.count();
+		long index = 0;
+
+		for( ; index < count; index++ )
+			pcap_encrypt.dump( header, *xch->event_resend.ipqueue.get( index ) );
+	}
+
+	xch->lock.unlock();
+
 	if( result != LIBIKE_OK )
 	{
 		ph1->status( XCH_STATUS_DEAD, XCH_FAILED_NETWORK, 0 );
@@ -298,19 +333,6 @@ long _IKED::packet_ike_xmit( IDB_PH1 * ph1, IDB_XCH * xch, PACKET_IKE & packet,
 		return LIBIKE_FAILED;
 	}
 
-	//
-	// queue packet for resend
-	//
-
-	xch->resend_queue( packet_ip );
-
-	//
-	// dump for encoded packets
-	//
-
-	if( dump_encrypt )
-		pcap_encrypt.dump( header, packet_ip );
-
 	return LIBIKE_OK;
 }
 
@@ -322,6 +344,8 @@ long _IKED::packet_ike_encap( PACKET_IKE & packet_ike, PACKET_IP & packet_ip, IK
 		src.saddr4.sin_port,
 		dst.saddr4.sin_port );
 
+	packet_udp.reserve( packet_udp.size() + 4 + packet_ike.size() );
+
 	if( natt >= IPSEC_NATT_V02 )
 		packet_udp.add_null( 4 );
 
@@ -337,6 +361,7 @@ long _IKED::packet_ike_encap( PACKET_IKE & packet_ike, PACKET_IP & packet_ip, IK
 		ident++,
 		PROTO_IP_UDP );
 
+	packet_ip.reserve( packet_ip.size() + packet_udp.size() );
 	packet_ip.add( packet_udp );
 
 	packet_ip.done();
@@ -394,25 +419,7 @@ long _IKED::packet_ike_decrypt( IDB_PH1 * sa, PACKET_IKE & packet, BDATA * iv )
 	EVP_CIPHER_CTX ctx_cipher;
 	EVP_CIPHER_CTX_init( &ctx_cipher );
 
-	EVP_CipherInit_ex(
-		&ctx_cipher,
-		sa->evp_cipher,
-		NULL,
-		NULL,
-		NULL,
-		0 );
-
-	EVP_CIPHER_CTX_set_key_length(
-		&ctx_cipher,
-		( int ) sa->key.size() );
-
-	EVP_CipherInit_ex(
-		&ctx_cipher,
-		NULL,
-		NULL,
-		sa->key.buff(),
-		iv->buff(),
-		0 );
+	sa->cipher_init( &ctx_cipher, iv, 0 );
 
 	//
 	// decrypt all but header
@@ -598,25 +605,7 @@ long _IKED::packet_ike_encrypt( IDB_PH1 * sa, PACKET_IKE & packet, BDATA * iv )
 	EVP_CIPHER_CTX ctx_cipher;
 	EVP_CIPHER_CTX_init( &ctx_cipher );
 
-	EVP_CipherInit_ex(
-		&ctx_cipher,
-		sa->evp_cipher,
-		NULL,
-		NULL,
-		NULL,
-		1 );
-
-	EVP_CIPHER_CTX_set_key_length(
-		&ctx_cipher,
-		( int ) sa->key.size() );
-
-	EVP_CipherInit_ex(
-		&ctx_cipher,
-		NULL,
-		NULL,
-		sa->key.buff(),
-		iv->buff(),
-		1 );
+	sa->cipher_init( &ctx_cipher, iv, 1 );
 
 	EVP_Cipher(
 		&ctx_cipher,
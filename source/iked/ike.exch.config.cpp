@@ -71,6 +71,19 @@ long _IKED::process_config_recv( IDB_PH1 * ph1, PACKET_IKE & packet, unsigned ch
 		cfg->add( true );
 	}
 
+	//
+	// make sure we are not waiting on
+	// an xauth worker to resume this
+	// config exchange
+	//
+
+	if( cfg->xstate & CSTATE_WAIT_XRSLT )
+	{
+		log.txt( LLOG_ERROR, "!! : config packet ignored ( xauth request pending )\n" );
+		cfg->dec( true );
+		return LIBIKE_OK;
+	}
+
 	//
 	// if the msgid has changed, set the
 	// config msgid value and the iv
@@ -209,7 +222,7 @@ long _IKED::process_config_recv( IDB_PH1 * ph1, PACKET_IKE & packet, unsigned ch
 			{
 				result = payload_get_hash( packet, cfg->hash_r, ph1->hash_size );
 
-				cfg->xstate |= XSTATE_RECV_HA;
+				ith_atomic_or( &cfg->xstate, XSTATE_RECV_HA );
 
 				break;
 			}
@@ -491,24 +504,24 @@ bool _IKED::config_client_xauth_recv( IDB_CFG * cfg, IDB_PH1 * ph1 )
 
 				case XAUTH_USER_NAME:
 				case CHKPT_USER_NAME:
-					cfg->xstate |= CSTATE_RECV_XUSER;
+					ith_atomic_or( &cfg->xstate, CSTATE_RECV_XUSER );
 					log.txt( LLOG_INFO, "ii : - xauth username\n" );
 					break;
 
 				case XAUTH_USER_PASSWORD:
 				case CHKPT_USER_PASSWORD:
-					cfg->xstate |= CSTATE_RECV_XPASS;
+					ith_atomic_or( &cfg->xstate, CSTATE_RECV_XPASS );
 					log.txt( LLOG_INFO, "ii : - xauth password\n" );
 					break;
 
 				case XAUTH_PASSCODE:
-					cfg->xstate |= CSTATE_RECV_XPASS | CSTATE_USE_PASSCODE;
+					ith_atomic_or( &cfg->xstate, CSTATE_RECV_XPASS | CSTATE_USE_PASSCODE );
 					log.txt( LLOG_INFO, "ii : - xauth passcode\n" );
 					break;
 
 				case XAUTH_CHALLENGE:
 				case CHKPT_CHALLENGE:
-					cfg->xstate |= CSTATE_RECV_XPASS;
+					ith_atomic_or( &cfg->xstate, CSTATE_RECV_XPASS );
 					log.txt( LLOG_INFO, "ii : - xauth challenge\n" );
 					if( !attr->basic )
 						cfg->tunnel->xauth.hash = attr->vdata;
@@ -646,11 +659,11 @@ bool _IKED::config_client_xauth_recv( IDB_CFG * cfg, IDB_PH1 * ph1 )
 		// gateway bypasses xauth on rekey
 		//
 
-		cfg->xstate |= CSTATE_SENT_XUSER;
-		cfg->xstate |= CSTATE_SENT_XPASS;
-		cfg->xstate |= CSTATE_RECV_XUSER;
-		cfg->xstate |= CSTATE_RECV_XPASS;
-		cfg->xstate |= CSTATE_RECV_XRSLT;
+		ith_atomic_or( &cfg->xstate, CSTATE_SENT_XUSER );
+		ith_atomic_or( &cfg->xstate, CSTATE_SENT_XPASS );
+		ith_atomic_or( &cfg->xstate, CSTATE_RECV_XUSER );
+		ith_atomic_or( &cfg->xstate, CSTATE_RECV_XPASS );
+		ith_atomic_or( &cfg->xstate, CSTATE_RECV_XRSLT );
 
 		return false;
 	}
@@ -687,7 +700,7 @@ bool _IKED::config_client_xauth_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 					cfg->tunnel->xauth.user.buff(),
 					cfg->tunnel->xauth.user.size() );
 
-				cfg->xstate |= CSTATE_SENT_XUSER;
+				ith_atomic_or( &cfg->xstate, CSTATE_SENT_XUSER );
 
 				log.txt( LLOG_INFO,
 					"ii : - standard xauth username\n" );
@@ -760,7 +773,7 @@ bool _IKED::config_client_xauth_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 					}
 				}
 
-				cfg->xstate |= CSTATE_SENT_XPASS;
+				ith_atomic_or( &cfg->xstate, CSTATE_SENT_XPASS );
 			}
 		}
 		else
@@ -778,7 +791,7 @@ bool _IKED::config_client_xauth_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 					cfg->tunnel->xauth.user.buff(),
 					cfg->tunnel->xauth.user.size() );
 
-				cfg->xstate |= CSTATE_SENT_XUSER;
+				ith_atomic_or( &cfg->xstate, CSTATE_SENT_XUSER );
 
 				log.txt( LLOG_INFO,
 					"ii : - checkpoint xauth username\n" );
@@ -828,7 +841,7 @@ bool _IKED::config_client_xauth_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 					}
 				}
 
-				cfg->xstate |= CSTATE_SENT_XPASS;
+				ith_atomic_or( &cfg->xstate, CSTATE_SENT_XPASS );
 			}
 		}
 
@@ -877,7 +890,7 @@ bool _IKED::config_client_xauth_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 		log.txt( LLOG_INFO, "ii : sending xauth acknowledge\n" );
 		config_message_send( ph1, cfg );
 
-		cfg->xstate |= CSTATE_SENT_XRSLT;
+		ith_atomic_or( &cfg->xstate, CSTATE_SENT_XRSLT );
 
 		return true;
 	}
@@ -911,7 +924,7 @@ bool _IKED::config_client_xconf_pull_recv( IDB_CFG * cfg, IDB_PH1 * ph1 )
 
 		cfg->tunnel->xconf.opts |= cfg->tunnel->xconf.rqst & getbits;
 
-		cfg->xstate |= CSTATE_RECV_XCONF;
+		ith_atomic_or( &cfg->xstate, CSTATE_RECV_XCONF );
 
 		return false;
 	}
@@ -962,7 +975,7 @@ bool _IKED::config_client_xconf_pull_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 			log.txt( LLOG_INFO, "ii : sending config pull request\n" );
 			config_message_send( ph1, cfg );
 
-			cfg->xstate |= CSTATE_SENT_XCONF;
+			ith_atomic_or( &cfg->xstate, CSTATE_SENT_XCONF );
 		}
 		else
 		{
@@ -972,8 +985,8 @@ bool _IKED::config_client_xconf_pull_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 
 			log.txt( LLOG_INFO, "ii : config pull is not required\n" );
 
-			cfg->xstate |= CSTATE_SENT_XCONF;
-			cfg->xstate |= CSTATE_RECV_XCONF;
+			ith_atomic_or( &cfg->xstate, CSTATE_SENT_XCONF );
+			ith_atomic_or( &cfg->xstate, CSTATE_RECV_XCONF );
 		}
 
 		return false;
@@ -1012,7 +1025,7 @@ bool _IKED::config_client_xconf_push_recv( IDB_CFG * cfg, IDB_PH1 * ph1 )
 		// config is now mature
 		//
 
-		cfg->xstate |= CSTATE_RECV_XCONF;
+		ith_atomic_or( &cfg->xstate, CSTATE_RECV_XCONF );
 
 		return false;
 	}
@@ -1051,7 +1064,7 @@ bool _IKED::config_client_xconf_push_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 		log.txt( LLOG_INFO, "ii : sending config push acknowledge\n" );
 		config_message_send( ph1, cfg );
 
-		cfg->xstate |= CSTATE_SENT_XCONF;
+		ith_atomic_or( &cfg->xstate, CSTATE_SENT_XCONF );
 
 		return false;
 	}
@@ -1080,12 +1093,12 @@ bool _IKED::config_server_xauth_recv( IDB_CFG * cfg, IDB_PH1 * ph1 )
 			switch( attr->atype )
 			{
 				case XAUTH_USER_NAME:
-					cfg->xstate |= CSTATE_RECV_XUSER;
+					ith_atomic_or( &cfg->xstate, CSTATE_RECV_XUSER );
 					cfg->tunnel->xauth.user.set( attr->vdata );
 					break;
 
 				case XAUTH_USER_PASSWORD:
-					cfg->xstate |= CSTATE_RECV_XPASS;
+					ith_atomic_or( &cfg->xstate, CSTATE_RECV_XPASS );
 					cfg->tunnel->xauth.pass.set( attr->vdata );
 					break;
 			}
@@ -1104,7 +1117,7 @@ bool _IKED::config_server_xauth_recv( IDB_CFG * cfg, IDB_PH1 * ph1 )
 	{
 		log.txt( LLOG_INFO, "ii : received xauth ack\n" );
 
-		cfg->xstate |= CSTATE_RECV_XRSLT;
+		ith_atomic_or( &cfg->xstate, CSTATE_RECV_XRSLT );
 
 		if( cfg->tunnel->peer->xconf_mode != CONFIG_MODE_PUSH )
 			cfg->status( XCH_STATUS_MATURE, XCH_NORMAL, 0 );
@@ -1146,8 +1159,8 @@ bool _IKED::config_server_xauth_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 		// flag as sent
 		//
 
-		cfg->xstate |= CSTATE_SENT_XUSER;
-		cfg->xstate |= CSTATE_SENT_XPASS;
+		ith_atomic_or( &cfg->xstate, CSTATE_SENT_XUSER );
+		ith_atomic_or( &cfg->xstate, CSTATE_SENT_XPASS );
 
 		log.txt( LLOG_INFO, "ii : sent xauth request\n" );
 
@@ -1156,98 +1169,89 @@ bool _IKED::config_server_xauth_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 
 	if( !( cfg->xstate & CSTATE_SENT_XRSLT ) )
 	{
-		bool allow = false;
-		if( cfg->tunnel->xauth.user.size() &&
-			cfg->tunnel->xauth.pass.size() )
-			allow = true;
-
 		//
-		// check user password
+		// without both a user name and a
+		// password the request is denied
 		//
 
-		if( allow )
+		if( !cfg->tunnel->xauth.user.size() ||
+			!cfg->tunnel->xauth.pass.size() )
 		{
-			cfg->tunnel->xauth.user.add( 0, 1 );
-			cfg->tunnel->xauth.pass.add( 0, 1 );
-
-			allow = cfg->tunnel->peer->xauth_source->auth_pwd(
-						cfg->tunnel->xauth );
-
-			if( allow )
-				iked.log.txt( LLOG_INFO,
-					"ii : xauth user %s password accepted ( %s )\n",
-					cfg->tunnel->xauth.user.text(),
-					cfg->tunnel->peer->xauth_source->name() );
-			else
-				iked.log.txt( LLOG_ERROR,
-					"!! : xauth user %s password rejected ( %s )\n",
-					cfg->tunnel->xauth.user.text(),
-					cfg->tunnel->peer->xauth_source->name() );
+			config_server_xauth_rslt( cfg, ph1, false );
+			return false;
 		}
 
+		cfg->tunnel->xauth.user.add( 0, 1 );
+		cfg->tunnel->xauth.pass.add( 0, 1 );
+
 		//
-		// check user group membership
+		// hand the request off to our xauth
+		// worker threads. the exchange will be
+		// resumed once the result is known
 		//
 
-		if( allow && cfg->tunnel->peer->xauth_group.size() )
+		if( xauth_workers )
 		{
-			allow = cfg->tunnel->peer->xauth_source->auth_grp(
+			ith_atomic_or( &cfg->xstate, CSTATE_WAIT_XRSLT );
+			xauth_queue( cfg, ph1 );
+
+			return false;
+		}
+
+		bool allow = xauth_check(
+						cfg->tunnel->peer->xauth_source,
 						cfg->tunnel->xauth,
 						cfg->tunnel->peer->xauth_group );
 
-			if( allow )
-				log.txt( LLOG_INFO,
-					"ii : xauth user %s group %s membership accepted ( %s )\n",
-					cfg->tunnel->xauth.user.text(),
-					cfg->tunnel->peer->xauth_group.text(),
-					cfg->tunnel->peer->xauth_source->name() );
-			else
-				log.txt( LLOG_ERROR,
-					"!! : xauth user %s group %s membership rejected ( %s )\n",
-					cfg->tunnel->xauth.user.text(),
-					cfg->tunnel->peer->xauth_group.text(),
-					cfg->tunnel->peer->xauth_source->name() );
-		}
+		config_server_xauth_rslt( cfg, ph1, allow );
 
-		//
-		// set result attributes
-		//
+		return false;
+	}
 
-		cfg->mtype = ISAKMP_CFG_SET;
+	return false;
+}
 
-		if( allow )
-			cfg->attr_add_b( XAUTH_STATUS, 1 );
-		else
-			cfg->attr_add_b( XAUTH_STATUS, 0 );
+void _IKED::config_server_xauth_rslt( IDB_CFG * cfg, IDB_PH1 * ph1, bool allow )
+{
+	//
+	// set result attributes
+	//
 
-		//
-		// create new msgid and iv
-		//
+	cfg->attr_reset();
 
-		cfg->new_msgid();
-		cfg->new_msgiv( ph1 );
+	cfg->mtype = ISAKMP_CFG_SET;
 
-		//
-		// send config packet
-		//
+	if( allow )
+		cfg->attr_add_b( XAUTH_STATUS, 1 );
+	else
+		cfg->attr_add_b( XAUTH_STATUS, 0 );
 
-		config_message_send( ph1, cfg );
+	//
+	// create new msgid and iv
+	//
 
-		//
-		// flag as sent and release
-		//
+	cfg->new_msgid();
+	cfg->new_msgiv( ph1 );
+
+	//
+	// flag as sent and release the exchange
+	// before the packet goes out so that the
+	// peer acknowledgment is not ignored
+	//
 
-		cfg->xstate |= CSTATE_SENT_XRSLT;
+	ith_atomic_or( &cfg->xstate, CSTATE_SENT_XRSLT );
+	ith_atomic_and( &cfg->xstate, ~CSTATE_WAIT_XRSLT );
 
-		log.txt( LLOG_INFO, "ii : sent xauth result\n" );
+	//
+	// send config packet
+	//
 
-		if( !allow )
-			ph1->status( XCH_STATUS_DEAD, XCH_FAILED_USER_AUTH, 0 );
+	config_message_send( ph1, cfg );
 
-		return false;
-	}
+	log.txt( LLOG_INFO, "ii : sent xauth result\n" );
 
-	return false;
+	if( !allow )
+		ph1->status( XCH_STATUS_DEAD, XCH_FAILED_USER_AUTH, 0 );
 }
 
 bool _IKED::config_server_xconf_pull_recv( IDB_CFG * cfg, IDB_PH1 * ph1 )
@@ -1265,7 +1269,7 @@ bool _IKED::config_server_xconf_pull_recv( IDB_CFG * cfg, IDB_PH1 * ph1 )
 			0,
 			ph1->vendopts_r );
 
-		cfg->xstate |= CSTATE_RECV_XCONF;
+		ith_atomic_or( &cfg->xstate, CSTATE_RECV_XCONF );
 
 		return false;
 	}
@@ -1344,7 +1348,7 @@ bool _IKED::config_server_xconf_push_recv( IDB_CFG * cfg, IDB_PH1 * ph1 )
 			0,
 			ph1->vendopts_r );
 
-		cfg->xstate |= CSTATE_RECV_XCONF;
+		ith_atomic_or( &cfg->xstate, CSTATE_RECV_XCONF );
 
 		return false;
 	}
@@ -1415,7 +1419,7 @@ bool _IKED::config_server_xconf_push_send( IDB_CFG * cfg, IDB_PH1 * ph1 )
 		// flag as sent
 		//
 
-		cfg->xstate |= CSTATE_SENT_XCONF;
+		ith_atomic_or( &cfg->xstate, CSTATE_SENT_XCONF );
 
 		return false;
 	}
@@ -2422,7 +2426,7 @@ long _IKED::config_xconf_get( IDB_CFG * cfg, long & getbits, long getmask, VENDO
 							cfg->tunnel->natt_version = IPSEC_NATT_CISCO;
 							cfg->tunnel->peer->natt_port = htons( attr->bdata );
 
-							cfg->tunnel->inc( true );
+							cfg->tunnel->inc();
 							cfg->tunnel->event_natt.delay = cfg->tunnel->peer->natt_rate * 1000;
 							ith_timer.add( &cfg->tunnel->event_natt );
 
@@ -2484,7 +2488,7 @@ long _IKED::config_chk_hash( IDB_PH1 * ph1, IDB_CFG * cfg, unsigned long msgid )
 	HMAC_CTX ctx_prf;
 	HMAC_CTX_init( &ctx_prf );
 
-	HMAC_Init_ex( &ctx_prf, ph1->skeyid_a.buff(), ( int ) ph1->skeyid_a.size(), ph1->evp_hash, NULL );
+	ph1->hmac_init_a( &ctx_prf );
 	HMAC_Update( &ctx_prf, ( unsigned char * ) &msgid, 4 );
 	HMAC_Update( &ctx_prf, cfg->hda.buff(), cfg->hda.size() );
 	HMAC_Final( &ctx_prf, hash_c.buff(), NULL );
@@ -2546,7 +2550,7 @@ long _IKED::config_message_send( IDB_PH1 * ph1, IDB_CFG * cfg )
 	HMAC_CTX ctx_prf;
 	HMAC_CTX_init( &ctx_prf );
 
-	HMAC_Init_ex( &ctx_prf, ph1->skeyid_a.buff(), ( int ) ph1->skeyid_a.size(), ph1->evp_hash, NULL );
+	ph1->hmac_init_a( &ctx_prf );
 	HMAC_Update( &ctx_prf, ( unsigned char * ) &cfg->msgid, sizeof( cfg->msgid ) );
 	HMAC_Update( &ctx_prf, packet.buff() + beg, end - beg );
 	HMAC_Final( &ctx_prf, hash.buff(), 0 );
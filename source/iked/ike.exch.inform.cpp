@@ -402,7 +402,7 @@ long _IKED::inform_chk_hash( IDB_PH1 * ph1, IDB_XCH * inform )
 	HMAC_CTX ctx_prf;
 	HMAC_CTX_init( &ctx_prf );
 
-	HMAC_Init_ex( &ctx_prf, ph1->skeyid_a.buff(), ( int ) ph1->skeyid_a.size(), ph1->evp_hash, NULL );
+	ph1->hmac_init_a( &ctx_prf );
 	HMAC_Update( &ctx_prf, ( unsigned char * ) &inform->msgid, 4 );
 	HMAC_Update( &ctx_prf, inform->hda.buff(), inform->hda.size() );
 	HMAC_Final( &ctx_prf, hash_c.buff(), NULL );
@@ -442,7 +442,7 @@ long _IKED::inform_gen_hash( IDB_PH1 * ph1, IDB_XCH * inform )
 	HMAC_CTX ctx_prf;
 	HMAC_CTX_init( &ctx_prf );
 
-	HMAC_Init_ex( &ctx_prf, ph1->skeyid_a.buff(), ( int ) ph1->skeyid_a.size(), ph1->evp_hash, NULL );
+	ph1->hmac_init_a( &ctx_prf );
 	HMAC_Update( &ctx_prf, ( unsigned char * ) &inform->msgid, sizeof( inform->msgid ) );
 	HMAC_Update( &ctx_prf, inform->hda.buff(), inform->hda.size() );
 	HMAC_Final( &ctx_prf, inform->hash_l.buff(), 0 );
@@ -603,7 +603,7 @@ long _IKED::inform_chk_notify( IDB_PH1 * ph1, IKE_NOTIFY * notify, bool secure )
 					// flag our existing phase1 object for removal
 					//
 
-					ph1->inc( true );
+					ph1->inc();
 					ph1->status( XCH_STATUS_DEAD, XCH_NORMAL, 0 );
 					ph1->dec( true );
 
@@ -644,6 +644,9 @@ long _IKED::inform_chk_notify( IDB_PH1 * ph1, IKE_NOTIFY * notify, bool secure )
 					ph1_ulb->tunnel->saddr_r = ph1_ulb->tunnel->peer->saddr;
 					ph1_ulb->tunnel->saddr_l.saddr4.sin_port = htons( 500 );
 
+					iked.idb_list_peer.index_addr( true, ph1_ulb->tunnel->peer );
+					iked.idb_list_tunnel.index_addr( true, ph1_ulb->tunnel );
+
 					//
 					// reinitialize our filter
 					//
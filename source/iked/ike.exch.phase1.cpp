@@ -641,7 +641,7 @@ long _IKED::process_phase1_send( IDB_PH1 * ph1 )
 
 						BDATA sign;
 						phase1_gen_hash_i( ph1, ph1->hash_l );
-						prvkey_rsa_encrypt( ph1->tunnel->peer->cert_k, ph1->hash_l, sign );
+						prvkey_rsa_encrypt( ph1->tunnel->peer, ph1->hash_l, sign );
 						payload_add_sign( packet, sign, ISAKMP_PAYLOAD_NONE );
 
 						ph1->xstate |= XSTATE_SENT_CT;
@@ -873,7 +873,7 @@ long _IKED::process_phase1_send( IDB_PH1 * ph1 )
 
 						BDATA sign;
 						phase1_gen_hash_r( ph1, ph1->hash_l );
-						prvkey_rsa_encrypt( ph1->tunnel->peer->cert_k, ph1->hash_l, sign );
+						prvkey_rsa_encrypt( ph1->tunnel->peer, ph1->hash_l, sign );
 						payload_add_sign( packet, sign, ISAKMP_PAYLOAD_NONE );
 
 						//
@@ -1120,7 +1120,7 @@ long _IKED::process_phase1_send( IDB_PH1 * ph1 )
 
 							BDATA sign;
 							phase1_gen_hash_i( ph1, ph1->hash_l );
-							prvkey_rsa_encrypt( ph1->tunnel->peer->cert_k, ph1->hash_l, sign );
+							prvkey_rsa_encrypt( ph1->tunnel->peer, ph1->hash_l, sign );
 							payload_add_sign( packet, sign, ph1->natt_pldtype );
 
 							//
@@ -1225,7 +1225,7 @@ long _IKED::process_phase1_send( IDB_PH1 * ph1 )
 
 						BDATA sign;
 						phase1_gen_hash_r( ph1, ph1->hash_l );
-						prvkey_rsa_encrypt( ph1->tunnel->peer->cert_k, ph1->hash_l, sign );
+						prvkey_rsa_encrypt( ph1->tunnel->peer, ph1->hash_l, sign );
 						payload_add_sign( packet, sign, ISAKMP_PAYLOAD_VEND );
 
 						ph1->xstate |= XSTATE_SENT_CT;
@@ -1352,7 +1352,7 @@ long _IKED::process_phase1_send( IDB_PH1 * ph1 )
 
 			if( ph1->tunnel->natt_version != IPSEC_NATT_NONE )
 			{
-				ph1->tunnel->inc( true );
+				ph1->tunnel->inc();
 				ph1->tunnel->event_natt.delay = ph1->tunnel->peer->natt_rate * 1000;
 
 				ith_timer.add( &ph1->tunnel->event_natt );
@@ -1367,7 +1367,7 @@ long _IKED::process_phase1_send( IDB_PH1 * ph1 )
 			{
 				ph1->tunnel->stats.dpd = true;
 
-				ph1->tunnel->inc( true );
+				ph1->tunnel->inc();
 				ph1->tunnel->event_dpd.delay = ph1->tunnel->peer->dpd_delay * 1000;
 
 				ith_timer.add( &ph1->tunnel->event_dpd );
@@ -1468,7 +1468,7 @@ long _IKED::process_phase1_send( IDB_PH1 * ph1 )
 		// add pahse1 soft expire event
 		//
 
-		ph1->inc( true );
+		ph1->inc();
 		ph1->event_soft.delay = proposal->life_sec;
 		ph1->event_soft.delay *= PFKEY_SOFT_LIFETIME_RATE;
 		ph1->event_soft.delay /= 100;
@@ -1480,7 +1480,7 @@ long _IKED::process_phase1_send( IDB_PH1 * ph1 )
 		// add pahse1 hard expire event
 		//
 
-		ph1->inc( true );
+		ph1->inc();
 		ph1->event_hard.delay = proposal->life_sec;
 		ph1->event_hard.delay *= 1000;
 
@@ -1490,7 +1490,7 @@ long _IKED::process_phase1_send( IDB_PH1 * ph1 )
 		// add pahse1 dead event
 		//
 
-		ph1->inc( true );
+		ph1->inc();
 		ph1->event_dead.delay = proposal->life_sec + 6;
 		ph1->event_dead.delay *= 1000;
 
@@ -1556,8 +1556,7 @@ long _IKED::phase1_gen_keys( IDB_PH1 * ph1 )
 	if( level >= LLOG_DECODE )
 	{
 		BDATA prv;
-		prv.size( ph1->dh_size );
-		BN_bn2bin( ph1->dh->priv_key, prv.buff() );
+		dh_prvkey( ph1->dh, prv );
 
 		log.bin(
 			LLOG_DECODE,
@@ -1600,15 +1599,9 @@ long _IKED::phase1_gen_keys( IDB_PH1 * ph1 )
 	// determine shared secret
 	//
 
-	BIGNUM * gx = BN_new();
-	BN_bin2bn( ph1->xr.buff(), ph1->dh_size, gx );
-
 	BDATA shared;
-	shared.set( 0, ph1->dh_size );
-	long result = DH_compute_key( shared.buff(), gx, ph1->dh );
-	BN_free( gx );
 
-	if( result < 0 )
+	if( !dh_compute( ph1->dh, ph1->xr, shared ) )
 	{
 		log.txt( LLOG_ERROR,
 			"!! : failed to compute DH shared secret\n" );
@@ -1617,19 +1610,6 @@ long _IKED::phase1_gen_keys( IDB_PH1 * ph1 )
 		return LIBIKE_FAILED;
 	}
 
-	//
-	// fixup shared secret buffer alignment
-	//
-
-	if( ph1->dh_size > result )
-	{
-		log.txt( LLOG_DEBUG,
-			"ww : short DH shared secret computed\n" );
-
-		shared.size( result );
-		shared.ins( 0, ph1->dh_size - result );
-	}
-
 	log.bin(
 		LLOG_DEBUG,
 		LLOG_DECODE,
@@ -1886,6 +1866,14 @@ long _IKED::phase1_gen_keys( IDB_PH1 * ph1 )
 		iv_size,
 		"== : cipher iv" );
 
+	//
+	// setup our keyed cipher and hmac
+	// templates for future messages
+	//
+
+	if( !ph1->setup_ctx() )
+		log.txt( LLOG_ERROR, "!! : failed to setup keyed cipher contexts\n" );
+
 	//
 	// flag key material calculated
 	//
@@ -2517,7 +2505,7 @@ long _IKED::phase1_chk_sign( IDB_PH1 * ph1 )
 
 	BDATA cert;
 
-	if( !cert_verify( ph1->certs_r, ph1->tunnel->peer->cert_r, cert ) )
+	if( !cert_verify( ph1->certs_r, ph1->tunnel->peer, cert ) )
 	{
 		log.txt( LLOG_ERROR, "!! : unable to verify remote peer certificate\n" );
 		return LIBIKE_FAILED;
@@ -2528,9 +2516,9 @@ long _IKED::phase1_chk_sign( IDB_PH1 * ph1 )
 	// peer provided certificate
 	//
 
-	BDATA pubkey;
+	RSA * pubkey = pubkey_rsa_get( ph1->tunnel->peer, cert );
 
-	if( !pubkey_rsa_read( cert, pubkey ) )
+	if( pubkey == NULL )
 	{
 		log.txt( LLOG_ERROR, "!! : unable to extract public key from remote peer certificate\n" );
 		return LIBIKE_FAILED;
@@ -2542,7 +2530,11 @@ long _IKED::phase1_chk_sign( IDB_PH1 * ph1 )
 	// by the remote peer
 	//
 
-	if( !pubkey_rsa_decrypt( pubkey, ph1->sign_r, ph1->hash_r ) )
+	bool decrypted = pubkey_rsa_decrypt( pubkey, ph1->sign_r, ph1->hash_r );
+
+	RSA_free( pubkey );
+
+	if( !decrypted )
 	{
 		log.txt( LLOG_ERROR, "!! : unable to compute remote peer signed hash\n" );
 		return LIBIKE_FAILED;
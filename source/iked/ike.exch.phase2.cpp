@@ -331,6 +331,8 @@ long _IKED::process_phase2_recv( IDB_PH1 * ph1, PACKET_IKE & packet, unsigned ch
 					result = payload_get_sa( packet, ph2->plist_r );
 					size_t end = packet.oset();
 
+					idb_list_ph2.index_spi( true, ph2 );
+
 					ph2->hda.add( packet.buff() + beg, end - beg );
 				}
 
@@ -1011,7 +1013,7 @@ long _IKED::phase2_gen_hash_i( IDB_PH1 * ph1, IDB_PH2 * ph2, BDATA & hash )
 	HMAC_CTX ctx_prf;
 	HMAC_CTX_init( &ctx_prf );
 
-	HMAC_Init_ex( &ctx_prf, ph1->skeyid_a.buff(), ( int ) ph1->skeyid_a.size(), ph1->evp_hash, NULL );
+	ph1->hmac_init_a( &ctx_prf );
 	HMAC_Update( &ctx_prf, input.buff(), input.size() );
 	HMAC_Final( &ctx_prf, hash.buff(), NULL );
 
@@ -1051,7 +1053,7 @@ long _IKED::phase2_gen_hash_r( IDB_PH1 * ph1, IDB_PH2 * ph2, BDATA & hash )
 	HMAC_CTX ctx_prf;
 	HMAC_CTX_init( &ctx_prf );
 
-	HMAC_Init_ex( &ctx_prf, ph1->skeyid_a.buff(), ( int ) ph1->skeyid_a.size(), ph1->evp_hash, NULL );
+	ph1->hmac_init_a( &ctx_prf );
 	HMAC_Update( &ctx_prf, input.buff(), input.size() );
 	HMAC_Final( &ctx_prf, hash.buff(), NULL );
 
@@ -1096,7 +1098,7 @@ long _IKED::phase2_gen_hash_p( IDB_PH1 * ph1, IDB_PH2 * ph2, BDATA & hash )
 	HMAC_CTX ctx_prf;
 	HMAC_CTX_init( &ctx_prf );
 
-	HMAC_Init_ex( &ctx_prf, ph1->skeyid_a.buff(), ( int ) ph1->skeyid_a.size(), ph1->evp_hash, NULL );
+	ph1->hmac_init_a( &ctx_prf );
 	HMAC_Update( &ctx_prf, input.buff(), input.size() );
 	HMAC_Final( &ctx_prf, hash.buff(), 0 );
 
@@ -1290,6 +1292,8 @@ long _IKED::phase2_chk_params( IDB_PH1 * ph1, IDB_PH2 * ph2, PACKET_IKE & packet
 			return LIBIKE_FAILED;
 		}
 
+		idb_list_ph2.index_spi( true, ph2 );
+
 		ph2->lstate |= LSTATE_CHKPROP;
 
 		//
@@ -1507,6 +1511,8 @@ long _IKED::phase2_chk_params( IDB_PH1 * ph1, IDB_PH2 * ph2, PACKET_IKE & packet
 			return LIBIKE_FAILED;
 		}
 
+		idb_list_ph2.index_spi( true, ph2 );
+
 		ph2->lstate |= LSTATE_CHKPROP;
 
 		//
@@ -1554,8 +1560,7 @@ long _IKED::phase2_gen_keys( IDB_PH1 * ph1, IDB_PH2 * ph2 )
 		if( level >= LLOG_DECODE )
 		{
 			BDATA prv;
-			prv.size( ph2->dh_size );
-			BN_bn2bin( ph2->dh->priv_key, prv.buff() );
+			dh_prvkey( ph2->dh, prv );
 
 			log.bin(
 				LLOG_DECODE,
@@ -1598,14 +1603,7 @@ long _IKED::phase2_gen_keys( IDB_PH1 * ph1, IDB_PH2 * ph2 )
 		// determine shared secret
 		//
 
-		BIGNUM * gx = BN_new();
-		BN_bin2bn( ph2->xr.buff(), ph2->dh_size, gx );
-
-		shared.size( ph2->dh_size );
-		long result = DH_compute_key( shared.buff(), gx, ph2->dh );
-		BN_free( gx );
-
-		if( result < 0 )
+		if( !dh_compute( ph2->dh, ph2->xr, shared ) )
 		{
 			log.txt( LLOG_ERROR,
 				"!! : failed to compute PFS DH shared secret\n" );
@@ -1614,16 +1612,6 @@ long _IKED::phase2_gen_keys( IDB_PH1 * ph1, IDB_PH2 * ph2 )
 			return LIBIKE_FAILED;
 		}
 
-		//
-		// fixup shared secret buffer alignment
-		//
-
-		if( ph2->dh_size > result )
-		{
-			shared.size( result );
-			shared.ins( 0, ph2->dh_size - result );
-		}
-
 		log.bin(
 			LLOG_DEBUG,
 			LLOG_DECODE,
@@ -1663,8 +1651,8 @@ long _IKED::phase2_gen_keys( IDB_PH1 * ph1, IDB_PH2 * ph2 )
 	// and life time seconds
 	//
 
-	ph2->inc( true );
-	ph2->inc( true );
+	ph2->inc();
+	ph2->inc();
 
 	ph2->event_hard.delay = lifetime + 1;
 
@@ -1820,7 +1808,7 @@ long _IKED::phase2_gen_keys( IDB_PH1 * ph1, IDB_PH2 * ph2, long dir, IKE_PROPOSA
 	HMAC_CTX ctx_prf;
 	HMAC_CTX_init( &ctx_prf );
 
-	HMAC_Init_ex( &ctx_prf, ph1->skeyid_d.buff(), ( int ) ph1->skeyid_d.size(), ph1->evp_hash, NULL );
+	ph1->hmac_init_d( &ctx_prf );
 
 	if( ph2->dhgr_id )
 		HMAC_Update( &ctx_prf, shared.buff(), shared.size() );
@@ -1843,7 +1831,7 @@ long _IKED::phase2_gen_keys( IDB_PH1 * ph1, IDB_PH2 * ph2, long dir, IKE_PROPOSA
 
 	for( long size = skeyid_size; size < key_size; size += skeyid_size )
 	{
-		HMAC_Init_ex( &ctx_prf, ph1->skeyid_d.buff(), ( int ) ph1->skeyid_d.size(), ph1->evp_hash, NULL );
+		ph1->hmac_init_d( &ctx_prf );
 		HMAC_Update( &ctx_prf, key_data + size - skeyid_size, skeyid_size );
 
 		if( ph2->dhgr_id )
@@ -322,6 +322,9 @@
 #define IKE_GRP_GROUP16				16	// oakley modp 4096
 #define IKE_GRP_GROUP17				17	// oakley modp 6144
 #define IKE_GRP_GROUP18				18	// oakley modp 8192
+#define IKE_GRP_GROUP19				19	// ecp 256
+#define IKE_GRP_GROUP20				20	// ecp 384
+#define IKE_GRP_GROUP21				21	// ecp 521
 
 #define IKE_GRP_TYPE_MODP			1
 #define IKE_GRP_TYPE_ECP			2
@@ -88,7 +88,7 @@ bool _IDB_LIST_CFG::find( bool lock, IDB_CFG ** cfg, IDB_PH1 * ph1 )
 
 		if( cfg != NULL )
 		{
-			tmp_cfg->inc( false );
+			tmp_cfg->inc();
 			*cfg = tmp_cfg;
 		}
 
@@ -118,7 +118,7 @@ _IDB_CFG::_IDB_CFG( IDB_PH1 * set_ph1ref, bool set_initiator )
 
 	ph1ref = set_ph1ref;			// never accessed directly
 	tunnel = set_ph1ref->tunnel;
-	tunnel->inc( true );
+	tunnel->inc();
 
 	initiator = set_initiator;
 
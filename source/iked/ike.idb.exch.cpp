@@ -170,16 +170,9 @@ bool _IDB_XCH::resend()
 	lock.lock();
 
 	long count = event_resend.ipqueue.count();
-	long index = 0;
 
-	for( ; index < count; index++ )
-	{
-		PACKET_IP packet;
-		event_resend.ipqueue.get( packet, index );
-
-		iked.send_ip(
-			packet );
-	}
+	iked.send_ip(
+		event_resend.ipqueue );
 
 	lock.unlock();
 
@@ -206,12 +199,14 @@ bool _IDB_XCH::resend()
 bool _IDB_XCH::resend_queue( PACKET_IP & packet )
 {
 	//
-	// queue a packet
+	// queue a packet. the queue takes
+	// over the packet buffer so the same
+	// buffer is used for each resend
 	//
 
 	lock.lock();
 
-	bool added = event_resend.ipqueue.add( packet );
+	bool added = event_resend.ipqueue.add( packet, true );
 
 	lock.unlock();
 
@@ -247,10 +242,11 @@ bool _IDB_XCH::resend_sched( bool lock )
 		//
 
 		event_resend.delay = iked.retry_delay * 1000;
+		event_resend.group = tunnel;
 
 		if( iked.ith_timer.add( &event_resend ) )
 		{
-			idb_refcount++;
+			refinc();
 			iked.log.txt( LLOG_DEBUG,
 				"DB : %s resend event scheduled ( ref count = %i )\n",
 				name(),
@@ -284,7 +280,7 @@ void _IDB_XCH::resend_clear( bool lock, bool purge )
 
 	if( iked.ith_timer.del( &event_resend ) )
 	{
-		idb_refcount--;
+		refdec();
 		iked.log.txt( LLOG_DEBUG,
 			"DB : %s resend event canceled ( ref count = %i )\n",
 			name(),
@@ -418,9 +418,10 @@ bool _IKED_RC_ENTRY::add( bool lock )
 	if( lock )
 		list()->lock();
 
-	inc( false );
+	refinc();
 
 	list()->add_entry( this );
+	list()->index_add( this );
 
 	iked.log.txt(
 		LLOG_DEBUG,
@@ -434,26 +435,55 @@ bool _IKED_RC_ENTRY::add( bool lock )
 	return true;
 }
 
-void _IKED_RC_ENTRY::inc( bool lock )
+void _IKED_RC_ENTRY::inc()
 {
-	if( lock )
-		list()->lock();
+	//
+	// the caller already holds a reference
+	// or an idb lock so no lock is needed to
+	// take another one
+	//
 
-	idb_refcount++;
+	long count = refinc();
 
-	iked.log.txt(
-		LLOG_LOUD,
-		"DB : %s ref increment ( ref count = %i, obj count = %i )\n",
-		name(),
-		idb_refcount,
-		list()->count() );
-
-	if( lock )
-		list()->unlock();
+	if( iked.log.enabled( LLOG_LOUD ) )
+		iked.log.txt(
+			LLOG_LOUD,
+			"DB : %s ref increment ( ref count = %i, obj count = %i )\n",
+			name(),
+			count,
+			list()->count() );
 }
 
 bool _IKED_RC_ENTRY::dec( bool lock, bool setdel )
 {
+	//
+	// drop a reference that cannot be the
+	// last one without taking any lock
+	//
+
+	if( !setdel && !chkflags( ENTRY_FLAG_DEAD ) )
+	{
+		long count = idb_refcount;
+
+		while( count > 1 )
+		{
+			if( ith_atomic_cas( &idb_refcount, count, count - 1 ) )
+			{
+				if( iked.log.enabled( LLOG_LOUD ) )
+					iked.log.txt(
+						LLOG_LOUD,
+						"DB : %s ref decrement ( ref count = %i, obj count = %i )\n",
+						name(),
+						count - 1,
+						list()->count() );
+
+				return false;
+			}
+
+			count = idb_refcount;
+		}
+	}
+
 	if( lock )
 		list()->lock();
 
@@ -465,16 +495,17 @@ bool _IKED_RC_ENTRY::dec( bool lock, bool setdel )
 
 	assert( idb_refcount > 0 );
 
-	idb_refcount--;
+	long count = refdec();
 
-	if( idb_refcount || ( !chkflags( ENTRY_FLAG_DEAD ) && !chkflags( ENTRY_FLAG_IMMEDIATE ) ) )
+	if( count || ( !chkflags( ENTRY_FLAG_DEAD ) && !chkflags( ENTRY_FLAG_IMMEDIATE ) ) )
 	{
-		iked.log.txt(
-			LLOG_LOUD,
-			"DB : %s ref decrement ( ref count = %i, obj count = %i )\n",
-			name(),
-			idb_refcount,
-			list()->count() );
+		if( iked.log.enabled( LLOG_LOUD ) )
+			iked.log.txt(
+				LLOG_LOUD,
+				"DB : %s ref decrement ( ref count = %i, obj count = %i )\n",
+				name(),
+				count,
+				list()->count() );
 
 		if( lock )
 			list()->unlock();
@@ -482,6 +513,7 @@ bool _IKED_RC_ENTRY::dec( bool lock, bool setdel )
 		return false;
 	}
 
+	list()->index_del( this );
 	list()->del_entry( this );
 
 	iked.log.txt(
@@ -500,6 +532,13 @@ bool _IKED_RC_ENTRY::dec( bool lock, bool setdel )
 
 _IKED_RC_LIST::_IKED_RC_LIST()
 {
+	//
+	// entries are located through their
+	// list indexes so the list order is
+	// not preserved on removal
+	//
+
+	entry_order = false;
 }
 
 _IKED_RC_LIST::~_IKED_RC_LIST()
@@ -517,7 +556,7 @@ void _IKED_RC_LIST::clean()
 	{
 		IKED_RC_ENTRY * entry = static_cast<IKED_RC_ENTRY*>( get_entry( obj_index ) );
 
-		entry->inc( false );
+		entry->inc();
 		if( entry->dec( false, true ) )
 		{
 			obj_index--;
@@ -528,6 +567,14 @@ void _IKED_RC_LIST::clean()
 	unlock();
 }
 
+void _IKED_RC_LIST::index_add( IKED_RC_ENTRY * entry )
+{
+}
+
+void _IKED_RC_LIST::index_del( IKED_RC_ENTRY * entry )
+{
+}
+
 bool _IKED_RC_LIST::lock()
 {
 	return iked.lock_idb.lock();
@@ -45,6 +45,62 @@
 // ike peer list
 //==============================================================================
 
+_IDB_LIST_PEER::_IDB_LIST_PEER()
+{
+	next_order = 0;
+}
+
+void _IDB_LIST_PEER::index_add( IKED_RC_ENTRY * entry )
+{
+	IDB_PEER * peer = static_cast<IDB_PEER*>( entry );
+
+	//
+	// entries are appended to the list so
+	// the order value tracks list order
+	//
+
+	peer->idxorder = next_order++;
+	peer->idxwild = !has_sockaddr( &peer->saddr.saddr );
+	peer->idxkey_addr = key_sockaddr( peer->saddr.saddr );
+
+	if( peer->idxwild )
+		list_wild.add_entry( peer );
+	else
+		hash_addr.add_entry( peer->idxkey_addr, peer );
+}
+
+void _IDB_LIST_PEER::index_del( IKED_RC_ENTRY * entry )
+{
+	IDB_PEER * peer = static_cast<IDB_PEER*>( entry );
+
+	if( peer->idxwild )
+		list_wild.del_entry( peer );
+	else
+		hash_addr.del_entry( peer->idxkey_addr, peer );
+}
+
+void _IDB_LIST_PEER::index_addr( bool lock, IDB_PEER * peer )
+{
+	if( lock )
+		iked.lock_idb.lock();
+
+	//
+	// reindex the peer after its address
+	// has changed. the list order value
+	// is left untouched
+	//
+
+	long order = peer->idxorder;
+
+	index_del( peer );
+	index_add( peer );
+
+	peer->idxorder = order;
+
+	if( lock )
+		iked.lock_idb.unlock();
+}
+
 IDB_PEER * _IDB_LIST_PEER::get( int index )
 {
 	return static_cast<IDB_PEER*>( get_entry( index ) );
@@ -58,22 +114,58 @@ bool _IDB_LIST_PEER::find( bool lock, IDB_PEER ** peer, IKE_SADDR * saddr )
 	if( lock )
 		iked.lock_idb.lock();
 
-	long peer_count = count();
-	long peer_index = 0;
+	IDB_PEER * tmp_peer = NULL;
 
-	for( ; peer_index < peer_count; peer_index++ )
+	if( saddr != NULL )
 	{
-		IDB_PEER * tmp_peer = get( peer_index );
+		//
+		// select the matching peer that was
+		// added first from those indexed by
+		// the address and those that match
+		// any address
+		//
+
+		uint32_t key = key_sockaddr( saddr->saddr );
+		IDB_HASH_NODE * node = NULL;
+		IDB_PEER * next_peer;
+
+		while( ( next_peer = static_cast<IDB_PEER*>( hash_addr.get_entry( key, &node ) ) ) != NULL )
+			if( cmp_sockaddr( next_peer->saddr.saddr, saddr->saddr, false ) )
+				if( ( tmp_peer == NULL ) || ( next_peer->idxorder < tmp_peer->idxorder ) )
+					tmp_peer = next_peer;
+
+		long wild_count = list_wild.count();
+		long wild_index = 0;
 
+		for( ; wild_index < wild_count; wild_index++ )
+		{
+			next_peer = static_cast<IDB_PEER*>( list_wild.get_entry( wild_index ) );
+
+			if( ( tmp_peer == NULL ) || ( next_peer->idxorder < tmp_peer->idxorder ) )
+				tmp_peer = next_peer;
+		}
+	}
+	else
+	{
 		//
-		// match the peer address
+		// select the peer that was added
+		// first as list order is not kept
 		//
 
-		if( saddr != NULL )
-			if( has_sockaddr( &tmp_peer->saddr.saddr ) )
-				if( !cmp_sockaddr( tmp_peer->saddr.saddr, saddr->saddr, false ) )
-					continue;
+		long peer_count = count();
+		long peer_index = 0;
+
+		for( ; peer_index < peer_count; peer_index++ )
+		{
+			IDB_PEER * next_peer = get( peer_index );
+
+			if( ( tmp_peer == NULL ) || ( next_peer->idxorder < tmp_peer->idxorder ) )
+				tmp_peer = next_peer;
+		}
+	}
 
+	if( tmp_peer != NULL )
+	{
 		iked.log.txt( LLOG_DEBUG, "DB : peer found\n" );
 
 		//
@@ -82,7 +174,7 @@ bool _IDB_LIST_PEER::find( bool lock, IDB_PEER ** peer, IKE_SADDR * saddr )
 
 		if( peer != NULL )
 		{
-			tmp_peer->inc( false );
+			tmp_peer->inc();
 			*peer = tmp_peer;
 		}
 
@@ -117,10 +209,35 @@ _IDB_PEER::_IDB_PEER( IKE_PEER * set_peer )
 
 	if( set_peer != NULL )
 		*static_cast<IKE_PEER*>( this ) = *set_peer;
+
+	cert_r_time = 0;
+	cert_r_check = 0;
+	cert_r_store = NULL;
+
+	cert_k_rsa = NULL;
+	memset( cert_r_rsa, 0, sizeof( cert_r_rsa ) );
+	cert_r_used = 0;
+
+	cert_lock.name( "peer cert" );
 }
 
 _IDB_PEER::~_IDB_PEER()
 {
+	// release our certificate store
+
+	if( cert_r_store != NULL )
+		iked.cert_store_put( cert_r_store );
+
+	// release our parsed rsa keys
+
+	if( cert_k_rsa != NULL )
+		RSA_free( cert_k_rsa );
+
+	for( long index = 0; index < IKED_RSA_CACHE_SETS; index++ )
+		for( long way = 0; way < IKED_RSA_CACHE_WAYS; way++ )
+			if( cert_r_rsa[ index ][ way ].rsa != NULL )
+				RSA_free( cert_r_rsa[ index ][ way ].rsa );
+
 	// handle idb zero reference condition
 
 	iked.lock_run.lock();
@@ -172,7 +289,7 @@ void _IDB_PEER::end()
 
 		if( tunnel->peer == this )
 		{
-			tunnel->inc( false );
+			tunnel->inc();
 
 			if( tunnel->dec( false, true ) )
 			{
@@ -121,119 +121,194 @@ IDB_PH1 * _IDB_LIST_PH1::get( int index )
 	return static_cast<IDB_PH1*>( get_entry( index ) );
 }
 
-bool _IDB_LIST_PH1::find( bool lock, IDB_PH1 ** ph1, IDB_TUNNEL * tunnel, XCH_STATUS min, XCH_STATUS max, IKE_COOKIES * cookies )
+void _IDB_LIST_PH1::index_add( IKED_RC_ENTRY * entry )
 {
-	if( ph1 != NULL )
-		*ph1 = NULL;
-
-	if( lock )
-		iked.lock_idb.lock();
+	IDB_PH1 * ph1 = static_cast<IDB_PH1*>( entry );
 
 	//
-	// step through our list of sa's
-	// and locate a match
+	// the initiator cookie and tunnel are
+	// fixed when the sa is created so they
+	// are safe to use as index keys
 	//
 
-	long ph1_count = count();
-	long ph1_index = 0;
+	hash_cookies.add_entry(
+		IDB_HASH::hash( ph1->cookies.i, ISAKMP_COOKIE_SIZE ),
+		ph1 );
 
-	for( ; ph1_index < ph1_count; ph1_index++ )
-	{
-		//
-		// get the next sa in our list
-		//
+	hash_tunnel.add_entry(
+		IDB_HASH::hash( &ph1->tunnel, sizeof( ph1->tunnel ) ),
+		ph1 );
+}
 
-		IDB_PH1 * tmp_ph1 = get( ph1_index );
+void _IDB_LIST_PH1::index_del( IKED_RC_ENTRY * entry )
+{
+	IDB_PH1 * ph1 = static_cast<IDB_PH1*>( entry );
 
-		//
-		// match sa minimum status level
-		//
+	hash_cookies.del_entry(
+		IDB_HASH::hash( ph1->cookies.i, ISAKMP_COOKIE_SIZE ),
+		ph1 );
 
-		if( min != XCH_STATUS_ANY )
-			if( tmp_ph1->status() < min )
-				continue;
+	hash_tunnel.del_entry(
+		IDB_HASH::hash( &ph1->tunnel, sizeof( ph1->tunnel ) ),
+		ph1 );
+}
 
-		//
-		// match sa maximum status level
-		//
+bool _IDB_LIST_PH1::match( IDB_PH1 * tmp_ph1, IDB_TUNNEL * tunnel, XCH_STATUS min, XCH_STATUS max, IKE_COOKIES * cookies )
+{
+	//
+	// match sa minimum status level
+	//
 
-		if( max != XCH_STATUS_ANY )
-			if( tmp_ph1->status() > max )
-				continue;
+	if( min != XCH_STATUS_ANY )
+		if( tmp_ph1->status() < min )
+			return false;
+
+	//
+	// match sa maximum status level
+	//
+
+	if( max != XCH_STATUS_ANY )
+		if( tmp_ph1->status() > max )
+			return false;
+
+	//
+	// match the tunnel id
+	//
 
+	if( tunnel != NULL )
+		if( tmp_ph1->tunnel != tunnel )
+			return false;
+
+	//
+	// match the cookies
+	//
+
+	if( cookies != NULL )
+	{
 		//
-		// match the tunnel id
+		// next match the initiator cookie
 		//
 
-		if( tunnel != NULL )
-			if( tmp_ph1->tunnel != tunnel )
-				continue;
+		if( memcmp( tmp_ph1->cookies.i, cookies->i, ISAKMP_COOKIE_SIZE ) )
+		{
+			//
+			// the initiator cookie should
+			// always match if we are to
+			// return a known sa
+			//
+
+			return false;
+		}
 
 		//
-		// match the cookies
+		// next match the responder cookie
 		//
 
-		if( cookies != NULL )
+		if( memcmp( tmp_ph1->cookies.r, cookies->r, ISAKMP_COOKIE_SIZE ) )
 		{
 			//
-			// next match the initiator cookie
+			// responder cookie did not match,
+			// if we are the intiator for this
+			// sa, the responder cookie is null
+			// and we are waiting on an sa
+			// payload, it should match
 			//
 
-			if( memcmp( tmp_ph1->cookies.i, cookies->i, ISAKMP_COOKIE_SIZE ) )
+			if( tmp_ph1->initiator )
 			{
 				//
-				// the initiator cookie should
-				// always match if we are to
-				// return a known sa
+				// check to see if we solicited
+				// a response from this host
 				//
 
-				continue;
-			}
+				if( !( tmp_ph1->xstate & XSTATE_SENT_SA ) ||
+					 ( tmp_ph1->xstate & XSTATE_RECV_SA ) )
+					 return false;
 
-			//
-			// next match the responder cookie
-			//
+				//
+				// check the responder cookie
+				// for a null value
+				//
+
+				for( long x = 0; x < ISAKMP_COOKIE_SIZE; x++ )
+					if( tmp_ph1->cookies.r[ x ] )
+						continue;
 
-			if( memcmp( tmp_ph1->cookies.r, cookies->r, ISAKMP_COOKIE_SIZE ) )
-			{
 				//
-				// responder cookie did not match,
-				// if we are the intiator for this
-				// sa, the responder cookie is null
-				// and we are waiting on an sa
-				// payload, it should match
+				// store the responders cookie in
+				// our existing sa
 				//
 
-				if( tmp_ph1->initiator )
-				{
-					//
-					// check to see if we solicited
-					// a response from this host
-					//
-
-					if( !( tmp_ph1->xstate & XSTATE_SENT_SA ) ||
-						 ( tmp_ph1->xstate & XSTATE_RECV_SA ) )
-						 continue;
-
-					//
-					// check the responder cookie
-					// for a null value
-					//
-
-					for( long x = 0; x < ISAKMP_COOKIE_SIZE; x++ )
-						if( tmp_ph1->cookies.r[ x ] )
-							continue;
-
-					//
-					// store the responders cookie in
-					// our existing sa
-					//
-
-					memcpy( tmp_ph1->cookies.r, cookies->r, ISAKMP_COOKIE_SIZE );
-				}
+				memcpy( tmp_ph1->cookies.r, cookies->r, ISAKMP_COOKIE_SIZE );
+			}
+		}
+	}
+
+	return true;
+}
+
+bool _IDB_LIST_PH1::find( bool lock, IDB_PH1 ** ph1, IDB_TUNNEL * tunnel, XCH_STATUS min, XCH_STATUS max, IKE_COOKIES * cookies )
+{
+	if( ph1 != NULL )
+		*ph1 = NULL;
+
+	if( lock )
+		iked.lock_idb.lock();
+
+	IDB_PH1 * tmp_ph1 = NULL;
+
+	if( cookies != NULL )
+	{
+		//
+		// step through the sa's indexed
+		// by the initiator cookie
+		//
+
+		uint32_t key = IDB_HASH::hash( cookies->i, ISAKMP_COOKIE_SIZE );
+		IDB_HASH_NODE * node = NULL;
+
+		while( ( tmp_ph1 = static_cast<IDB_PH1*>( hash_cookies.get_entry( key, &node ) ) ) != NULL )
+			if( match( tmp_ph1, tunnel, min, max, cookies ) )
+				break;
+	}
+	else if( tunnel != NULL )
+	{
+		//
+		// step through the sa's indexed
+		// by the tunnel
+		//
+
+		uint32_t key = IDB_HASH::hash( &tunnel, sizeof( tunnel ) );
+		IDB_HASH_NODE * node = NULL;
+
+		while( ( tmp_ph1 = static_cast<IDB_PH1*>( hash_tunnel.get_entry( key, &node ) ) ) != NULL )
+			if( match( tmp_ph1, tunnel, min, max, cookies ) )
+				break;
+	}
+	else
+	{
+		//
+		// step through our list of sa's
+		// and locate a match
+		//
+
+		long ph1_count = count();
+		long ph1_index = 0;
+
+		for( ; ph1_index < ph1_count; ph1_index++ )
+		{
+			IDB_PH1 * next_ph1 = get( ph1_index );
+
+			if( match( next_ph1, tunnel, min, max, cookies ) )
+			{
+				tmp_ph1 = next_ph1;
+				break;
 			}
 		}
+	}
 
+	if( tmp_ph1 != NULL )
+	{
 		//
 		// looks like we found a match
 		//
@@ -246,7 +321,7 @@ bool _IDB_LIST_PH1::find( bool lock, IDB_PH1 ** ph1, IDB_TUNNEL * tunnel, XCH_ST
 
 		if( ph1 != NULL )
 		{
-			tmp_ph1->inc( false );
+			tmp_ph1->inc();
 			*ph1 = tmp_ph1;
 		}
 
@@ -284,12 +359,18 @@ _IDB_PH1::_IDB_PH1( IDB_TUNNEL * set_tunnel, bool set_initiator, IKE_COOKIES * s
 
 	hash_size = 0;
 
+	EVP_CIPHER_CTX_init( &ctx_encrypt );
+	EVP_CIPHER_CTX_init( &ctx_decrypt );
+	HMAC_CTX_init( &ctx_prf_a );
+	HMAC_CTX_init( &ctx_prf_d );
+	ctx_keyed = false;
+
 	//
 	// initialize associated tunnel
 	//
 
 	tunnel = set_tunnel;
-	tunnel->inc( true );
+	tunnel->inc();
 
 	//
 	// initialize initiator value
@@ -428,6 +509,15 @@ _IDB_PH1::_IDB_PH1( IDB_TUNNEL * set_tunnel, bool set_initiator, IKE_COOKIES * s
 	event_hard.ph1 = this;
 	event_dead.ph1 = this;
 
+	//
+	// events for the same tunnel are
+	// never executed concurrently
+	//
+
+	event_soft.group = tunnel;
+	event_hard.group = tunnel;
+	event_dead.group = tunnel;
+
 	//
 	// build text strings for logging
 	//
@@ -461,6 +551,11 @@ _IDB_PH1::~_IDB_PH1()
 {
 	clean();
 
+	EVP_CIPHER_CTX_cleanup( &ctx_encrypt );
+	EVP_CIPHER_CTX_cleanup( &ctx_decrypt );
+	HMAC_CTX_cleanup( &ctx_prf_a );
+	HMAC_CTX_cleanup( &ctx_prf_d );
+
 	//
 	// derefrence our tunnel
 	//
@@ -501,7 +596,7 @@ void _IDB_PH1::end()
 
 	if( iked.ith_timer.del( &event_soft ) )
 	{
-		idb_refcount--;
+		refdec();
 		iked.log.txt( LLOG_DEBUG,
 			"DB : phase1 soft event canceled ( ref count = %i )\n",
 			idb_refcount );
@@ -509,7 +604,7 @@ void _IDB_PH1::end()
 
 	if( iked.ith_timer.del( &event_hard ) )
 	{
-		idb_refcount--;
+		refdec();
 		iked.log.txt( LLOG_DEBUG,
 			"DB : phase1 hard event canceled ( ref count = %i )\n",
 			idb_refcount );
@@ -517,7 +612,7 @@ void _IDB_PH1::end()
 
 	if( iked.ith_timer.del( &event_dead ) )
 	{
-		idb_refcount--;
+		refdec();
 		iked.log.txt( LLOG_DEBUG,
 			"DB : phase1 dead event canceled ( ref count = %i )\n",
 			idb_refcount );
@@ -559,7 +654,7 @@ void _IDB_PH1::end()
 			IDB_CFG * cfg = iked.idb_list_cfg.get( cfg_index );
 			if( cfg->ph1ref == this )
 			{
-				cfg->inc( false );
+				cfg->inc();
 
 				cfg->status( XCH_STATUS_DEAD, XCH_FAILED_PENDING, 0 );
 
@@ -599,7 +694,7 @@ void _IDB_PH1::end()
 			IDB_PH2 * ph2 = iked.idb_list_ph2.get( ph2_index );
 			if( ( ph2->tunnel == tunnel ) && ( ph2->status() == XCH_STATUS_PENDING ) )
 			{
-				ph2->inc( false );
+				ph2->inc();
 
 				ph2->status( XCH_STATUS_DEAD, XCH_FAILED_PENDING, 0 );
 
@@ -669,24 +764,16 @@ bool _IDB_PH1::setup_dhgrp( IKE_PROPOSAL * proposal )
 	// initialize dh group
 	//
 
-	if( !dh_init( proposal->dhgr_id, &dh, &dh_size ) )
+	if( !iked.dh_pool.get( proposal->dhgr_id, &dh, &dh_size ) )
 	{
 		iked.log.txt( LLOG_ERROR, "ii : failed to setup DH group\n" );
 		return false;
 	}
 
-	xl.size( dh_size );
-	long result = BN_bn2bin( dh->pub_key, xl.buff() );
-
-	//
-	// fixup public buffer alignment
-	//
-
-	if( dh_size > result )
+	if( !dh_pubkey( dh, xl ) )
 	{
-		iked.log.txt( LLOG_DEBUG, "ww : short DH public value\n" );
-		xl.size( result );
-		xl.ins( 0, dh_size - result );
+		iked.log.txt( LLOG_ERROR, "ii : failed to read DH public value\n" );
+		return false;
 	}
 
 	return true;
@@ -799,11 +886,88 @@ bool _IDB_PH1::setup_xform( IKE_PROPOSAL * proposal )
 	return true;
 }
 
+bool _IDB_PH1::setup_ctx()
+{
+	//
+	// key our cipher templates
+	//
+
+	for( int encrypt = 0; encrypt < 2; encrypt++ )
+	{
+		EVP_CIPHER_CTX * ctx = encrypt ? &ctx_encrypt : &ctx_decrypt;
+
+		if( !EVP_CipherInit_ex( ctx, evp_cipher, NULL, NULL, NULL, encrypt ) )
+			return false;
+
+		if( !EVP_CIPHER_CTX_set_key_length( ctx, ( int ) key.size() ) )
+			return false;
+
+		if( !EVP_CipherInit_ex( ctx, NULL, NULL, key.buff(), NULL, encrypt ) )
+			return false;
+	}
+
+	//
+	// key our hmac templates
+	//
+
+	HMAC_Init_ex( &ctx_prf_a, skeyid_a.buff(), ( int ) skeyid_a.size(), evp_hash, NULL );
+	HMAC_Init_ex( &ctx_prf_d, skeyid_d.buff(), ( int ) skeyid_d.size(), evp_hash, NULL );
+
+	ctx_keyed = true;
+
+	return true;
+}
+
+void _IDB_PH1::cipher_init( EVP_CIPHER_CTX * ctx, BDATA * iv, int encrypt )
+{
+	//
+	// copy the keyed template and only
+	// set the iv. fall back to keying
+	// the context if no template exists
+	//
+
+	if( ctx_keyed )
+	{
+		EVP_CIPHER_CTX_copy( ctx, encrypt ? &ctx_encrypt : &ctx_decrypt );
+		EVP_CipherInit_ex( ctx, NULL, NULL, NULL, iv->buff(), encrypt );
+
+		return;
+	}
+
+	EVP_CipherInit_ex( ctx, evp_cipher, NULL, NULL, NULL, encrypt );
+	EVP_CIPHER_CTX_set_key_length( ctx, ( int ) key.size() );
+	EVP_CipherInit_ex( ctx, NULL, NULL, key.buff(), iv->buff(), encrypt );
+}
+
+void _IDB_PH1::hmac_init_a( HMAC_CTX * ctx )
+{
+	if( ctx_keyed )
+	{
+		HMAC_CTX_cleanup( ctx );
+		HMAC_CTX_init( ctx );
+		HMAC_CTX_copy( ctx, &ctx_prf_a );
+	}
+	else
+		HMAC_Init_ex( ctx, skeyid_a.buff(), ( int ) skeyid_a.size(), evp_hash, NULL );
+}
+
+void _IDB_PH1::hmac_init_d( HMAC_CTX * ctx )
+{
+	if( ctx_keyed )
+	{
+		HMAC_CTX_cleanup( ctx );
+		HMAC_CTX_init( ctx );
+		HMAC_CTX_copy( ctx, &ctx_prf_d );
+	}
+	else
+		HMAC_Init_ex( ctx, skeyid_d.buff(), ( int ) skeyid_d.size(), evp_hash, NULL );
+}
+
 void _IDB_PH1::clean()
 {
 	if( dh )
 	{
-		DH_free( dh );
+		dh_free( dh );
 		dh = NULL;
 	}
 
@@ -83,109 +83,279 @@ IDB_PH2 * _IDB_LIST_PH2::get( int index )
 	return static_cast<IDB_PH2*>( get_entry( index ) );
 }
 
-bool _IDB_LIST_PH2::find( bool lock, IDB_PH2 ** ph2, IDB_TUNNEL * tunnel, XCH_STATUS min, XCH_STATUS max, u_int32_t * seqid, uint32_t * msgid, IKE_SPI * spi_l, IKE_SPI * spi_r )
+void _IDB_LIST_PH2::spi_add( IDB_HASH & hash, BDATA & keys, IDB_LIST_PROPOSAL & plist, IDB_PH2 * ph2 )
 {
-	if( ph2 != NULL )
-		*ph2 = NULL;
+	//
+	// index each spi in the proposal list
+	// and record the key so it can later
+	// be removed from the index
+	//
+
+	IKE_PROPOSAL * proposal;
+	long pindex = 0;
+
+	while( plist.get( &proposal, pindex++ ) )
+	{
+		if( !proposal->spi.size )
+			continue;
+
+		uint32_t key = IDB_HASH::hash( &proposal->spi, proposal->spi.size );
+
+		hash.add_entry( key, ph2 );
+		keys.add( &key, sizeof( key ) );
+	}
+}
+
+void _IDB_LIST_PH2::spi_del( IDB_HASH & hash, BDATA & keys, IDB_PH2 * ph2 )
+{
+	uint32_t key;
+	keys.oset( 0 );
+
+	while( keys.get( &key, sizeof( key ) ) )
+		hash.del_entry( key, ph2 );
+
+	keys.del();
+}
+
+void _IDB_LIST_PH2::index_add( IKED_RC_ENTRY * entry )
+{
+	IDB_PH2 * ph2 = static_cast<IDB_PH2*>( entry );
+
+	//
+	// the tunnel, seqids and message id
+	// are fixed when the sa is created.
+	// spis are indexed as they are set
+	//
+
+	hash_tunnel.add_entry(
+		IDB_HASH::hash( &ph2->tunnel, sizeof( ph2->tunnel ) ),
+		ph2 );
+
+	hash_seqid.add_entry(
+		IDB_HASH::hash( &ph2->seqid_in, sizeof( ph2->seqid_in ) ),
+		ph2 );
+
+	hash_seqid.add_entry(
+		IDB_HASH::hash( &ph2->seqid_out, sizeof( ph2->seqid_out ) ),
+		ph2 );
+
+	hash_msgid.add_entry(
+		IDB_HASH::hash( &ph2->msgid, sizeof( ph2->msgid ) ),
+		ph2 );
+
+	spi_add( hash_spi_l, ph2->idxkey_spi_l, ph2->plist_l, ph2 );
+	spi_add( hash_spi_r, ph2->idxkey_spi_r, ph2->plist_r, ph2 );
+}
+
+void _IDB_LIST_PH2::index_del( IKED_RC_ENTRY * entry )
+{
+	IDB_PH2 * ph2 = static_cast<IDB_PH2*>( entry );
+
+	hash_tunnel.del_entry(
+		IDB_HASH::hash( &ph2->tunnel, sizeof( ph2->tunnel ) ),
+		ph2 );
+
+	hash_seqid.del_entry(
+		IDB_HASH::hash( &ph2->seqid_in, sizeof( ph2->seqid_in ) ),
+		ph2 );
+
+	hash_seqid.del_entry(
+		IDB_HASH::hash( &ph2->seqid_out, sizeof( ph2->seqid_out ) ),
+		ph2 );
+
+	hash_msgid.del_entry(
+		IDB_HASH::hash( &ph2->msgid, sizeof( ph2->msgid ) ),
+		ph2 );
 
+	spi_del( hash_spi_l, ph2->idxkey_spi_l, ph2 );
+	spi_del( hash_spi_r, ph2->idxkey_spi_r, ph2 );
+}
+
+void _IDB_LIST_PH2::index_spi( bool lock, IDB_PH2 * ph2 )
+{
 	if( lock )
 		iked.lock_idb.lock();
 
 	//
-	// step through our list of sa's
-	// and locate a match
+	// reindex the local and remote spis
+	// after the proposal lists change
 	//
 
-	long ph2_count = count();
-	long ph2_index = 0;
+	spi_del( hash_spi_l, ph2->idxkey_spi_l, ph2 );
+	spi_del( hash_spi_r, ph2->idxkey_spi_r, ph2 );
 
-	for( ; ph2_index < ph2_count; ph2_index++ )
+	spi_add( hash_spi_l, ph2->idxkey_spi_l, ph2->plist_l, ph2 );
+	spi_add( hash_spi_r, ph2->idxkey_spi_r, ph2->plist_r, ph2 );
+
+	if( lock )
+		iked.lock_idb.unlock();
+}
+
+bool _IDB_LIST_PH2::match( IDB_PH2 * tmp_ph2, IDB_TUNNEL * tunnel, XCH_STATUS min, XCH_STATUS max, u_int32_t * seqid, uint32_t * msgid, IKE_SPI * spi_l, IKE_SPI * spi_r )
+{
+	//
+	// match sa minimum status level
+	//
+
+	if( min != XCH_STATUS_ANY )
+		if( tmp_ph2->status() < min )
+			return false;
+
+	//
+	// match sa maximum status level
+	//
+
+	if( max != XCH_STATUS_ANY )
+		if( tmp_ph2->status() > max )
+			return false;
+
+	//
+	// match the tunnel id
+	//
+
+	if( tunnel != NULL )
+		if( tmp_ph2->tunnel != tunnel )
+			return false;
+
+	//
+	// match the seqid
+	//
+
+	if( seqid != NULL )
+		if( ( tmp_ph2->seqid_in != *seqid ) &&
+			( tmp_ph2->seqid_out != *seqid ) )
+			return false;
+
+	//
+	// match the msgid
+	//
+
+	if( msgid != NULL )
+		if( tmp_ph2->msgid != *msgid )
+			return false;
+
+	//
+	// match a local spi value
+	//
+
+	if( spi_l != NULL )
 	{
-		//
-		// get the next sa in our list
-		//
+		IKE_PROPOSAL * proposal;
+		long pindex = 0;
+		bool found;
 
-		IDB_PH2 * tmp_ph2 = get( ph2_index );
+		while( ( found = tmp_ph2->plist_l.get( &proposal, pindex++ ) ) )
+			if( proposal->spi.size == spi_l->size )
+				if( !memcmp( &proposal->spi, spi_l, spi_l->size ) )
+					break;
 
-		//
-		// match sa minimum status level
-		//
+		if( !found )
+			return false;
+	}
 
-		if( min != XCH_STATUS_ANY )
-			if( tmp_ph2->status() < min )
-				continue;
+	//
+	// match a remote spi value
+	//
 
-		//
-		// match sa maximum status level
-		//
+	if( spi_r != NULL )
+	{
+		IKE_PROPOSAL * proposal;
+		long pindex = 0;
+		bool found;
 
-		if( max != XCH_STATUS_ANY )
-			if( tmp_ph2->status() > max )
-				continue;
+		while( ( found = tmp_ph2->plist_r.get( &proposal, pindex++ ) ) )
+			if( proposal->spi.size == spi_r->size )
+				if( !memcmp( &proposal->spi, spi_r, spi_r->size ) )
+					break;
 
-		//
-		// match the tunnel id
-		//
+		if( !found )
+			return false;
+	}
 
-		if( tunnel != NULL )
-			if( tmp_ph2->tunnel != tunnel )
-				continue;
+	return true;
+}
 
-		//
-		// match the seqid
-		//
+bool _IDB_LIST_PH2::find( bool lock, IDB_PH2 ** ph2, IDB_TUNNEL * tunnel, XCH_STATUS min, XCH_STATUS max, u_int32_t * seqid, uint32_t * msgid, IKE_SPI * spi_l, IKE_SPI * spi_r )
+{
+	if( ph2 != NULL )
+		*ph2 = NULL;
 
-		if( seqid != NULL )
-			if( ( tmp_ph2->seqid_in != *seqid ) &&
-				( tmp_ph2->seqid_out != *seqid ) )
-				continue;
+	if( lock )
+		iked.lock_idb.lock();
 
-		//
-		// match the msgid
-		//
+	//
+	// select the most specific index
+	// available for the search criteria
+	//
 
-		if( msgid != NULL )
-			if( tmp_ph2->msgid != *msgid )
-				continue;
+	IDB_HASH *	hash = NULL;
+	uint32_t	key = 0;
 
-		//
-		// match a local spi value
-		//
+	if( ( spi_l != NULL ) && spi_l->size )
+	{
+		hash = &hash_spi_l;
+		key = IDB_HASH::hash( spi_l, spi_l->size );
+	}
+	else if( ( spi_r != NULL ) && spi_r->size )
+	{
+		hash = &hash_spi_r;
+		key = IDB_HASH::hash( spi_r, spi_r->size );
+	}
+	else if( msgid != NULL )
+	{
+		hash = &hash_msgid;
+		key = IDB_HASH::hash( msgid, sizeof( *msgid ) );
+	}
+	else if( seqid != NULL )
+	{
+		hash = &hash_seqid;
+		key = IDB_HASH::hash( seqid, sizeof( *seqid ) );
+	}
+	else if( tunnel != NULL )
+	{
+		hash = &hash_tunnel;
+		key = IDB_HASH::hash( &tunnel, sizeof( tunnel ) );
+	}
 
-		if( spi_l != NULL )
-		{
-			IKE_PROPOSAL * proposal;
-			long pindex = 0;
-			bool found;
+	IDB_PH2 * tmp_ph2 = NULL;
 
-			while( ( found = tmp_ph2->plist_l.get( &proposal, pindex++ ) ) )
-				if( proposal->spi.size == spi_l->size )
-					if( !memcmp( &proposal->spi, spi_l, spi_l->size ) )
-						break;
+	if( hash != NULL )
+	{
+		//
+		// step through the indexed sa's
+		// and locate a match
+		//
 
-			if( !found )
-				continue;
-		}
+		IDB_HASH_NODE * node = NULL;
 
+		while( ( tmp_ph2 = static_cast<IDB_PH2*>( hash->get_entry( key, &node ) ) ) != NULL )
+			if( match( tmp_ph2, tunnel, min, max, seqid, msgid, spi_l, spi_r ) )
+				break;
+	}
+	else
+	{
 		//
-		// match a remote spi value
+		// step through our list of sa's
+		// and locate a match
 		//
 
-		if( spi_r != NULL )
-		{
-			IKE_PROPOSAL * proposal;
-			long pindex = 0;
-			bool found;
+		long ph2_count = count();
+		long ph2_index = 0;
 
-			while( ( found = tmp_ph2->plist_r.get( &proposal, pindex++ ) ) )
-				if( proposal->spi.size == spi_r->size )
-					if( !memcmp( &proposal->spi, spi_r, spi_r->size ) )
-						break;
+		for( ; ph2_index < ph2_count; ph2_index++ )
+		{
+			IDB_PH2 * next_ph2 = get( ph2_index );
 
-			if( !found )
-				continue;
+			if( match( next_ph2, tunnel, min, max, seqid, msgid, spi_l, spi_r ) )
+			{
+				tmp_ph2 = next_ph2;
+				break;
+			}
 		}
+	}
 
+	if( tmp_ph2 != NULL )
+	{
 		iked.log.txt( LLOG_DEBUG, "DB : phase2 found\n" );
 
 		//
@@ -194,7 +364,7 @@ bool _IDB_LIST_PH2::find( bool lock, IDB_PH2 ** ph2, IDB_TUNNEL * tunnel, XCH_ST
 
 		if( ph2 != NULL )
 		{
-			tmp_ph2->inc( false );
+			tmp_ph2->inc();
 			*ph2 = tmp_ph2;
 		}
 
@@ -223,7 +393,7 @@ void _IDB_LIST_PH2::flush()
 	{
 		IDB_PH2 * ph2 = get( ph2_index );
 
-		ph2->inc( false );
+		ph2->inc();
 
 		ph2->status( XCH_STATUS_DEAD, XCH_FAILED_FLUSHED, 0 );
 
@@ -258,7 +428,7 @@ _IDB_PH2::_IDB_PH2( IDB_TUNNEL * set_tunnel, bool set_initiator, uint32_t set_ms
 	//
 
 	tunnel = set_tunnel;
-	tunnel->inc( true );
+	tunnel->inc();
 
 	//
 	// initialize sa
@@ -301,6 +471,14 @@ _IDB_PH2::_IDB_PH2( IDB_TUNNEL * set_tunnel, bool set_initiator, uint32_t set_ms
 	event_soft.ph2 = this;
 	event_hard.ph2 = this;
 
+	//
+	// events for the same tunnel are
+	// never executed concurrently
+	//
+
+	event_soft.group = tunnel;
+	event_hard.group = tunnel;
+
 	//
 	// phase 2 created
 	//
@@ -354,7 +532,7 @@ void _IDB_PH2::end()
 
 	if( iked.ith_timer.del( &event_soft ) )
 	{
-		idb_refcount--;
+		refdec();
 		iked.log.txt( LLOG_DEBUG,
 			"DB : phase2 soft event canceled ( ref count = %i )\n",
 			idb_refcount );
@@ -362,7 +540,7 @@ void _IDB_PH2::end()
 
 	if( iked.ith_timer.del( &event_hard ) )
 	{
-		idb_refcount--;
+		refdec();
 		iked.log.txt( LLOG_DEBUG,
 			"DB : phase2 hard event canceled ( ref count = %i )\n",
 			idb_refcount );
@@ -431,24 +609,16 @@ bool _IDB_PH2::setup_dhgrp()
 
 	if( dhgr_id )
 	{
-		if( !dh_init( dhgr_id, &dh, &dh_size ) )
+		if( !iked.dh_pool.get( dhgr_id, &dh, &dh_size ) )
 		{
 			iked.log.txt( LLOG_ERROR, "ii : failed to setup PFS DH group\n" );
 			return false;
 		}
 
-		xl.size( dh_size );
-		long result = BN_bn2bin( dh->pub_key, xl.buff() );
-
-		//
-		// fixup public buffer alignment
-		//
-
-		if( dh_size > result )
+		if( !dh_pubkey( dh, xl ) )
 		{
-			iked.log.txt( LLOG_DEBUG, "ww : short PFS DH public value\n" );
-			xl.size( result );
-			xl.ins( 0, dh_size - result );
+			iked.log.txt( LLOG_ERROR, "ii : failed to read PFS DH public value\n" );
+			return false;
 		}
 	}
 
@@ -459,7 +629,7 @@ void _IDB_PH2::clean()
 {
 	if( dh )
 	{
-		DH_free( dh );
+		dh_free( dh );
 		dh = NULL;
 	}
 
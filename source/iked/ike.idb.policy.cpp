@@ -41,109 +41,390 @@
 
 #include "iked.h"
 
+//==============================================================================
+// policy selector trie node
+//==============================================================================
+
+_IDB_POLICY_NODE::_IDB_POLICY_NODE()
+{
+	next[ 0 ] = NULL;
+	next[ 1 ] = NULL;
+}
+
+_IDB_POLICY_NODE::~_IDB_POLICY_NODE()
+{
+	if( next[ 0 ] != NULL )
+		delete next[ 0 ];
+
+	if( next[ 1 ] != NULL )
+		delete next[ 1 ];
+}
+
 //==============================================================================
 // policy list
 //==============================================================================
 
-IDB_POLICY * _IDB_LIST_POLICY::get( int index )
+//
+// return the number of prefix bits in an
+// ipv4 selector id or -1 if the selector
+// cannot be stored in the trie
+//
+
+static long ph2id_bits( IKE_PH2ID & ph2id )
 {
-	return static_cast<IDB_POLICY*>( get_entry( index ) );
+	switch( ph2id.type )
+	{
+		case ISAKMP_ID_IPV4_ADDR:
+			return 32;
+
+		case ISAKMP_ID_IPV4_ADDR_SUBNET:
+		{
+			uint32_t mask = ntohl( ph2id.addr2.s_addr );
+			long bits = 0;
+
+			while( ( bits < 32 ) && ( mask & ( 0x80000000 >> bits ) ) )
+				bits++;
+
+			if( bits < 32 )
+				if( mask & ( 0xffffffff >> bits ) )
+					return -1;
+
+			return bits;
+		}
+	}
+
+	return -1;
 }
 
-bool _IDB_LIST_POLICY::find( bool lock, IDB_POLICY ** policy, long dir, u_int16_t type, u_int32_t * seq, u_int32_t * plcyid, IKE_SADDR * src, IKE_SADDR * dst, IKE_PH2ID * ids, IKE_PH2ID * idd )
+static inline long ph2id_bit( IKE_PH2ID & ph2id, long bit )
 {
-	if( policy != NULL )
-		*policy = NULL;
+	return ( ntohl( ph2id.addr1.s_addr ) >> ( 31 - bit ) ) & 1;
+}
+
+_IDB_LIST_POLICY::_IDB_LIST_POLICY()
+{
+	next_order = 0;
+}
+
+uint32_t _IDB_LIST_POLICY::key( long dir, u_int16_t type, u_int32_t value )
+{
+	uint32_t hkey = IDB_HASH::hash( &dir, sizeof( dir ) );
+	hkey = IDB_HASH::hash( &type, sizeof( type ), hkey );
+
+	return IDB_HASH::hash( &value, sizeof( value ), hkey );
+}
+
+void _IDB_LIST_POLICY::trie_add( IDB_POLICY_NODE * root, IKE_PH2ID & ph2id, IDB_POLICY * policy )
+{
+	IDB_POLICY_NODE * node = root;
+
+	long bits = ph2id_bits( ph2id );
+	long bit = 0;
+
+	for( ; bit < bits; bit++ )
+	{
+		long side = ph2id_bit( ph2id, bit );
+
+		if( node->next[ side ] == NULL )
+			node->next[ side ] = new IDB_POLICY_NODE;
+
+		node = node->next[ side ];
+	}
+
+	node->policies.add_entry( policy );
+}
+
+void _IDB_LIST_POLICY::trie_del( IDB_POLICY_NODE * root, IKE_PH2ID & ph2id, IDB_POLICY * policy )
+{
+	//
+	// record the path to the policy node
+	// so empty branches can be released
+	//
+
+	IDB_POLICY_NODE * path[ 33 ];
+	IDB_POLICY_NODE * node = root;
+
+	long bits = ph2id_bits( ph2id );
+	long bit = 0;
+
+	path[ 0 ] = root;
+
+	for( ; bit < bits; bit++ )
+	{
+		node = node->next[ ph2id_bit( ph2id, bit ) ];
+		if( node == NULL )
+			return;
+
+		path[ bit + 1 ] = node;
+	}
+
+	node->policies.del_entry( policy );
+
+	for( ; bit > 0; bit-- )
+	{
+		node = path[ bit ];
+
+		if( node->policies.count() ||
+			( node->next[ 0 ] != NULL ) ||
+			( node->next[ 1 ] != NULL ) )
+			break;
+
+		path[ bit - 1 ]->next[ ph2id_bit( ph2id, bit - 1 ) ] = NULL;
+		delete node;
+	}
+}
+
+void _IDB_LIST_POLICY::index_add( IKED_RC_ENTRY * entry )
+{
+	IDB_POLICY * policy = static_cast<IDB_POLICY*>( entry );
+
+	//
+	// the endpoint addresses and selector
+	// ids never change once the policy is
+	// added so they are computed only once
+	//
+
+	memset( &policy->idx_ids, 0, sizeof( policy->idx_ids ) );
+	memset( &policy->idx_idd, 0, sizeof( policy->idx_idd ) );
+
+	iked.policy_get_addrs( policy, policy->idx_src, policy->idx_dst );
+
+	policy->idx_ipv4 =
+		iked.paddr_ph2id( policy->paddr_src, policy->idx_ids ) &&
+		iked.paddr_ph2id( policy->paddr_dst, policy->idx_idd );
+
+	policy->idxorder = next_order++;
+	policy->idxkey_plcyid = key( policy->sp.dir, policy->sp.type, policy->sp.id );
+
+	hash_seq.add_entry( key( policy->sp.dir, policy->sp.type, policy->seq ), policy );
+	hash_plcyid.add_entry( policy->idxkey_plcyid, policy );
+	hash_type.add_entry( key( policy->sp.dir, policy->sp.type, 0 ), policy );
+
+	if( policy->idx_ipv4 )
+	{
+		trie_add( &trie_src, policy->idx_ids, policy );
+		trie_add( &trie_dst, policy->idx_idd, policy );
+	}
+	else
+		list_other.add_entry( policy );
+}
+
+void _IDB_LIST_POLICY::index_del( IKED_RC_ENTRY * entry )
+{
+	IDB_POLICY * policy = static_cast<IDB_POLICY*>( entry );
+
+	hash_seq.del_entry( key( policy->sp.dir, policy->sp.type, policy->seq ), policy );
+	hash_plcyid.del_entry( policy->idxkey_plcyid, policy );
+	hash_type.del_entry( key( policy->sp.dir, policy->sp.type, 0 ), policy );
+
+	if( policy->idx_ipv4 )
+	{
+		trie_del( &trie_src, policy->idx_ids, policy );
+		trie_del( &trie_dst, policy->idx_idd, policy );
+	}
+	else
+		list_other.del_entry( policy );
+}
 
+void _IDB_LIST_POLICY::index_plcyid( bool lock, IDB_POLICY * policy )
+{
 	if( lock )
 		iked.lock_idb.lock();
 
 	//
-	// step through our list of policys
-	// and see if they match the msgid
+	// reindex the policy after the kernel
+	// has assigned its policy id
 	//
 
-	long policy_count = count();
-	long policy_index = 0;
+	hash_plcyid.del_entry( policy->idxkey_plcyid, policy );
 
-	for( ; policy_index < policy_count; policy_index++ )
-	{
-		//
-		// get the next policy in our list
-		//
+	policy->idxkey_plcyid = key( policy->sp.dir, policy->sp.type, policy->sp.id );
 
-		IDB_POLICY * tmp_policy = get( policy_index );
+	hash_plcyid.add_entry( policy->idxkey_plcyid, policy );
 
-		//
-		// compare policy direction
-		//
+	if( lock )
+		iked.lock_idb.unlock();
+}
 
-		if( tmp_policy->sp.dir != dir )
-			continue;
+IDB_POLICY * _IDB_LIST_POLICY::get( int index )
+{
+	return static_cast<IDB_POLICY*>( get_entry( index ) );
+}
 
-		//
-		// compare policy type
-		//
+bool _IDB_LIST_POLICY::match( IDB_POLICY * policy, long dir, u_int16_t type, u_int32_t * seq, u_int32_t * plcyid, IKE_SADDR * src, IKE_SADDR * dst, IKE_PH2ID * ids, IKE_PH2ID * idd )
+{
+	//
+	// compare policy direction
+	//
 
-		if( tmp_policy->sp.type != type )
-			continue;
+	if( policy->sp.dir != dir )
+		return false;
 
-		//
-		// compare policy sequence
-		//
+	//
+	// compare policy type
+	//
 
-		if( seq != NULL )
-			if( *seq != tmp_policy->seq )
-				continue;
+	if( policy->sp.type != type )
+		return false;
+
+	//
+	// compare policy sequence
+	//
+
+	if( seq != NULL )
+		if( *seq != policy->seq )
+			return false;
 
+	//
+	// compare policy id
+	//
+
+	if( plcyid != NULL )
+		if( *plcyid != policy->sp.id )
+			return false;
+
+	//
+	// compare the policy endpoint addresses
+	//
+
+	if( src != NULL )
+		if( !cmp_ikeaddr( policy->idx_src, *src, false ) )
+			return false;
+
+	if( dst != NULL )
+		if( !cmp_ikeaddr( policy->idx_dst, *dst, false ) )
+			return false;
+
+	//
+	// compare ipv4 ids ( non-exact )
+	//
+
+	if( ids != NULL )
+		if( !iked.cmp_ph2id( policy->idx_ids, *ids, false ) )
+			return false;
+
+	if( idd != NULL )
+		if( !iked.cmp_ph2id( policy->idx_idd, *idd, false ) )
+			return false;
+
+	return true;
+}
+
+bool _IDB_LIST_POLICY::find( bool lock, IDB_POLICY ** policy, long dir, u_int16_t type, u_int32_t * seq, u_int32_t * plcyid, IKE_SADDR * src, IKE_SADDR * dst, IKE_PH2ID * ids, IKE_PH2ID * idd )
+{
+	if( policy != NULL )
+		*policy = NULL;
+
+	if( lock )
+		iked.lock_idb.lock();
+
+	IDB_POLICY * tmp_policy = NULL;
+	IDB_POLICY * next_policy;
+
+	//
+	// select the most specific index
+	// available for the search criteria
+	//
+
+	IDB_HASH *	hash = NULL;
+	uint32_t	hkey = 0;
+
+	IDB_POLICY_NODE *	root = NULL;
+	IKE_PH2ID *			ph2id = NULL;
+
+	if( seq != NULL )
+	{
+		hash = &hash_seq;
+		hkey = key( dir, type, *seq );
+	}
+	else if( plcyid != NULL )
+	{
+		hash = &hash_plcyid;
+		hkey = key( dir, type, *plcyid );
+	}
+	else if( ( idd != NULL ) && ( ph2id_bits( *idd ) >= 0 ) )
+	{
+		root = &trie_dst;
+		ph2id = idd;
+	}
+	else if( ( ids != NULL ) && ( ph2id_bits( *ids ) >= 0 ) )
+	{
+		root = &trie_src;
+		ph2id = ids;
+	}
+	else
+	{
+		hash = &hash_type;
+		hkey = key( dir, type, 0 );
+	}
+
+	if( hash != NULL )
+	{
 		//
-		// compare policy id
+		// hash chains keep insertion order
+		// so the first match is the one that
+		// was added first
 		//
 
-		if( plcyid != NULL )
-			if( *plcyid != tmp_policy->sp.id )
-				continue;
+		IDB_HASH_NODE * node = NULL;
 
+		while( ( tmp_policy = static_cast<IDB_POLICY*>( hash->get_entry( hkey, &node ) ) ) != NULL )
+			if( match( tmp_policy, dir, type, seq, plcyid, src, dst, ids, idd ) )
+				break;
+	}
+	else
+	{
 		//
-		// compare the policy endpoint addresses
+		// an ipv4 address or subnet id can only
+		// match a policy whose selector prefix
+		// covers the id address. walk the trie
+		// along the address and select the match
+		// that was added first. policies with non
+		// ipv4 selectors are always compared
 		//
 
-		IKE_SADDR psrc;
-		IKE_SADDR pdst;
+		IDB_POLICY_NODE * node = root;
+		long bit = 0;
 
-		if( ( src != NULL ) || ( dst != NULL ) )
-			iked.policy_get_addrs( tmp_policy, psrc, pdst );
+		while( node != NULL )
+		{
+			long policy_count = node->policies.count();
+			long policy_index = 0;
 
-		if( src != NULL )
-			if( !cmp_ikeaddr( psrc, *src, false ) )
-				continue;
+			for( ; policy_index < policy_count; policy_index++ )
+			{
+				next_policy = static_cast<IDB_POLICY*>( node->policies.get_entry( policy_index ) );
 
-		if( dst != NULL )
-			if( !cmp_ikeaddr( pdst, *dst, false ) )
-				continue;
+				if( ( tmp_policy != NULL ) && ( next_policy->idxorder > tmp_policy->idxorder ) )
+					continue;
 
-		//
-		// compare ipv4 ids ( non-exact )
-		//
+				if( match( next_policy, dir, type, seq, plcyid, src, dst, ids, idd ) )
+					tmp_policy = next_policy;
+			}
 
-		if( ids != NULL )
-		{
-			IKE_PH2ID ph2id;
-			iked.paddr_ph2id( tmp_policy->paddr_src, ph2id );
+			if( bit == 32 )
+				break;
 
-			if( !iked.cmp_ph2id( ph2id, *ids, false ) )
-				continue;
+			node = node->next[ ph2id_bit( *ph2id, bit++ ) ];
 		}
 
-		if( idd != NULL )
+		long other_count = list_other.count();
+		long other_index = 0;
+
+		for( ; other_index < other_count; other_index++ )
 		{
-			IKE_PH2ID ph2id;
-			iked.paddr_ph2id( tmp_policy->paddr_dst, ph2id );
+			next_policy = static_cast<IDB_POLICY*>( list_other.get_entry( other_index ) );
 
-			if( !iked.cmp_ph2id( ph2id, *idd, false ) )
+			if( ( tmp_policy != NULL ) && ( next_policy->idxorder > tmp_policy->idxorder ) )
 				continue;
+
+			if( match( next_policy, dir, type, seq, plcyid, src, dst, ids, idd ) )
+				tmp_policy = next_policy;
 		}
+	}
 
+	if( tmp_policy != NULL )
+	{
 		iked.log.txt( LLOG_DEBUG, "DB : policy found\n" );
 
 		//
@@ -152,7 +433,7 @@ bool _IDB_LIST_POLICY::find( bool lock, IDB_POLICY ** policy, long dir, u_int16_
 
 		if( policy != NULL )
 		{
-			tmp_policy->inc( false );
+			tmp_policy->inc();
 			*policy = tmp_policy;
 		}
 
@@ -307,11 +307,90 @@ bool _ITH_EVENT_TUNSTATS::func()
 // tunnel list
 //==============================================================================
 
+void _IDB_LIST_TUNNEL::index_add( IKED_RC_ENTRY * entry )
+{
+	IDB_TUNNEL * tunnel = static_cast<IDB_TUNNEL*>( entry );
+
+	//
+	// the tunnel id is fixed when the tunnel
+	// is created. the remote address is only
+	// changed through index_addr
+	//
+
+	hash_tunnelid.add_entry(
+		IDB_HASH::hash( &tunnel->tunnelid, sizeof( tunnel->tunnelid ) ),
+		tunnel );
+
+	tunnel->idxkey_addr = key_sockaddr( tunnel->saddr_r.saddr );
+
+	hash_addr.add_entry( tunnel->idxkey_addr, tunnel );
+}
+
+void _IDB_LIST_TUNNEL::index_del( IKED_RC_ENTRY * entry )
+{
+	IDB_TUNNEL * tunnel = static_cast<IDB_TUNNEL*>( entry );
+
+	hash_tunnelid.del_entry(
+		IDB_HASH::hash( &tunnel->tunnelid, sizeof( tunnel->tunnelid ) ),
+		tunnel );
+
+	hash_addr.del_entry( tunnel->idxkey_addr, tunnel );
+}
+
+void _IDB_LIST_TUNNEL::index_addr( bool lock, IDB_TUNNEL * tunnel )
+{
+	if( lock )
+		iked.lock_idb.lock();
+
+	//
+	// reindex the tunnel after its
+	// remote address has changed
+	//
+
+	hash_addr.del_entry( tunnel->idxkey_addr, tunnel );
+
+	tunnel->idxkey_addr = key_sockaddr( tunnel->saddr_r.saddr );
+
+	hash_addr.add_entry( tunnel->idxkey_addr, tunnel );
+
+	if( lock )
+		iked.lock_idb.unlock();
+}
+
 IDB_TUNNEL * _IDB_LIST_TUNNEL::get( int index )
 {
 	return static_cast<IDB_TUNNEL*>( get_entry( index ) );
 }
 
+bool _IDB_LIST_TUNNEL::match( IDB_TUNNEL * tmp_tunnel, long * tunnelid, IKE_SADDR * saddr, bool port, bool suspended )
+{
+	//
+	// match the tunnel id
+	//
+
+	if( tunnelid != NULL )
+		if( tmp_tunnel->tunnelid != *tunnelid )
+			return false;
+
+	//
+	// match the peer address
+	//
+
+	if( saddr != NULL )
+		if( !cmp_sockaddr( tmp_tunnel->saddr_r.saddr, saddr->saddr, port ) )
+			return false;
+
+	//
+	// match suspended value
+	//
+
+	if( suspended )
+		if( !tmp_tunnel->suspended )
+			return false;
+
+	return true;
+}
+
 bool _IDB_LIST_TUNNEL::find( bool lock, IDB_TUNNEL ** tunnel, long * tunnelid, IKE_SADDR * saddr, bool port, bool suspended )
 {
 	if( tunnel != NULL )
@@ -320,37 +399,60 @@ bool _IDB_LIST_TUNNEL::find( bool lock, IDB_TUNNEL ** tunnel, long * tunnelid, I
 	if( lock )
 		iked.lock_idb.lock();
 
-	long tunnel_count = count();
-	long tunnel_index = 0;
+	IDB_TUNNEL * tmp_tunnel = NULL;
 
-	for( ; tunnel_index < tunnel_count; tunnel_index++ )
+	if( tunnelid != NULL )
 	{
-		IDB_TUNNEL * tmp_tunnel = get( tunnel_index );
-
 		//
-		// match the tunnel id
+		// step through the tunnels indexed
+		// by the tunnel id
 		//
 
-		if( tunnelid != NULL )
-			if( tmp_tunnel->tunnelid != *tunnelid )
-				continue;
+		uint32_t key = IDB_HASH::hash( tunnelid, sizeof( *tunnelid ) );
+		IDB_HASH_NODE * node = NULL;
 
+		while( ( tmp_tunnel = static_cast<IDB_TUNNEL*>( hash_tunnelid.get_entry( key, &node ) ) ) != NULL )
+			if( match( tmp_tunnel, tunnelid, saddr, port, suspended ) )
+				break;
+	}
+	else if( saddr != NULL )
+	{
 		//
-		// match the peer address
+		// step through the tunnels indexed
+		// by the remote address
 		//
 
-		if( saddr != NULL )
-			if( !cmp_sockaddr( tmp_tunnel->saddr_r.saddr, saddr->saddr, port ) )
-				continue;
+		uint32_t key = key_sockaddr( saddr->saddr );
+		IDB_HASH_NODE * node = NULL;
 
+		while( ( tmp_tunnel = static_cast<IDB_TUNNEL*>( hash_addr.get_entry( key, &node ) ) ) != NULL )
+			if( match( tmp_tunnel, tunnelid, saddr, port, suspended ) )
+				break;
+	}
+	else
+	{
 		//
-		// match suspended value
+		// step through our list of tunnels
+		// and locate a match
 		//
 
-		if( suspended )
-			if( !tmp_tunnel->suspended )
-				continue;
+		long tunnel_count = count();
+		long tunnel_index = 0;
+
+		for( ; tunnel_index < tunnel_count; tunnel_index++ )
+		{
+			IDB_TUNNEL * next_tunnel = get( tunnel_index );
 
+			if( match( next_tunnel, tunnelid, saddr, port, suspended ) )
+			{
+				tmp_tunnel = next_tunnel;
+				break;
+			}
+		}
+	}
+
+	if( tmp_tunnel != NULL )
+	{
 		iked.log.txt( LLOG_DEBUG, "DB : tunnel found\n" );
 
 		//
@@ -359,7 +461,7 @@ bool _IDB_LIST_TUNNEL::find( bool lock, IDB_TUNNEL ** tunnel, long * tunnelid, I
 
 		if( tunnel != NULL )
 		{
-			tmp_tunnel->inc( false );
+			tmp_tunnel->inc();
 			*tunnel = tmp_tunnel;
 		}
 
@@ -416,7 +518,7 @@ _IDB_TUNNEL::_IDB_TUNNEL( IDB_PEER * set_peer, IKE_XCONF * set_xconf, IKE_SADDR
 	saddr_r = *set_saddr_r;
 
 	peer = set_peer;
-	peer->inc( true );
+	peer->inc();
 
 	memset( &stats, 0, sizeof( stats ) );
 	memset( &xconf, 0, sizeof( xconf ) );
@@ -446,14 +548,18 @@ _IDB_TUNNEL::_IDB_TUNNEL( IDB_PEER * set_peer, IKE_XCONF * set_xconf, IKE_SADDR
 	//
 
 	event_stats.tunnel = this;
+	event_stats.group = this;
 
 	event_dpd.tunnel = this;
+	event_dpd.group = this;
 	event_dpd.sequence = 0;
 	event_dpd.attempt = 0;
 
 	event_natt.tunnel = this;
+	event_natt.group = this;
 
 	event_dhcp.tunnel = this;
+	event_dhcp.group = this;
 	event_dhcp.lease = 0;
 	event_dhcp.renew = 0;
 	event_dhcp.retry = 0;
@@ -525,7 +631,7 @@ void _IDB_TUNNEL::end()
 
 	if( iked.ith_timer.del( &event_dhcp ) )
 	{
-		idb_refcount--;
+		refdec();
 		iked.log.txt( LLOG_DEBUG,
 			"DB : tunnel dhcp event canceled ( ref count = %i )\n",
 			idb_refcount );
@@ -533,7 +639,7 @@ void _IDB_TUNNEL::end()
 
 	if( iked.ith_timer.del( &event_dpd ) )
 	{
-		idb_refcount--;
+		refdec();
 		iked.log.txt( LLOG_DEBUG,
 			"DB : tunnel dpd event canceled ( ref count = %i )\n",
 			idb_refcount );
@@ -541,7 +647,7 @@ void _IDB_TUNNEL::end()
 
 	if( iked.ith_timer.del( &event_natt ) )
 	{
-		idb_refcount--;
+		refdec();
 		iked.log.txt( LLOG_DEBUG,
 			"DB : tunnel natt event canceled ( ref count = %i )\n",
 			idb_refcount );
@@ -549,7 +655,7 @@ void _IDB_TUNNEL::end()
 
 	if( iked.ith_timer.del( &event_stats ) )
 	{
-		idb_refcount--;
+		refdec();
 		iked.log.txt( LLOG_DEBUG,
 			"DB : tunnel stats event canceled ( ref count = %i )\n",
 			idb_refcount );
@@ -575,7 +681,7 @@ void _IDB_TUNNEL::end()
 
 		if( cfg->tunnel == this )
 		{
-			cfg->inc( false );
+			cfg->inc();
 
 			cfg->status( XCH_STATUS_DEAD, XCH_FAILED_USERREQ, 0 );
 
@@ -606,7 +712,7 @@ void _IDB_TUNNEL::end()
 		IDB_PH2 * ph2 = iked.idb_list_ph2.get( ph2_index );
 		if( ph2->tunnel == this )
 		{
-			ph2->inc( false );
+			ph2->inc();
 
 			ph2->status( XCH_STATUS_DEAD, XCH_FAILED_USERREQ, 0 );
 
@@ -637,7 +743,7 @@ void _IDB_TUNNEL::end()
 		IDB_PH1 * ph1 = iked.idb_list_ph1.get( ph1_index );
 		if( ph1->tunnel == this )
 		{
-			ph1->inc( false );
+			ph1->inc();
 
 			ph1->status( XCH_STATUS_DEAD, XCH_FAILED_USERREQ, 0 );
 
@@ -773,7 +773,7 @@ long _IKED::loop_ipc_client( IKEI * ikei )
 				// add the statistics event
 				//
 
-				tunnel->inc( true );
+				tunnel->inc();
 				tunnel->event_stats.delay = 1000;
 				ith_timer.add( &tunnel->event_stats );
 
@@ -51,6 +51,26 @@ long ITH_NWORK::iked_func( void * arg )
 	return iked->loop_ike_nwork();
 }
 
+//
+// ike packet worker thread
+//
+
+_ITH_IKEW::_ITH_IKEW()
+{
+	head = NULL;
+	tail = NULL;
+	stop = false;
+
+	lock.name( "worker" );
+	cond.name( "worker" );
+}
+
+long ITH_IKEW::iked_func( void * arg )
+{
+	ITH_IKEW * worker = ( ITH_IKEW * ) arg;
+	return iked.loop_ike_work( worker );
+}
+
 long _IKED::loop_ike_nwork()
 {
 	//
@@ -59,128 +79,144 @@ long _IKED::loop_ike_nwork()
 
 	loop_ref_inc( "network" );
 
-	ETH_HEADER	eth_header;
-	PACKET_IP	packet_ip;
+	IKED_RECV * recv_list[ IKED_RECV_BATCH ];
+	memset( recv_list, 0, sizeof( recv_list ) );
 
 	while( true )
 	{
 		//
-		// attempt to recv packet
+		// allocate packet handles. packets are
+		// received directly into the handles
+		// so they can be queued without a copy
 		//
 
-		long result = recv_ip(
-					packet_ip,
-					&eth_header );
+		long index = 0;
 
-		if( result == LIBIKE_SOCKET )
-			break;
+		for( ; index < IKED_RECV_BATCH; index++ )
+		{
+			if( recv_list[ index ] == NULL )
+			{
+				recv_list[ index ] = new IKED_RECV;
+				if( recv_list[ index ] == NULL )
+					break;
+			}
+		}
 
-		if( result == LIBIKE_NODATA )
-			continue;
+		if( index < IKED_RECV_BATCH )
+			break;
 
 		//
-		// dump encrypted packets
+		// attempt to recv a batch of packets
 		//
 
-		if( dump_encrypt )
-			pcap_encrypt.dump(
-				eth_header,
-				packet_ip );
+		long recv_count = 0;
 
-		//
-		// read the ip header
-		//
+		long result = recv_ike(
+					recv_list,
+					recv_count );
 
-		IKE_SADDR saddr_src;
-		IKE_SADDR saddr_dst;
+		if( result == LIBIKE_SOCKET )
+			break;
 
-		memset( &saddr_src, 0, sizeof( saddr_src ) );
-		memset( &saddr_dst, 0, sizeof( saddr_dst ) );
+		if( result == LIBIKE_NODATA )
+			continue;
 
-		saddr_src.saddr4.sin_family = AF_INET;
-		saddr_dst.saddr4.sin_family = AF_INET;
+		for( index = 0; index < recv_count; index++ )
+		{
+			IKED_RECV * recv = recv_list[ index ];
 
-		unsigned char proto;
+			PACKET_IKE & packet_ike = recv->packet;
+			IKE_SADDR & saddr_src = recv->saddr_src;
+			IKE_SADDR & saddr_dst = recv->saddr_dst;
 
-		packet_ip.read(
-			saddr_src.saddr4.sin_addr,
-			saddr_dst.saddr4.sin_addr,
-			proto );
+			//
+			// dump encrypted packets. the ip
+			// and udp headers are only built
+			// when a dump has been requested
+			//
 
-		//
-		// convert source ip address
-		// to a string for logging
-		//
+			if( dump_encrypt )
+			{
+				PACKET_IP packet_ip_dump;
 
-		char txtaddr_src[ LIBIKE_MAX_TEXTADDR ];
-		char txtaddr_dst[ LIBIKE_MAX_TEXTADDR ];
+				packet_ike_encap(
+					packet_ike,
+					packet_ip_dump,
+					saddr_src,
+					saddr_dst,
+					recv->encap ? IPSEC_NATT_V02 : IPSEC_NATT_NONE );
 
-		text_addr( txtaddr_src, &saddr_src, false );
-		text_addr( txtaddr_dst, &saddr_dst, false );
+				ETH_HEADER ethhdr;
+				header( packet_ip_dump, ethhdr );
 
-		//
-		// is this a UDP packet
-		//
+				pcap_encrypt.dump(
+					ethhdr,
+					packet_ip_dump );
+			}
 
-		if( proto == PROTO_IP_UDP )
-		{
 			//
-			// read the udp packet
+			// check for NAT-T keep alive
 			//
 
-			PACKET_UDP packet_udp;
-			packet_ip.get( packet_udp );
-
-			packet_udp.read(
-				saddr_src.saddr4.sin_port,
-				saddr_dst.saddr4.sin_port );
-
-			unsigned short port_src = htons( saddr_src.saddr4.sin_port );
-			unsigned short port_dst = htons( saddr_dst.saddr4.sin_port );
+			bool keep_alive = ( packet_ike.size() < sizeof( IKE_HEADER ) );
 
 			//
-			// check for NAT-T keep alive
+			// convert the ip addresses to strings
+			// only when the packet will be logged
 			//
 
-			if( packet_udp.size() < sizeof( IKE_HEADER ) )
+			if( log.enabled( LLOG_DEBUG ) )
 			{
-				log.txt( LLOG_DEBUG,
-					"<- : recv NAT-T:KEEP-ALIVE packet %s:%u -> %s:%u\n",
-					txtaddr_src, port_src,
-					txtaddr_dst, port_dst );
+				char txtaddr_src[ LIBIKE_MAX_TEXTADDR ];
+				char txtaddr_dst[ LIBIKE_MAX_TEXTADDR ];
+
+				text_addr( txtaddr_src, &saddr_src, false );
+				text_addr( txtaddr_dst, &saddr_dst, false );
+
+				unsigned short port_src = htons( saddr_src.saddr4.sin_port );
+				unsigned short port_dst = htons( saddr_dst.saddr4.sin_port );
+
+				if( keep_alive )
+				{
+					log.txt( LLOG_DEBUG,
+						"<- : recv NAT-T:KEEP-ALIVE packet %s:%u -> %s:%u\n",
+						txtaddr_src, port_src,
+						txtaddr_dst, port_dst );
+				}
+				else if( !recv->encap )
+				{
+					log.bin(
+						LLOG_DEBUG,
+						LLOG_DECODE,
+						packet_ike.buff(),
+						packet_ike.size(),
+						"<- : recv IKE packet %s:%u -> %s:%u",
+						txtaddr_src, port_src,
+						txtaddr_dst, port_dst );
+				}
+				else
+				{
+					log.bin(
+						LLOG_DEBUG,
+						LLOG_DECODE,
+						packet_ike.buff(),
+						packet_ike.size(),
+						"<- : recv NAT-T:IKE packet %s:%u -> %s:%u",
+						txtaddr_src, port_src,
+						txtaddr_dst, port_dst );
+				}
+			}
 
+			if( keep_alive )
 				continue;
-			}
 
 			//
-			// examine the packet contents
-			// for a NAT-T non-ESP marker
+			// process the ike packet inline or
+			// hand it off to a worker thread
 			//
 
-			uint32_t * marker = ( uint32_t * )( packet_udp.buff() + packet_udp.oset() );
-
-			if( marker[ 0 ] )
+			if( !ike_workers )
 			{
-				//
-				// obtain packet payload
-				//
-
-				PACKET_IKE packet_ike;
-				packet_udp.get( packet_ike );
-
-				log.bin(
-					LLOG_DEBUG,
-					LLOG_DECODE,
-					packet_ike.buff(),
-					packet_ike.size(),
-					"<- : recv IKE packet %s:%u -> %s:%u",
-					txtaddr_src, port_src,
-					txtaddr_dst, port_dst );
-
-				//
-				// process the ike packet
-				//
-
 				process_ike_recv(
 					packet_ike,
 					saddr_src,
@@ -188,43 +224,157 @@ long _IKED::loop_ike_nwork()
 
 				continue;
 			}
-			else
-			{
-				//
-				// skip the null marker
-				//
 
-				packet_udp.get_null( 4 );
+			process_ike_queue( recv );
+			recv_list[ index ] = NULL;
+		}
+	}
 
-				//
-				// obtain IKE packet payload
-				//
+	for( long index = 0; index < IKED_RECV_BATCH; index++ )
+		if( recv_list[ index ] != NULL )
+			delete recv_list[ index ];
 
-				PACKET_IKE packet_ike;
-				packet_udp.get( packet_ike );
+	//
+	// stop our worker threads
+	//
 
-				//
-				// process the ike packet
-				//
+	for( long index = 0; index < ike_workers; index++ )
+	{
+		ith_ikew[ index ].lock.lock();
+		ith_ikew[ index ].stop = true;
+		ith_ikew[ index ].lock.unlock();
+		ith_ikew[ index ].cond.alert();
+	}
 
-				log.bin(
-					LLOG_DEBUG,
-					LLOG_DECODE,
-					packet_ike.buff(),
-					packet_ike.size(),
-					"<- : recv NAT-T:IKE packet %s:%u -> %s:%u",
-					txtaddr_src, port_src,
-					txtaddr_dst, port_dst );
+	//
+	// stop our xauth worker threads
+	//
 
-				process_ike_recv(
-					packet_ike,
-					saddr_src,
-					saddr_dst );
-			}
+	lock_xauth.lock();
+	stop_xauth = true;
+	xauth_alert();
+	lock_xauth.unlock();
+
+	loop_ref_dec( "network" );
+
+	return LIBIKE_OK;
+}
+
+void _IKED::process_ike_queue( IKED_RECV * recv )
+{
+	//
+	// select a worker using the initiator
+	// cookie. it is the only value that is
+	// present in every packet sent for the
+	// lifetime of a phase1 sa
+	//
+
+	uint32_t hash = IDB_HASH::hash(
+		recv->packet.buff(),
+		ISAKMP_COOKIE_SIZE );
+
+	ITH_IKEW * worker = &ith_ikew[ hash % ike_workers ];
+
+	recv->next = NULL;
+
+	worker->lock.lock();
+
+	//
+	// the worker drains its queue before it
+	// waits so it is only alerted when the
+	// queue was empty
+	//
+
+	bool wake = ( worker->head == NULL );
+
+	if( worker->tail != NULL )
+		worker->tail->next = recv;
+	else
+		worker->head = recv;
+
+	worker->tail = recv;
+
+	worker->lock.unlock();
+
+	if( wake )
+		worker->cond.alert();
+}
+
+long _IKED::loop_ike_work( ITH_IKEW * worker )
+{
+	//
+	// begin worker thread
+	//
+
+	loop_ref_inc( "worker" );
+
+	while( true )
+	{
+		//
+		// take the next queued packet
+		//
+
+		worker->lock.lock();
+
+		IKED_RECV * recv = worker->head;
+		if( recv != NULL )
+		{
+			worker->head = recv->next;
+			if( worker->head == NULL )
+				worker->tail = NULL;
 		}
+
+		bool stop = worker->stop;
+
+		worker->lock.unlock();
+
+		//
+		// only wait once the queue is empty.
+		// alerts may be coalesced so a single
+		// wake up can cover several packets
+		//
+
+		if( recv == NULL )
+		{
+			if( stop )
+				break;
+
+			if( !worker->cond.wait( -1 ) )
+				worker->cond.reset();
+
+			continue;
+		}
+
+		//
+		// process the ike packet
+		//
+
+		process_ike_recv(
+			recv->packet,
+			recv->saddr_src,
+			recv->saddr_dst );
+
+		delete recv;
 	}
 
-	loop_ref_dec( "network" );
+	//
+	// discard any remaining packets
+	//
+
+	worker->lock.lock();
+
+	while( worker->head != NULL )
+	{
+		IKED_RECV * recv = worker->head;
+		worker->head = recv->next;
+		delete recv;
+	}
+
+	worker->tail = NULL;
+
+	worker->lock.unlock();
+
+	loop_ref_dec( "worker" );
 
 	return LIBIKE_OK;
 }
@@ -252,9 +402,6 @@ long _IKED::process_ike_recv( PACKET_IKE & packet, IKE_SADDR & saddr_src, IKE_SA
 		return LIBIKE_OK;
 	}
 
-	char txtaddr_src[ LIBIKE_MAX_TEXTADDR ];
-	text_addr( txtaddr_src, &saddr_src, false );
-
 	//
 	// attempt to locate a known sa
 	// sa for this packet
@@ -270,6 +417,14 @@ long _IKED::process_ike_recv( PACKET_IKE & packet, IKE_SADDR & saddr_src, IKE_SA
 			XCH_STATUS_ANY,
 			&cookies ) )
 	{
+		//
+		// the source address is only needed
+		// for log output when no sa is known
+		//
+
+		char txtaddr_src[ LIBIKE_MAX_TEXTADDR ];
+		text_addr( txtaddr_src, &saddr_src, false );
+
 		//
 		// if we are acting as a responder
 		// and the packet has an SA as its
@@ -312,8 +467,17 @@ long _IKED::process_ike_recv( PACKET_IKE & packet, IKE_SADDR & saddr_src, IKE_SA
 
 		IDB_TUNNEL * tunnel = NULL;
 
+		//
+		// the tunnel is located and created while
+		// holding the idb lock so workers handling
+		// packets from the same new peer cannot
+		// each create a tunnel
+		//
+
+		lock_idb.lock();
+
 		if( !idb_list_tunnel.find(
-				true,
+				false,
 				&tunnel,
 				NULL,
 				&saddr_src,
@@ -328,10 +492,12 @@ long _IKED::process_ike_recv( PACKET_IKE & packet, IKE_SADDR & saddr_src, IKE_SA
 			IDB_PEER * peer;
 
 			if( !idb_list_peer.find(
-					true,
+					false,
 					&peer,
 					&saddr_src ) )
 			{
+				lock_idb.unlock();
+
 				log.txt( LLOG_INFO,
 					"ww : ike packet from %s ignored, no matching definition for peer\n",
 					txtaddr_src );
@@ -343,18 +509,23 @@ long _IKED::process_ike_recv( PACKET_IKE & packet, IKE_SADDR & saddr_src, IKE_SA
 
 			if( tunnel == NULL )
 			{
+				peer->dec( false );
+
+				lock_idb.unlock();
+
 				log.txt( LLOG_INFO,
 					"ww : ike packet from %s ignored, unable to create tunnel object\n",
 					txtaddr_src );
 
-				peer->dec( true );
 				return LIBIKE_MEMORY;
 			}
 
-			tunnel->add( true );
-			peer->dec( true );
+			tunnel->add( false );
+			peer->dec( false );
 		}
 
+		lock_idb.unlock();
+
 		//
 		// verify that the exchange type is correct
 		// and that we allow contact from this peer
@@ -697,6 +697,7 @@ long _IKED::pfkey_recv_spadd( PFKI_MSG & msg )
 	//
 
 	policy->sp.id = spinfo.sp.id;
+	idb_list_policy.index_plcyid( true, policy );
 
 	//
 	// if this policy was marked as nailed
@@ -1035,6 +1036,8 @@ long _IKED::pfkey_recv_getspi( PFKI_MSG & msg )
 		pcount++;
 	}
 
+	idb_list_ph2.index_spi( true, ph2 );
+
 	log.txt( LLOG_DEBUG,
 		"ii : updated spi for %i %s proposal\n",
 		pcount,
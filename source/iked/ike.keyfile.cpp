@@ -1000,24 +1000,22 @@ STACK_OF( X509 ) * build_cert_stack( IDB_LIST_CERT & certs, BDATA & leaf )
 	return chain;
 }
 
-bool _IKED::cert_verify( IDB_LIST_CERT & certs, BDATA & ca, BDATA & cert )
+IKED_CERT_STORE * _IKED::cert_store_new( BDATA & ca )
 {
-	int result = 0;
-
 	//
 	// create certificate storage
 	//
 
 	X509_STORE * store = X509_STORE_new();
 	if( store == NULL )
-		return false;
+		return NULL;
 
 	X509_STORE_set_verify_cb_func( store, verify_cb );
 	X509_LOOKUP * lookup = X509_STORE_add_lookup( store, X509_LOOKUP_file() );
 	if( lookup == NULL )
 	{
 		X509_STORE_free( store );
-		return false;
+		return NULL;
 	}
 
 	//
@@ -1028,7 +1026,7 @@ bool _IKED::cert_verify( IDB_LIST_CERT & certs, BDATA & ca, BDATA & cert )
 	if( !bdata_2_certs( &x509_ca, ca ) )
 	{
 		X509_STORE_free( store );
-		return false;
+		return NULL;
 	}
 
 	for (int i = 0; i < sk_X509_num(x509_ca); i++)
@@ -1036,6 +1034,8 @@ bool _IKED::cert_verify( IDB_LIST_CERT & certs, BDATA & ca, BDATA & cert )
 		X509_STORE_add_cert( store, sk_X509_value(x509_ca, i) );
 	}
 
+	sk_X509_pop_free( x509_ca, X509_free );
+
 #ifdef WIN32
 
 	//
@@ -1066,6 +1066,232 @@ bool _IKED::cert_verify( IDB_LIST_CERT & certs, BDATA & ca, BDATA & cert )
 
 #endif
 
+	IKED_CERT_STORE * cert_store = new IKED_CERT_STORE;
+	if( cert_store == NULL )
+	{
+		X509_STORE_free( store );
+		return NULL;
+	}
+
+	cert_store->store = store;
+	cert_store->generation = ith_atomic_inc( &cert_generation );
+	cert_store->refcount = 1;
+
+	return cert_store;
+}
+
+// newest modification time of the peer ca sources
+
+static time_t cert_store_time( IDB_PEER * peer, const char * path_ins )
+{
+	time_t mtime = 0;
+	struct stat sb;
+
+	if( peer->cert_r_path.size() )
+		if( !stat( peer->cert_r_path.text(), &sb ) )
+			mtime = sb.st_mtime;
+
+#ifdef WIN32
+
+	char tmppath[ MAX_PATH ];
+	sprintf_s( tmppath, MAX_PATH, "%s\\certificates", path_ins );
+
+	if( !stat( tmppath, &sb ) )
+		if( mtime < sb.st_mtime )
+			mtime = sb.st_mtime;
+
+#endif
+
+	return mtime;
+}
+
+IKED_CERT_STORE * _IKED::cert_store_get( IDB_PEER * peer )
+{
+	peer->cert_lock.lock();
+
+	//
+	// periodically check if the ca sources
+	// were modified since our store was
+	// built and reload them if needed
+	//
+
+	time_t now = time( NULL );
+
+	if( ( peer->cert_r_store != NULL ) && ( now >= peer->cert_r_check ) )
+	{
+		peer->cert_r_check = now + IKED_CERT_CHECK_DELAY;
+
+		time_t mtime = cert_store_time( peer, path_ins );
+		if( mtime != peer->cert_r_time )
+		{
+			bool reload = true;
+
+			if( peer->cert_r_path.size() )
+			{
+				BDATA ca;
+				BDATA pass = peer->cert_r_pass;
+
+				if( cert_load( ca, peer->cert_r_path.text(), true, pass ) == FILE_OK )
+					peer->cert_r = ca;
+				else
+				{
+					log.txt( LLOG_ERROR,
+						"!! : unable to reload ca file %s\n",
+						peer->cert_r_path.text() );
+
+					reload = false;
+				}
+			}
+
+			if( reload )
+			{
+				log.txt( LLOG_INFO, "ii : ca modified, rebuilding x509 store\n" );
+
+				cert_store_put( peer->cert_r_store );
+				peer->cert_r_store = NULL;
+			}
+		}
+	}
+
+	//
+	// build our store on first use
+	//
+
+	if( peer->cert_r_store == NULL )
+	{
+		peer->cert_r_time = cert_store_time( peer, path_ins );
+		peer->cert_r_check = now + IKED_CERT_CHECK_DELAY;
+		peer->cert_r_store = cert_store_new( peer->cert_r );
+	}
+
+	IKED_CERT_STORE * cert_store = peer->cert_r_store;
+	if( cert_store != NULL )
+		ith_atomic_inc( &cert_store->refcount );
+
+	peer->cert_lock.unlock();
+
+	return cert_store;
+}
+
+void _IKED::cert_store_put( IKED_CERT_STORE * cert_store )
+{
+	if( ith_atomic_dec( &cert_store->refcount ) )
+		return;
+
+	X509_STORE_free( cert_store->store );
+	delete cert_store;
+}
+
+void _IKED::cert_cache_hash( IDB_LIST_CERT & certs, unsigned char * hash )
+{
+	SHA_CTX ctx;
+	SHA1_Init( &ctx );
+
+	uint8_t type;
+	BDATA cert;
+	long index = 0;
+
+	while( certs.get( type, cert, index++ ) )
+		SHA1_Update( &ctx, cert.buff(), cert.size() );
+
+	SHA1_Final( hash, &ctx );
+}
+
+bool _IKED::cert_cache_find( unsigned char * hash, long generation )
+{
+	IKED_CERT_CACHE * entry = &cert_cache[ ( hash[ 0 ] | hash[ 1 ] << 8 ) % IKED_CERT_CACHE_SIZE ];
+
+	lock_cert.lock();
+
+	bool found =
+		( entry->generation == generation ) &&
+		( entry->expire > time( NULL ) ) &&
+		!memcmp( entry->hash, hash, SHA_DIGEST_LENGTH );
+
+	lock_cert.unlock();
+
+	return found;
+}
+
+void _IKED::cert_cache_add( unsigned char * hash, long generation, time_t expire )
+{
+	IKED_CERT_CACHE * entry = &cert_cache[ ( hash[ 0 ] | hash[ 1 ] << 8 ) % IKED_CERT_CACHE_SIZE ];
+
+	lock_cert.lock();
+
+	memcpy( entry->hash, hash, SHA_DIGEST_LENGTH );
+	entry->generation = generation;
+	entry->expire = expire;
+
+	lock_cert.unlock();
+}
+
+// check if a verify result may be cached until expire
+
+static bool cert_cache_valid( X509_STORE_CTX * store_ctx, X509_STORE * store, time_t * expire )
+{
+	//
+	// every certificate in the verified
+	// chain must remain valid
+	//
+
+	STACK_OF( X509 ) * vchain = X509_STORE_CTX_get_chain( store_ctx );
+	if( vchain == NULL )
+		return false;
+
+	for( int i = 0; i < sk_X509_num( vchain ); i++ )
+		if( X509_cmp_time( X509_get_notAfter( sk_X509_value( vchain, i ) ), expire ) <= 0 )
+			return false;
+
+	//
+	// every crl in the store must remain
+	// fresh. a replacement crl will rebuild
+	// the store and change its generation
+	//
+
+	for( int i = 0; i < sk_X509_OBJECT_num( store->objs ); i++ )
+	{
+		X509_OBJECT * obj = sk_X509_OBJECT_value( store->objs, i );
+		if( obj->type != X509_LU_CRL )
+			continue;
+
+		ASN1_TIME * next = X509_CRL_get_nextUpdate( obj->data.crl );
+		if( next != NULL )
+			if( X509_cmp_time( next, expire ) <= 0 )
+				return false;
+	}
+
+	return true;
+}
+
+bool _IKED::cert_verify( IDB_LIST_CERT & certs, IDB_PEER * peer, BDATA & cert )
+{
+	int result = 0;
+
+	//
+	// obtain the peer certificate storage
+	//
+
+	IKED_CERT_STORE * cert_store = cert_store_get( peer );
+	if( cert_store == NULL )
+		return false;
+
+	//
+	// check for a cached verify result
+	//
+
+	unsigned char hash[ SHA_DIGEST_LENGTH ];
+	cert_cache_hash( certs, hash );
+
+	if( cert_cache_find( hash, cert_store->generation ) )
+	{
+		log.txt( LLOG_DEBUG, "ii : using cached certificate verify result\n" );
+
+		cert_store_put( cert_store );
+
+		return true;
+	}
+
 	//
 	// create certificate chain
 	//
@@ -1086,15 +1312,25 @@ bool _IKED::cert_verify( IDB_LIST_CERT & certs, BDATA & ca, BDATA & cert )
 			// iniitialize our store context
 			//
 
-			X509_STORE_CTX_init( store_ctx, store, x509_cert, chain );
+			X509_STORE_CTX_init( store_ctx, cert_store->store, x509_cert, chain );
 			X509_STORE_CTX_set_flags( store_ctx, X509_V_FLAG_CRL_CHECK );
 			X509_STORE_CTX_set_flags( store_ctx, X509_V_FLAG_CRL_CHECK_ALL );
 
 			//
-			// verify our certificate and cleanup
+			// verify our certificate and
+			// cache a successful result
 			//
 
 			result = X509_verify_cert( store_ctx );
+
+			if( result > 0 )
+			{
+				time_t expire = time( NULL ) + IKED_CERT_CACHE_LIFE;
+
+				if( cert_cache_valid( store_ctx, cert_store->store, &expire ) )
+					cert_cache_add( hash, cert_store->generation, expire );
+			}
+
 			X509_STORE_CTX_free( store_ctx );
 		}
 
@@ -1106,8 +1342,7 @@ bool _IKED::cert_verify( IDB_LIST_CERT & certs, BDATA & ca, BDATA & cert )
 	//
 
 	sk_X509_pop_free( chain, X509_free );
-	sk_X509_free( x509_ca );
-	X509_STORE_free( store );
+	cert_store_put( cert_store );
 
 	return ( result > 0 );
 }
@@ -1260,30 +1495,123 @@ long _IKED::prvkey_rsa_load( BDATA & prvkey, BDATA & input, BDATA & pass )
 	return FILE_OK;
 }
 
-bool _IKED::pubkey_rsa_read( BDATA & cert, BDATA & pubkey )
+//
+// parsed rsa keys are cached in the peer and
+// returned with an added reference. callers
+// must release the key using RSA_free
+//
+
+RSA * _IKED::prvkey_rsa_get( IDB_PEER * peer )
+{
+	peer->cert_lock.lock();
+
+	if( peer->cert_k_rsa == NULL )
+		bdata_2_prvkey_rsa( &peer->cert_k_rsa, peer->cert_k );
+
+	RSA * rsa = peer->cert_k_rsa;
+	if( rsa != NULL )
+		RSA_up_ref( rsa );
+
+	peer->cert_lock.unlock();
+
+	return rsa;
+}
+
+RSA * _IKED::pubkey_rsa_get( IDB_PEER * peer, BDATA & cert )
 {
+	unsigned char hash[ SHA_DIGEST_LENGTH ];
+	SHA1( cert.buff(), cert.size(), hash );
+
+	IKED_RSA_CACHE * set = peer->cert_r_rsa[ ( hash[ 0 ] | hash[ 1 ] << 8 ) % IKED_RSA_CACHE_SETS ];
+
+	//
+	// check for a cached public key
+	//
+
+	peer->cert_lock.lock();
+
+	for( long way = 0; way < IKED_RSA_CACHE_WAYS; way++ )
+	{
+		IKED_RSA_CACHE * entry = &set[ way ];
+
+		if( ( entry->rsa != NULL ) && !memcmp( entry->hash, hash, SHA_DIGEST_LENGTH ) )
+		{
+			entry->used = ++peer->cert_r_used;
+
+			RSA * rsa = entry->rsa;
+			RSA_up_ref( rsa );
+
+			peer->cert_lock.unlock();
+
+			return rsa;
+		}
+	}
+
+	peer->cert_lock.unlock();
+
+	//
+	// read the public key from the
+	// certificate and cache it
+	//
+
 	X509 * x509;
 	if( !bdata_2_cert( &x509, cert ) )
-		return false;
+		return NULL;
 
 	EVP_PKEY * evp_pkey = X509_get_pubkey( x509 );
 
 	X509_free( x509 );
 
 	if( evp_pkey == NULL )
-		return false;
+		return NULL;
 
-	bool result = pubkey_rsa_2_bdata( pubkey, evp_pkey->pkey.rsa );
+	RSA * rsa = EVP_PKEY_get1_RSA( evp_pkey );
 
 	EVP_PKEY_free( evp_pkey );
 
-	return result;
+	if( rsa == NULL )
+		return NULL;
+
+	peer->cert_lock.lock();
+
+	//
+	// replace a key cached for the same
+	// certificate by another thread, an
+	// unused entry or the least recently
+	// used entry in the set
+	//
+
+	IKED_RSA_CACHE * entry = &set[ 0 ];
+
+	for( long way = 0; way < IKED_RSA_CACHE_WAYS; way++ )
+	{
+		if( ( set[ way ].rsa != NULL ) && !memcmp( set[ way ].hash, hash, SHA_DIGEST_LENGTH ) )
+		{
+			entry = &set[ way ];
+			break;
+		}
+
+		if( ( entry->rsa != NULL ) && ( ( set[ way ].rsa == NULL ) || ( set[ way ].used < entry->used ) ) )
+			entry = &set[ way ];
+	}
+
+	if( entry->rsa != NULL )
+		RSA_free( entry->rsa );
+
+	memcpy( entry->hash, hash, SHA_DIGEST_LENGTH );
+	entry->used = ++peer->cert_r_used;
+	entry->rsa = rsa;
+	RSA_up_ref( rsa );
+
+	peer->cert_lock.unlock();
+
+	return rsa;
 }
 
-bool _IKED::prvkey_rsa_encrypt( BDATA & prvkey, BDATA & hash, BDATA & sign )
+bool _IKED::prvkey_rsa_encrypt( IDB_PEER * peer, BDATA & hash, BDATA & sign )
 {
-	RSA * rsa;
-	if( !bdata_2_prvkey_rsa( &rsa, prvkey ) )
+	RSA * rsa = prvkey_rsa_get( peer );
+	if( rsa == NULL )
 		return false;
 
 	int size = RSA_size( rsa );
@@ -1296,22 +1624,18 @@ bool _IKED::prvkey_rsa_encrypt( BDATA & prvkey, BDATA & hash, BDATA & sign )
 				rsa,
 				RSA_PKCS1_PADDING );
 
+	RSA_free( rsa );
+
 	if( size == -1 )
 		return false;
 
-	RSA_free( rsa );
-
 	sign.size( size );
 
 	return true;
 }
 
-bool _IKED::pubkey_rsa_decrypt( BDATA & pubkey, BDATA & sign, BDATA & hash )
+bool _IKED::pubkey_rsa_decrypt( RSA * rsa, BDATA & sign, BDATA & hash )
 {
-	RSA * rsa;
-	if( !bdata_2_pubkey_rsa( &rsa, pubkey ) )
-		return false;
-
 	int size = RSA_size( rsa );
 	hash.size( size );
 
@@ -1325,8 +1649,6 @@ bool _IKED::pubkey_rsa_decrypt( BDATA & pubkey, BDATA & sign, BDATA & hash )
 	if( size == -1 )
 		return false;
 
-	RSA_free( rsa );
-
 	hash.size( size );
 
 	return true;
@@ -616,6 +616,9 @@ const char * _IKED::find_name( long type, long id )
 			static const char * group16 = "group16 ( modp-4096 )";
 			static const char * group17 = "group17 ( modp-6144 )";
 			static const char * group18 = "group18 ( modp-8192 )";
+			static const char * group19 = "group19 ( ecp-256 )";
+			static const char * group20 = "group20 ( ecp-384 )";
+			static const char * group21 = "group21 ( ecp-521 )";
 
 			switch( id )
 			{
@@ -652,6 +655,15 @@ const char * _IKED::find_name( long type, long id )
 				case IKE_GRP_GROUP18:
 					return group18;
 
+				case IKE_GRP_GROUP19:
+					return group19;
+
+				case IKE_GRP_GROUP20:
+					return group20;
+
+				case IKE_GRP_GROUP21:
+					return group21;
+
 				default:
 					return unknown2;
 			}
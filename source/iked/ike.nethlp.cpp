@@ -423,6 +423,29 @@ bool cmp_sockaddr( sockaddr & saddr1, sockaddr & saddr2, bool port )
 	return false;
 }
 
+//
+// index key for a socket address. the port
+// is not included so that addresses which
+// only differ by port share the same key
+//
+
+uint32_t key_sockaddr( sockaddr & saddr )
+{
+	switch( saddr.sa_family )
+	{
+		case AF_INET:
+		{
+			sockaddr_in * saddr_in = ( sockaddr_in * ) &saddr;
+
+			return IDB_HASH::hash(
+				&saddr_in->sin_addr,
+				sizeof( saddr_in->sin_addr ) );
+		}
+	}
+
+	return 0;
+}
+
 bool cpy_sockaddr( sockaddr & saddr1, sockaddr & saddr2, bool port )
 {
 	switch( saddr1.sa_family )
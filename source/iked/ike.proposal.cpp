@@ -75,6 +75,9 @@ long _IKED::phase1_gen_prop( IDB_PH1 * ph1 )
 
 	unsigned short glist[] =
 	{
+#ifdef DH_HAVE_ECP
+		IKE_GRP_GROUP19,
+#endif
 		IKE_GRP_GROUP14,
 		IKE_GRP_GROUP5,
 		IKE_GRP_GROUP2,
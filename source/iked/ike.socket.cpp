@@ -49,6 +49,57 @@ long _IKED::socket_init()
 {
 	socketpair( AF_UNIX, SOCK_STREAM, 0, wake_socket );
 	fcntl( wake_socket[ 0 ], F_SETFL, O_NONBLOCK );
+
+#ifdef __linux__
+
+	//
+	// register the wakeup socket and any
+	// sockets created while the config was
+	// loaded with our event poll. sockets
+	// are identified by their info pointer
+	// and the wakeup socket by null
+	//
+
+	poll_socket = epoll_create( IKED_RECV_BATCH );
+	if( poll_socket < 0 )
+	{
+		log.txt( LLOG_ERROR, "!! : socket event poll create failed\n" );
+		return LIBIKE_SOCKET;
+	}
+
+	epoll_event event;
+	memset( &event, 0, sizeof( event ) );
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+
+	if( epoll_ctl( poll_socket, EPOLL_CTL_ADD, wake_socket[ 0 ], &event ) < 0 )
+	{
+		log.txt( LLOG_ERROR, "!! : socket event poll add failed\n" );
+		return LIBIKE_SOCKET;
+	}
+
+	lock_net.lock();
+
+	long count = list_socket.count();
+	long index = 0;
+
+	for( ; index < count; index++ )
+	{
+		SOCK_INFO * sock_info = static_cast<SOCK_INFO*>( list_socket.get_entry( index ) );
+
+		event.data.ptr = sock_info;
+		if( epoll_ctl( poll_socket, EPOLL_CTL_ADD, sock_info->sock, &event ) < 0 )
+		{
+			lock_net.unlock();
+			log.txt( LLOG_ERROR, "!! : socket event poll add failed\n" );
+			return LIBIKE_SOCKET;
+		}
+	}
+
+	lock_net.unlock();
+
+#endif
+
 	return LIBIKE_OK;
 }
 
@@ -60,6 +111,16 @@ void _IKED::socket_done()
 		close( sock_info->sock );
 		delete sock_info;
 	}
+
+#ifdef __linux__
+
+	if( poll_socket >= 0 )
+	{
+		close( poll_socket );
+		poll_socket = -1;
+	}
+
+#endif
 }
 
 long _IKED::socket_create( IKE_SADDR & saddr, bool natt )
@@ -143,6 +204,32 @@ long _IKED::socket_create( IKE_SADDR & saddr, bool natt )
 
 	lock_net.lock();
 
+#ifdef __linux__
+
+	//
+	// a socket that cannot be registered with
+	// our event poll would never be read
+	//
+
+	if( poll_socket >= 0 )
+	{
+		epoll_event event;
+		memset( &event, 0, sizeof( event ) );
+		event.events = EPOLLIN;
+		event.data.ptr = sock_info;
+
+		if( epoll_ctl( poll_socket, EPOLL_CTL_ADD, sock_info->sock, &event ) < 0 )
+		{
+			lock_net.unlock();
+			log.txt( LLOG_ERROR, "!! : socket event poll add failed\n" );
+			close( sock_info->sock );
+			delete sock_info;
+			return LIBIKE_SOCKET;
+		}
+	}
+
+#endif
+
 	list_socket.add_entry( sock_info );
 
 	lock_net.unlock();
@@ -247,8 +334,235 @@ long _IKED::header( PACKET_IP & packet, ETH_HEADER & header )
 	return LIBIKE_OK;
 }
 
-long _IKED::recv_ip( PACKET_IP & packet, ETH_HEADER * ethhdr )
+void _IKED::recv_ike_prep( SOCK_INFO * sock_info, IKED_RECV * recv, msghdr & msg, iovec * iov, uint32_t * marker, unsigned char * ctrl, long ctrl_size )
+{
+	//
+	// the datagram is received directly
+	// into the ike packet buffer. natt
+	// sockets scatter the leading four
+	// bytes so a non-esp marker can be
+	// stripped without moving the data
+	//
+
+	recv->packet.reset();
+	recv->packet.size( RAWNET_BUFF_SIZE );
+
+	int iovcnt = 0;
+
+	*marker = 0;
+
+	if( sock_info->natt )
+	{
+		iov[ iovcnt ].iov_base = marker;
+		iov[ iovcnt ].iov_len = sizeof( *marker );
+		iovcnt++;
+	}
+
+	iov[ iovcnt ].iov_base = recv->packet.buff();
+	iov[ iovcnt ].iov_len = recv->packet.size();
+	iovcnt++;
+
+	memset( &recv->saddr_src, 0, sizeof( recv->saddr_src ) );
+
+	msg.msg_name = (caddr_t)&recv->saddr_src;
+	msg.msg_namelen = sizeof( recv->saddr_src.saddr4 );
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iovcnt;
+	msg.msg_control = ctrl;
+	msg.msg_controllen = ctrl_size;
+	msg.msg_flags = 0;
+}
+
+void _IKED::recv_ike_done( SOCK_INFO * sock_info, IKED_RECV * recv, msghdr & msg, uint32_t marker, long size )
+{
+	//
+	// the destination address is obtained
+	// from the packet info and the port is
+	// the one our socket is bound to
+	//
+
+	IKE_SADDR & saddr_src = recv->saddr_src;
+	IKE_SADDR & saddr_dst = recv->saddr_dst;
+	PACKET_IKE & packet = recv->packet;
+
+	memset( &saddr_dst, 0, sizeof( saddr_dst ) );
+
+	saddr_src.saddr4.sin_family = AF_INET;
+	saddr_dst.saddr4.sin_family = AF_INET;
+	saddr_dst.saddr4.sin_port = sock_info->saddr.saddr4.sin_port;
+
+#ifdef __linux__
+
+	struct cmsghdr *cm;
+	cm = (struct cmsghdr *) msg.msg_control;
+
+	struct in_pktinfo * pi;
+	pi = ( struct in_pktinfo * )( CMSG_DATA( cm ) );
+
+	memcpy(
+		&saddr_dst.saddr4.sin_addr,
+		&pi->ipi_addr,
+		sizeof( saddr_dst.saddr4.sin_addr ) );
+
+#else
+
+	memcpy(
+		&saddr_dst.saddr4.sin_addr,
+		CMSG_DATA( msg.msg_control ),
+		sizeof( saddr_dst.saddr4.sin_addr ) );
+
+#endif
+
+	recv->encap = false;
+
+	if( sock_info->natt )
+	{
+		//
+		// datagrams shorter than a marker
+		// are NAT-T keep alives, return
+		// them to the caller as is
+		//
+
+		if( size < ( long ) sizeof( marker ) )
+		{
+			packet.size( 0 );
+			packet.add( &marker, size );
+
+			return;
+		}
+
+		size -= sizeof( marker );
+
+		//
+		// if no non-esp marker is present,
+		// restore the leading packet bytes
+		//
+
+		if( marker )
+		{
+			packet.size( size );
+			packet.ins( &marker, sizeof( marker ), 0 );
+
+			return;
+		}
+
+		recv->encap = true;
+	}
+
+	packet.size( size );
+}
+
+#ifdef __linux__
+
+long _IKED::recv_ike( IKED_RECV ** recv_list, long & recv_count )
 {
+	recv_count = 0;
+
+	//
+	// wait for socket events. the socket
+	// set is registered with the poll as
+	// sockets are created so nothing is
+	// rebuilt for each call
+	//
+
+	epoll_event events[ IKED_RECV_BATCH ];
+
+	int ready = epoll_wait( poll_socket, events, IKED_RECV_BATCH, -1 );
+	if( ready < 0 )
+	{
+		if( errno == EINTR )
+			return LIBIKE_NODATA;
+
+		return LIBIKE_SOCKET;
+	}
+
+	mmsghdr			msgs[ IKED_RECV_BATCH ];
+	iovec			iovs[ IKED_RECV_BATCH ][ 2 ];
+	uint32_t		markers[ IKED_RECV_BATCH ];
+	unsigned char	ctrls[ IKED_RECV_BATCH ][ 256 ];
+
+	for( int event = 0; event < ready; event++ )
+	{
+		SOCK_INFO * sock_info = static_cast<SOCK_INFO*>( events[ event ].data.ptr );
+
+		if( sock_info == NULL )
+			return LIBIKE_SOCKET;
+
+		//
+		// drain the ready socket with batched
+		// receives until it would block or our
+		// packet list is full. sockets that
+		// still hold data are reported again
+		// by the next poll
+		//
+
+		while( recv_count < IKED_RECV_BATCH )
+		{
+			long avail = IKED_RECV_BATCH - recv_count;
+			long index = 0;
+
+			for( ; index < avail; index++ )
+			{
+				recv_ike_prep(
+					sock_info,
+					recv_list[ recv_count + index ],
+					msgs[ index ].msg_hdr,
+					iovs[ index ],
+					&markers[ index ],
+					ctrls[ index ],
+					sizeof( ctrls[ index ] ) );
+
+				msgs[ index ].msg_len = 0;
+			}
+
+			int result = recvmmsg( sock_info->sock, msgs, avail, MSG_DONTWAIT, NULL );
+			if( result <= 0 )
+				break;
+
+			//
+			// complete each datagram and compact
+			// the list to skip any empty ones
+			//
+
+			long filled = recv_count;
+
+			for( index = 0; index < result; index++ )
+			{
+				if( !msgs[ index ].msg_len )
+					continue;
+
+				IKED_RECV * recv = recv_list[ recv_count + index ];
+
+				recv_ike_done(
+					sock_info,
+					recv,
+					msgs[ index ].msg_hdr,
+					markers[ index ],
+					msgs[ index ].msg_len );
+
+				recv_list[ recv_count + index ] = recv_list[ filled ];
+				recv_list[ filled++ ] = recv;
+			}
+
+			recv_count = filled;
+
+			if( result < avail )
+				break;
+		}
+	}
+
+	if( !recv_count )
+		return LIBIKE_NODATA;
+
+	return LIBIKE_OK;
+}
+
+#else
+
+long _IKED::recv_ike( IKED_RECV ** recv_list, long & recv_count )
+{
+	recv_count = 0;
+
 	fd_set fdset;
 	FD_ZERO( &fdset );
 
@@ -281,14 +595,10 @@ long _IKED::recv_ip( PACKET_IP & packet, ETH_HEADER * ethhdr )
 		return LIBIKE_SOCKET;
 
 	//
-	// recv packet data
+	// drain each ready socket until it
+	// would block or our list is full
 	//
 
-	IKE_SADDR	from;
-	IKE_SADDR	dest;
-
-	socklen_t	flen = sizeof( from.saddr4 );
-
 	for( index = 0; index < count; index++ )
 	{
 		SOCK_INFO * sock_info = static_cast<SOCK_INFO*>( list_socket.get_entry( index ) );
@@ -296,89 +606,104 @@ long _IKED::recv_ip( PACKET_IP & packet, ETH_HEADER * ethhdr )
 		if( FD_ISSET( sock_info->sock, &fdset ) == 0 )
 			continue;
 
-		unsigned char buff[ RAWNET_BUFF_SIZE ];
-		unsigned char ctrl[ 256 ];
-
-		iovec iov;
-		iov.iov_base = buff;
-		iov.iov_len = RAWNET_BUFF_SIZE;
+		while( recv_count < IKED_RECV_BATCH )
+		{
+			IKED_RECV * recv = recv_list[ recv_count ];
 
-		msghdr msg;
-		msg.msg_name = (caddr_t)&from;
-		msg.msg_namelen = flen;
-		msg.msg_iov = &iov;
-		msg.msg_iovlen = 1;
-		msg.msg_control = ctrl;
-		msg.msg_controllen = 256;
-		msg.msg_flags = 0;
+			msghdr			msg;
+			iovec			iov[ 2 ];
+			uint32_t		marker;
+			unsigned char	ctrl[ 256 ];
 
-		long result = recvmsg( sock_info->sock, &msg, 0 );
-		if( result <= 0 )
-			continue;
+			recv_ike_prep( sock_info, recv, msg, iov, &marker, ctrl, sizeof( ctrl ) );
 
-#ifdef __linux__
+			long result = recvmsg( sock_info->sock, &msg, MSG_DONTWAIT );
+			if( result < 0 )
+				break;
 
-		struct cmsghdr *cm;
-		cm = (struct cmsghdr *) ctrl;
+			if( result == 0 )
+				continue;
 
-		struct in_pktinfo * pi;
-		pi = ( struct in_pktinfo * )( CMSG_DATA( cm ) );
+			recv_ike_done( sock_info, recv, msg, marker, result );
 
-		memcpy(
-			&dest.saddr4.sin_addr,
-			&pi->ipi_addr,
-			sizeof( dest.saddr4.sin_addr ) );
+			recv_count++;
+		}
+	}
 
-#else
+	if( !recv_count )
+		return LIBIKE_NODATA;
 
-		memcpy(
-			&dest.saddr4.sin_addr,
-			CMSG_DATA( msg.msg_control ),
-			sizeof( dest.saddr4.sin_addr ) );
+	return LIBIKE_OK;
+}
 
 #endif
 
-		//
-		// add udp and ip headers
-		//
+SOCK_INFO * _IKED::socket_lookup_sock( IKE_SADDR & saddr_l )
+{
+	//
+	// locate the bound socket that should
+	// be used to send from a local address
+	//
+
+	long count = list_socket.count();
+	long index = 0;
+
+	for( ; index < count; index++ )
+	{
+		SOCK_INFO * sock_info = static_cast<SOCK_INFO*>( list_socket.get_entry( index ) );
+
+		if( has_sockaddr( &sock_info->saddr.saddr ) )
+		{
+			if( !cmp_sockaddr( sock_info->saddr.saddr, saddr_l.saddr, true ) )
+				continue;
+		}
+		else
+		{
+			u_int16_t port1;
+			u_int16_t port2;
+			get_sockport( sock_info->saddr.saddr, port1 );
+			get_sockport( saddr_l.saddr, port2 );
 
-		PACKET_UDP packet_udp;
+			if( port1 != port2 )
+				continue;
+		}
 
-		packet_udp.write(
-			from.saddr4.sin_port,
-			sock_info->saddr.saddr4.sin_port );
+		return sock_info;
+	}
 
-		packet_udp.add( buff, result );
+	return NULL;
+}
 
-		packet_udp.done(
-			from.saddr4.sin_addr,
-			dest.saddr4.sin_addr );
+bool _IKED::send_ip_read( PACKET_IP & packet, IKE_SADDR & saddr_src, IKE_SADDR & saddr_dst )
+{
+	//
+	// read the ip and udp headers in place.
+	// the packet offset is left pointing to
+	// the udp payload
+	//
 
-		packet.write(
-			from.saddr4.sin_addr,
-			dest.saddr4.sin_addr,
-			0,
-			PROTO_IP_UDP );
+	unsigned char prot;
 
-		packet.add( packet_udp );
-		packet.done();
+	memset( &saddr_src, 0, sizeof( saddr_src ) );
+	memset( &saddr_dst, 0, sizeof( saddr_dst ) );
 
-		//
-		// optionally return an ethernet
-		// header for this packet
-		//
+	saddr_src.saddr4.sin_family = AF_INET;
+	saddr_dst.saddr4.sin_family = AF_INET;
 
-		if( ethhdr != NULL )
-		{
-			result = header( packet, *ethhdr );
-			if( result == LIBIKE_SOCKET )
-				return LIBIKE_SOCKET;
-		}
+	if( !packet.read(
+			saddr_src.saddr4.sin_addr,
+			saddr_dst.saddr4.sin_addr,
+			prot ) )
+		return false;
 
-		return LIBIKE_OK;
-	}
+	UDP_HEADER udp_header;
+	if( !packet.get( &udp_header, sizeof( udp_header ) ) )
+		return false;
 
-	return LIBIKE_NODATA;
+	saddr_src.saddr4.sin_port = udp_header.port_src;
+	saddr_dst.saddr4.sin_port = udp_header.port_dst;
+
+	return true;
 }
 
 long _IKED::send_ip( PACKET_IP & packet, ETH_HEADER * ethhdr )
@@ -389,90 +714,189 @@ long _IKED::send_ip( PACKET_IP & packet, ETH_HEADER * ethhdr )
 
 	IKE_SADDR saddr_src;
 	IKE_SADDR saddr_dst;
-	unsigned char prot;
 
-	memset( &saddr_src, 0, sizeof( saddr_src ) );
-	memset( &saddr_dst, 0, sizeof( saddr_dst ) );
+	send_ip_read( packet, saddr_src, saddr_dst );
 
-	saddr_src.saddr4.sin_family = AF_INET;
-	saddr_dst.saddr4.sin_family = AF_INET;
+	SOCK_INFO * sock_info = socket_lookup_sock( saddr_src );
+	if( sock_info == NULL )
+	{
+		log.txt( LLOG_ERROR, "!! : socket not found\n" );
+		return LIBIKE_SOCKET;
+	}
 
-	packet.read(
-		saddr_src.saddr4.sin_addr,
-		saddr_dst.saddr4.sin_addr,
-		prot );
+	//
+	// send packet data
+	//
+
+	long result = sendto(
+					sock_info->sock,
+					packet.buff() + packet.oset(),
+					packet.size() - packet.oset(),
+					0,
+					&saddr_dst.saddr,
+					sizeof( saddr_dst.saddr4 ) );
+
+	if( result <= 0 )
+	{
+		log.txt( LLOG_ERROR, "!! : send error %li\n", result );
+		return LIBIKE_SOCKET;
+	}
 
 	//
-	// read udp packet
+	// optionally return an ethernet
+	// header for this packet
 	//
 
-	PACKET_UDP packet_udp;
-	packet.get( packet_udp );
+	if( ethhdr != NULL )
+	{
+		result = header( packet, *ethhdr );
+		if( result == LIBIKE_SOCKET )
+			return LIBIKE_SOCKET;
+	}
 
-	packet_udp.read(
-		saddr_src.saddr4.sin_port,
-		saddr_dst.saddr4.sin_port );
+	return LIBIKE_OK;
+}
 
-	long count = list_socket.count();
+long _IKED::send_ip( IPQUEUE & queue, ETH_HEADER * ethhdr )
+{
+	//
+	// send all queued packets. the queued
+	// packets normally share a source and
+	// destination so the socket is only
+	// looked up when the source changes
+	//
+
+	SOCK_INFO *		sock_info = NULL;
+	IKE_SADDR		saddr_l;
+
+	IKE_SADDR		saddr_dst[ IKED_SEND_BATCH ];
+	PACKET_IP *		packets[ IKED_SEND_BATCH ];
+	long			batch = 0;
+
+	long count = queue.count();
 	long index = 0;
 
-	for( ; index < count; index++ )
+	memset( &saddr_l, 0, sizeof( saddr_l ) );
+
+	while( index < count || batch )
 	{
-		SOCK_INFO * sock_info = static_cast<SOCK_INFO*>( list_socket.get_entry( index ) );
+		IKE_SADDR saddr_src;
+		IKE_SADDR saddr_to;
+		PACKET_IP * packet = NULL;
 
-		if( has_sockaddr( &sock_info->saddr.saddr ) )
+		if( index < count )
 		{
-			if( !cmp_sockaddr( sock_info->saddr.saddr, saddr_src.saddr, true ) )
-				continue;
-		}
-		else
-		{
-			u_int16_t port1;
-			u_int16_t port2;
-			get_sockport( sock_info->saddr.saddr, port1 );
-			get_sockport( saddr_src.saddr, port2 );
-
-			if( port1 != port2 )
-				continue;
+			packet = queue.get( index );
+			send_ip_read( *packet, saddr_src, saddr_to );
 		}
 
 		//
-		// send packet data
+		// flush the batch when it is full, when
+		// the queue is empty or when the next
+		// packet needs a different socket
 		//
 
-		long result = sendto(
-						sock_info->sock,
-						packet_udp.buff() + packet_udp.oset(),
-						packet_udp.size() - packet_udp.oset(),
-						0,
-						&saddr_dst.saddr,
-						sizeof( saddr_dst.saddr4 ) );
+		bool flush = ( packet == NULL ) || ( batch == IKED_SEND_BATCH );
 
+		if( ( packet != NULL ) && ( sock_info != NULL ) )
+			if( !cmp_sockaddr( saddr_l.saddr, saddr_src.saddr, true ) )
+				flush = true;
 
-		if( result <= 0 )
+		if( flush && batch )
 		{
-			log.txt( LLOG_ERROR, "!! : send error %li\n", result );
-			return LIBIKE_SOCKET;
+
+#ifdef __linux__
+
+			mmsghdr	msgs[ IKED_SEND_BATCH ];
+			iovec	iovs[ IKED_SEND_BATCH ];
+
+			memset( msgs, 0, sizeof( msgs ) );
+
+			for( long item = 0; item < batch; item++ )
+			{
+				iovs[ item ].iov_base = packets[ item ]->buff() + packets[ item ]->oset();
+				iovs[ item ].iov_len = packets[ item ]->size() - packets[ item ]->oset();
+
+				msgs[ item ].msg_hdr.msg_name = &saddr_dst[ item ].saddr;
+				msgs[ item ].msg_hdr.msg_namelen = sizeof( saddr_dst[ item ].saddr4 );
+				msgs[ item ].msg_hdr.msg_iov = &iovs[ item ];
+				msgs[ item ].msg_hdr.msg_iovlen = 1;
+			}
+
+			long sent = 0;
+
+			while( sent < batch )
+			{
+				int result = sendmmsg( sock_info->sock, &msgs[ sent ], batch - sent, 0 );
+				if( result <= 0 )
+				{
+					log.txt( LLOG_ERROR, "!! : send error %i\n", result );
+					return LIBIKE_SOCKET;
+				}
+
+				sent += result;
+			}
+
+#else
+
+			for( long item = 0; item < batch; item++ )
+			{
+				long result = sendto(
+								sock_info->sock,
+								packets[ item ]->buff() + packets[ item ]->oset(),
+								packets[ item ]->size() - packets[ item ]->oset(),
+								0,
+								&saddr_dst[ item ].saddr,
+								sizeof( saddr_dst[ item ].saddr4 ) );
+
+				if( result <= 0 )
+				{
+					log.txt( LLOG_ERROR, "!! : send error %li\n", result );
+					return LIBIKE_SOCKET;
+				}
+			}
+
+#endif
+
+			batch = 0;
 		}
 
+		if( packet == NULL )
+			break;
+
 		//
-		// optionally return an ethernet
-		// header for this packet
+		// resolve the socket for this source
 		//
 
-		if( ethhdr != NULL )
+		if( !batch )
 		{
-			result = header( packet, *ethhdr );
-			if( result == LIBIKE_SOCKET )
+			sock_info = socket_lookup_sock( saddr_src );
+			if( sock_info == NULL )
+			{
+				log.txt( LLOG_ERROR, "!! : socket not found\n" );
 				return LIBIKE_SOCKET;
+			}
+
+			saddr_l = saddr_src;
 		}
 
-		return LIBIKE_OK;
+		saddr_dst[ batch ] = saddr_to;
+		packets[ batch++ ] = packet;
+		index++;
 	}
 
-	log.txt( LLOG_ERROR, "!! : socket not found\n" );
+	//
+	// optionally return an ethernet
+	// header for these packets
+	//
 
-	return LIBIKE_SOCKET;
+	if( ( ethhdr != NULL ) && count )
+	{
+		if( header( *queue.get( 0 ), *ethhdr ) == LIBIKE_SOCKET )
+			return LIBIKE_SOCKET;
+	}
+
+	return LIBIKE_OK;
 }
 
 //
@@ -45,10 +45,349 @@
 // XAUTH - BASE CLASS
 //
 
+_IKED_XAUTH::_IKED_XAUTH()
+{
+	conc_max = 0;
+	conc_cur = 0;
+
+	memset( hist, 0, sizeof( hist ) );
+}
+
 _IKED_XAUTH::~_IKED_XAUTH()
 {
 }
 
+void _IKED_XAUTH::hist_add( long msecs )
+{
+	//
+	// bucket zero holds requests that took
+	// less than a msec, bucket N holds those
+	// that took less than 2^N msecs
+	//
+
+	long index = 0;
+	while( msecs && ( index < ( XAUTH_HIST_SIZE - 1 ) ) )
+	{
+		msecs >>= 1;
+		index++;
+	}
+
+	hist[ index ]++;
+}
+
+void _IKED_XAUTH::hist_log()
+{
+	unsigned long total = 0;
+
+	long index = 0;
+	for( ; index < XAUTH_HIST_SIZE; index++ )
+		total += hist[ index ];
+
+	if( !total )
+		return;
+
+	iked.log.txt( LLOG_INFO,
+		"ii : xauth %s source handled %lu requests\n",
+		name(),
+		total );
+
+	for( index = 0; index < XAUTH_HIST_SIZE; index++ )
+	{
+		if( !hist[ index ] )
+			continue;
+
+		if( index < ( XAUTH_HIST_SIZE - 1 ) )
+			iked.log.txt( LLOG_INFO,
+				"ii : - %lu requests in less than %li ms\n",
+				hist[ index ],
+				1L << index );
+		else
+			iked.log.txt( LLOG_INFO,
+				"ii : - %lu requests in %li ms or more\n",
+				hist[ index ],
+				1L << ( index - 1 ) );
+	}
+}
+
+//
+// XAUTH - AUTH WORKER THREADS
+//
+
+long ITH_XAUTH::iked_func( void * arg )
+{
+	IKED * iked = ( IKED * ) arg;
+	return iked->loop_xauth_work();
+}
+
+static long xauth_msecs()
+{
+
+#ifdef WIN32
+
+	return GetTickCount();
+
+#endif
+
+#ifdef UNIX
+
+	timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+#endif
+
+}
+
+bool _IKED::xauth_check( IKED_XAUTH * source, IKE_XAUTH & xauth, BDATA & group )
+{
+	long start = xauth_msecs();
+
+	//
+	// check user password
+	//
+
+	bool allow = source->auth_pwd( xauth );
+
+	if( allow )
+		log.txt( LLOG_INFO,
+			"ii : xauth user %s password accepted ( %s )\n",
+			xauth.user.text(),
+			source->name() );
+	else
+		log.txt( LLOG_ERROR,
+			"!! : xauth user %s password rejected ( %s )\n",
+			xauth.user.text(),
+			source->name() );
+
+	//
+	// check user group membership
+	//
+
+	if( allow && group.size() )
+	{
+		allow = source->auth_grp( xauth, group );
+
+		if( allow )
+			log.txt( LLOG_INFO,
+				"ii : xauth user %s group %s membership accepted ( %s )\n",
+				xauth.user.text(),
+				group.text(),
+				source->name() );
+		else
+			log.txt( LLOG_ERROR,
+				"!! : xauth user %s group %s membership rejected ( %s )\n",
+				xauth.user.text(),
+				group.text(),
+				source->name() );
+	}
+
+	//
+	// record the request latency
+	//
+
+	lock_xauth.lock();
+	source->hist_add( xauth_msecs() - start );
+	lock_xauth.unlock();
+
+	return allow;
+}
+
+void _IKED::xauth_queue( IDB_CFG * cfg, IDB_PH1 * ph1 )
+{
+	//
+	// the request carries its own copy of
+	// the credentials and references to
+	// the exchange it will resume
+	//
+
+	IKED_XAUTH_RQST * rqst = new IKED_XAUTH_RQST;
+
+	rqst->source = cfg->tunnel->peer->xauth_source;
+	rqst->xauth.user.set( cfg->tunnel->xauth.user );
+	rqst->xauth.pass.set( cfg->tunnel->xauth.pass );
+	rqst->group.set( cfg->tunnel->peer->xauth_group );
+
+	cfg->inc();
+	ph1->inc();
+
+	rqst->cfg = cfg;
+	rqst->ph1 = ph1;
+
+	lock_xauth.lock();
+	list_xauth.add_entry( rqst );
+	xauth_alert();
+	lock_xauth.unlock();
+}
+
+void _IKED::xauth_alert()
+{
+	//
+	// called with the xauth lock held. busy
+	// workers take queued requests before they
+	// wait, so an alert is only needed when a
+	// worker is waiting. only one alert is left
+	// pending at a time so the condition never
+	// holds more than a single wake up
+	//
+
+	if( !idle_xauth || wake_xauth )
+		return;
+
+	wake_xauth = true;
+	cond_xauth.alert();
+}
+
+long _IKED::loop_xauth_work()
+{
+	//
+	// begin auth worker thread
+	//
+
+	loop_ref_inc( "xauth" );
+
+	while( true )
+	{
+		lock_xauth.lock();
+
+		//
+		// take the oldest request whose source
+		// is below its concurrency limit
+		//
+
+		IKED_XAUTH_RQST * rqst = NULL;
+
+		long count = list_xauth.count();
+		long index = 0;
+
+		for( ; index < count; index++ )
+		{
+			IKED_XAUTH_RQST * next = static_cast<IKED_XAUTH_RQST*>( list_xauth.get_entry( index ) );
+
+			if( next->source->conc_max &&
+				( next->source->conc_cur >= next->source->conc_max ) )
+				continue;
+
+			list_xauth.del_entry( index );
+			next->source->conc_cur++;
+			rqst = next;
+
+			break;
+		}
+
+		//
+		// only wait once no request can be
+		// taken. a stopping worker passes the
+		// alert on to the next waiting worker
+		//
+
+		if( rqst == NULL )
+		{
+			if( stop_xauth )
+			{
+				xauth_alert();
+				lock_xauth.unlock();
+				break;
+			}
+
+			idle_xauth++;
+			lock_xauth.unlock();
+
+			cond_xauth.wait( -1 );
+
+			lock_xauth.lock();
+
+			idle_xauth--;
+
+			if( wake_xauth )
+			{
+				cond_xauth.reset();
+				wake_xauth = false;
+			}
+
+			lock_xauth.unlock();
+
+			continue;
+		}
+
+		//
+		// let a waiting worker take any other
+		// queued requests
+		//
+
+		if( list_xauth.count() )
+			xauth_alert();
+
+		lock_xauth.unlock();
+
+		//
+		// authenticate the user unless the
+		// exchange was abandoned while the
+		// request was queued
+		//
+
+		bool alive =
+			( rqst->ph1->status() != XCH_STATUS_DEAD ) &&
+			( rqst->cfg->status() != XCH_STATUS_DEAD );
+
+		bool allow = false;
+		if( alive )
+			allow = xauth_check( rqst->source, rqst->xauth, rqst->group );
+
+		lock_xauth.lock();
+
+		rqst->source->conc_cur--;
+
+		if( list_xauth.count() )
+			xauth_alert();
+
+		lock_xauth.unlock();
+
+		//
+		// resume the config exchange
+		//
+
+		if( alive )
+			config_server_xauth_rslt( rqst->cfg, rqst->ph1, allow );
+		else
+			log.txt( LLOG_INFO,
+				"ii : xauth request for user %s discarded\n",
+				rqst->xauth.user.text() );
+
+		rqst->cfg->dec( true );
+		rqst->ph1->dec( true );
+
+		delete rqst;
+	}
+
+	//
+	// discard any remaining requests
+	//
+
+	while( true )
+	{
+		lock_xauth.lock();
+
+		IKED_XAUTH_RQST * rqst = NULL;
+		if( list_xauth.count() )
+			rqst = static_cast<IKED_XAUTH_RQST*>( list_xauth.del_entry( 0 ) );
+
+		lock_xauth.unlock();
+
+		if( rqst == NULL )
+			break;
+
+		rqst->cfg->dec( true );
+		rqst->ph1->dec( true );
+
+		delete rqst;
+	}
+
+	loop_ref_dec( "xauth" );
+
+	return LIBIKE_OK;
+}
+
 //
 // XAUTH - LOCAL ACCOUNT DB
 //
@@ -57,6 +396,13 @@ static const char * iked_xauth_local_name = "local";
 
 _IKED_XAUTH_LOCAL::_IKED_XAUTH_LOCAL()
 {
+	//
+	// the system account functions are
+	// not reentrant so only one request
+	// may be handled at a time
+	//
+
+	conc_max = 1;
 }
 
 _IKED_XAUTH_LOCAL::~_IKED_XAUTH_LOCAL()
@@ -156,13 +502,18 @@ _IKED_XAUTH_LDAP::_IKED_XAUTH_LDAP()
 
 	version = 3;
 	subtree = false;
+	conc_max = 4;
+	cache_life = LDAP_CACHE_LIFE;
 	attr_user.set( "cn", strlen( "cn" ) + 1 );
 	attr_group.set( "cn", strlen( "cn" ) + 1 );
 	attr_member.set( "member", strlen( "member" ) + 1 );
+
+	lock.name( "ldap" );
 }
 
 _IKED_XAUTH_LDAP::~_IKED_XAUTH_LDAP()
 {
+	cache_list.clean();
 }
 
 const char * _IKED_XAUTH_LDAP::name()
@@ -190,6 +541,29 @@ bool _IKED_XAUTH_LDAP::open_conn( LDAP ** ld )
 		LDAP_OPT_PROTOCOL_VERSION,
 		&version );
 
+	// enable tcp keep alives for pooled connections
+
+#ifdef LDAP_OPT_X_KEEPALIVE_IDLE
+
+	int keepalive = LDAP_CONN_IDLE / 2;
+
+	ldap_set_option( *ld,
+		LDAP_OPT_X_KEEPALIVE_IDLE,
+		&keepalive );
+
+#endif
+
+	if( !bind_conn( *ld ) )
+	{
+		ldap_unbind_ext_s( *ld, NULL, NULL );
+		return false;
+	}
+
+	return true;
+}
+
+bool _IKED_XAUTH_LDAP::bind_conn( LDAP * ld )
+{
 	//
 	// attempt to bind to the ldap server.
     // default to anonymous bind unless a
@@ -197,19 +571,21 @@ bool _IKED_XAUTH_LDAP::open_conn( LDAP ** ld )
 	// specified in our configuration
     //
 
+	int res;
+
 	if( bind_dn.size() && bind_pw.size() )
 	{
 		struct berval cred;
 		cred.bv_val = bind_pw.text();
 		cred.bv_len = bind_pw.size() - 1;
 
-		res = ldap_sasl_bind_s(	*ld,
+		res = ldap_sasl_bind_s(	ld,
 				bind_dn.text(), NULL, &cred,
 				NULL, NULL, NULL );
 	}
 	else
 	{
-		res = ldap_sasl_bind_s( *ld,
+		res = ldap_sasl_bind_s( ld,
 				NULL, NULL, NULL,
 				NULL, NULL, NULL );
 	}
@@ -220,8 +596,6 @@ bool _IKED_XAUTH_LDAP::open_conn( LDAP ** ld )
 			"!! : xauth ldap search bind failed ( %s )\n",
 			ldap_err2string( res ) );
 
-		ldap_unbind_ext_s( *ld, NULL, NULL );
-
 		return false;
 	}
 
@@ -238,15 +612,12 @@ bool _IKED_XAUTH_LDAP::auth_pwd( IKE_XAUTH & xauth )
 	char *	userdn = NULL;
 	int		scope = LDAP_SCOPE_ONELEVEL;
 	int	ecount = 0;
+	int res = LDAP_SUCCESS;
+	bool rebind = false;
 
 	LDAPMessage * lr = NULL;
 	LDAPMessage * le = NULL;
 
-	// open an ldap connection
-
-	if( !open_conn( &ld ) )
-		return false;
-
 	// build an ldap user search filter
 
 	filter.add( attr_user.buff(), attr_user.size() - 1 );
@@ -259,21 +630,8 @@ bool _IKED_XAUTH_LDAP::auth_pwd( IKE_XAUTH & xauth )
 	if( subtree )
 		scope = LDAP_SCOPE_SUBTREE;
 
-	struct timeval timeout;
-	timeout.tv_sec = 15;
-	timeout.tv_usec = 0;
-
-	int res = ldap_search_ext_s( ld,
-				base.text(),
-				scope,
-				filter.text(),
-				atlist,
-				0,
-				NULL,
-				NULL,
-				&timeout,
-				2,
-				&lr );
+	if( !search( &ld, res, base.text(), scope, filter.text(), atlist, 2, &lr ) )
+		return false;
 
 	if( res != LDAP_SUCCESS )
 	{
@@ -345,6 +703,8 @@ bool _IKED_XAUTH_LDAP::auth_pwd( IKE_XAUTH & xauth )
 			NULL,
 			NULL);
 
+	rebind = true;
+
 	if( res == LDAP_SUCCESS )
 		result = true;
 
@@ -358,61 +718,40 @@ ldap_pwd_end:
 	if( lr != NULL )
 		ldap_msgfree( lr );
 
-	ldap_unbind_ext_s( ld, NULL, NULL );
+	// return the connection to the pool
+
+	put_conn( ld, rebind, !ldap_conn_lost( res ) );
 
 	return result;
 }
 
-bool _IKED_XAUTH_LDAP::auth_grp( IKE_XAUTH & xauth, BDATA & group )
+bool _IKED_XAUTH_LDAP::find_groups( BDATA & userdn, BDATA & groups )
 {
-	bool result = false;
-
 	LDAP *	ld = NULL;
 	BDATA	filter;
-	char *	atlist[ 1 ] = { NULL };
+	char *	atlist[ 2 ] = { attr_group.text(), NULL };
 	int		scope = LDAP_SCOPE_ONELEVEL;
-	int	ecount = 0;
+	int res = LDAP_SUCCESS;
 
 	LDAPMessage * lr = NULL;
+	LDAPMessage * le = NULL;
 
-	// open an ldap connection
-
-	if( !open_conn( &ld ) )
-		return false;
-
-	// build an ldap group search filter
+	// build an ldap member search filter
 
-	filter.add( "(&(", 3 );
-	filter.add( attr_group.buff(), attr_group.size() - 1 );
-	filter.add( "=", 1 );
-	filter.add( group.buff(), group.size() - 1 );
-	filter.add( ")(", 2 );
+	filter.add( "(", 1 );
 	filter.add( attr_member.buff(), attr_member.size() - 1 );
 	filter.add( "=", 1 );
-	filter.add( xauth.context.buff(), xauth.context.size() - 1 );
-	filter.add( "))", 2 );
+	filter.add( userdn.buff(), userdn.size() - 1 );
+	filter.add( ")", 1 );
 	filter.add( 0, 1 );
 
-	// attempt to locate the group dn
+	// locate all groups the user is a member of
 
 	if( subtree )
 		scope = LDAP_SCOPE_SUBTREE;
 
-	struct timeval timeout;
-	timeout.tv_sec = 15;
-	timeout.tv_usec = 0;
-
-	int res = ldap_search_ext_s( ld,
-				base.text(),
-				scope,
-				filter.text(),
-				atlist,
-				0,
-				NULL,
-				NULL,
-				&timeout,
-				2,
-				&lr );
+	if( !search( &ld, res, base.text(), scope, filter.text(), atlist, 0, &lr ) )
+		return false;
 
 	if( res != LDAP_SUCCESS )
 	{
@@ -420,36 +759,147 @@ bool _IKED_XAUTH_LDAP::auth_grp( IKE_XAUTH & xauth, BDATA & group )
 			"!! : xauth ldap group search failed ( %s )\n",
 			ldap_err2string( res ) );
 
-		goto ldap_grp_end;
+		if( lr != NULL )
+			ldap_msgfree( lr );
+
+		put_conn( ld, false, !ldap_conn_lost( res ) );
+
+		return false;
 	}
 
-	// check the number of ldap entries returned
+	// collect the group names from each entry
 
-	ecount = ldap_count_entries( ld, lr );
-	if( ecount < 1 )
-		goto ldap_grp_end;
+	le = ldap_first_entry( ld, lr );
 
-	if( ecount > 1 )
+	for( ; le != NULL; le = ldap_next_entry( ld, le ) )
 	{
-		iked.log.txt( LLOG_ERROR,
-			"!! : warning, ldap return multiple results for group %s\n",
-			group.buff() );
+		struct berval ** values = ldap_get_values_len( ld, le, attr_group.text() );
+		if( values == NULL )
+			continue;
+
+		for( long index = 0; values[ index ] != NULL; index++ )
+		{
+			groups.add( values[ index ]->bv_val, values[ index ]->bv_len );
+			groups.add( 0, 1 );
+		}
+
+		ldap_value_free_len( values );
 	}
 
-	// found a valid group membership
+	// free ldap resources
 
-	result = true;
+	ldap_msgfree( lr );
 
-ldap_grp_end:
+	// return the connection to the pool
 
-	// free ldap resources
+	put_conn( ld, false, true );
 
-	if( lr != NULL )
-		ldap_msgfree( lr );
+	return true;
+}
 
-	ldap_unbind_ext_s( ld, NULL, NULL );
+bool _IKED_XAUTH_LDAP::cache_get( BDATA & userdn, BDATA & groups )
+{
+	bool found = false;
+	time_t now = time( NULL );
 
-	return result;
+	lock.lock();
+
+	long index = 0;
+	while( index < cache_list.count() )
+	{
+		IKED_LDAP_GROUPS * entry = static_cast<IKED_LDAP_GROUPS*>( cache_list.get_entry( index ) );
+
+		// remove expired entries
+
+		if( entry->expire <= now )
+		{
+			cache_list.del_entry( index );
+			delete entry;
+			continue;
+		}
+
+		if( ( entry->userdn.size() == userdn.size() ) &&
+			!memcmp( entry->userdn.buff(), userdn.buff(), userdn.size() ) )
+		{
+			groups.set( entry->groups );
+			found = true;
+			break;
+		}
+
+		index++;
+	}
+
+	lock.unlock();
+
+	return found;
+}
+
+void _IKED_XAUTH_LDAP::cache_add( BDATA & userdn, BDATA & groups )
+{
+	if( cache_life <= 0 )
+		return;
+
+	IKED_LDAP_GROUPS * entry = new IKED_LDAP_GROUPS;
+	if( entry == NULL )
+		return;
+
+	entry->userdn.set( userdn );
+	entry->groups.set( groups );
+	entry->expire = time( NULL ) + cache_life;
+
+	lock.lock();
+
+	// make room by evicting the oldest entry
+
+	if( cache_list.count() >= LDAP_CACHE_MAX )
+		delete cache_list.del_entry( 0 );
+
+	cache_list.add_entry( entry );
+
+	lock.unlock();
+}
+
+bool _IKED_XAUTH_LDAP::auth_grp( IKE_XAUTH & xauth, BDATA & group )
+{
+	//
+	// the user dn is recorded in the
+	// xauth context by auth_pwd
+	//
+
+	if( !xauth.context.size() )
+		return false;
+
+	//
+	// read the users group list from
+	// the cache or the ldap server
+	//
+
+	BDATA groups;
+
+	if( !cache_get( xauth.context, groups ) )
+	{
+		if( !find_groups( xauth.context, groups ) )
+			return false;
+
+		cache_add( xauth.context, groups );
+	}
+
+	//
+	// check for a matching group name
+	//
+
+	size_t oset = 0;
+	while( oset < groups.size() )
+	{
+		const char * name = ( const char * ) groups.buff() + oset;
+
+		if( !_stricmp( name, group.text() ) )
+			return true;
+
+		oset += strlen( name ) + 1;
+	}
+
+	return false;
 }
 
 #endif
@@ -45,9 +45,60 @@
 // XCONF - BASE CLASS
 //
 
+_IKED_XCONF::_IKED_XCONF()
+{
+	pool4_array = NULL;
+	pool4_inuse = 0;
+	pool4_total = 0;
+
+	pool4_base = 0;
+	pool4_head = POOL4_NONE;
+	pool4_tail = POOL4_NONE;
+
+	memset( &pool4_stat, 0, sizeof( pool4_stat ) );
+
+	pool4_lock.name( "pool4" );
+}
+
 _IKED_XCONF::~_IKED_XCONF()
 {
-	delete [] pool4_array;
+	pool4_users.clean();
+
+	if( pool4_array != NULL )
+		delete [] pool4_array;
+}
+
+void _IKED_XCONF::pool4_unlink( long index )
+{
+	POOL4 & entry = pool4_array[ index ];
+
+	if( entry.prev != POOL4_NONE )
+		pool4_array[ entry.prev ].next = entry.next;
+	else
+		pool4_head = entry.next;
+
+	if( entry.next != POOL4_NONE )
+		pool4_array[ entry.next ].prev = entry.prev;
+	else
+		pool4_tail = entry.prev;
+
+	entry.prev = POOL4_NONE;
+	entry.next = POOL4_NONE;
+}
+
+void _IKED_XCONF::pool4_append( long index )
+{
+	POOL4 & entry = pool4_array[ index ];
+
+	entry.prev = pool4_tail;
+	entry.next = POOL4_NONE;
+
+	if( pool4_tail != POOL4_NONE )
+		pool4_array[ pool4_tail ].next = index;
+	else
+		pool4_head = index;
+
+	pool4_tail = index;
 }
 
 bool _IKED_XCONF::pool4_set( in_addr & base, long bits, long max )
@@ -67,9 +118,15 @@ bool _IKED_XCONF::pool4_set( in_addr & base, long bits, long max )
 	config.mask.s_addr = htonl( config.mask.s_addr );
 	config.addr.s_addr = base.s_addr & config.mask.s_addr;
 
+	pool4_users.clean();
+
 	if( pool4_array != NULL )
 		delete [] pool4_array;
 
+	pool4_array = NULL;
+	pool4_head = POOL4_NONE;
+	pool4_tail = POOL4_NONE;
+
 	//
 	// calculate max total addresses
 	// for the given network and the
@@ -123,12 +180,17 @@ bool _IKED_XCONF::pool4_set( in_addr & base, long bits, long max )
 	if( pool4_array == NULL )
 		return false;
 
+	pool4_base = ntohl( base.s_addr );
+	pool4_inuse = 0;
+
 	for( long a = 0; a < pool4_total; a++ )
 	{
-		pool4_array[ a ].addr.s_addr = htonl( ntohl( base.s_addr ) + a );
 		pool4_array[ a ].used = false;
+		pool4_append( a );
 	}
 
+	memset( &pool4_stat, 0, sizeof( pool4_stat ) );
+
 	char txtaddr[ LIBIKE_MAX_TEXTADDR ];
 	char txtmask[ LIBIKE_MAX_TEXTADDR ];
 	char txtbase[ LIBIKE_MAX_TEXTADDR ];
@@ -158,67 +220,145 @@ bool _IKED_XCONF::pool4_set( in_addr & base, long bits, long max )
 	return true;
 }
 
-bool _IKED_XCONF::pool4_get( in_addr & addr )
+bool _IKED_XCONF::pool4_get( in_addr & addr, BDATA & user )
 {
-	if( pool4_inuse == pool4_total )
-		return false;
-
 	pool4_lock.lock();
 
-	long index = 0;
-	for( ; index < pool4_total; index++ )
+	long index = POOL4_NONE;
+
+	//
+	// prefer a free address that was
+	// last leased to the same user
+	//
+
+	uint32_t key = 0;
+
+	if( user.size() )
 	{
-		if( !pool4_array[ index ].used )
+		key = IDB_HASH::hash( user.buff(), user.size() );
+
+		IDB_HASH_NODE * node = NULL;
+		POOL4 * entry;
+
+		while( ( entry = static_cast<POOL4*>( pool4_users.get_entry( key, &node ) ) ) != NULL )
 		{
-			addr = pool4_array[ index ].addr;
-			pool4_array[ index ].used = true;
+			if( !entry->used && ( entry->user == user ) )
+			{
+				index = long( entry - pool4_array );
+				pool4_stat.renewed++;
+				break;
+			}
+		}
+	}
 
-			char txtaddr[ LIBIKE_MAX_TEXTADDR ];
-			iked.text_addr( txtaddr, addr );
+	//
+	// otherwise use the address that
+	// has been free the longest
+	//
 
-			iked.log.txt( LLOG_DEBUG,
-				"ii : address %s aquired from %s pool\n",
-				txtaddr,
-				name() );
+	if( index == POOL4_NONE )
+		index = pool4_head;
 
-			break;
-		}
+	if( index == POOL4_NONE )
+	{
+		pool4_stat.failed++;
+		pool4_lock.unlock();
+
+		iked.log.txt( LLOG_ERROR,
+			"!! : %s address pool exhausted\n",
+			name() );
+
+		return false;
+	}
+
+	pool4_unlink( index );
+
+	//
+	// record the new lessee
+	//
+
+	POOL4 & entry = pool4_array[ index ];
+
+	if( entry.user != user )
+	{
+		if( entry.user.size() )
+			pool4_users.del_entry(
+				IDB_HASH::hash( entry.user.buff(), entry.user.size() ),
+				&entry );
+
+		entry.user.set( user );
+
+		if( user.size() )
+			pool4_users.add_entry( key, &entry );
 	}
 
+	entry.used = true;
+
+	pool4_inuse++;
+	pool4_stat.leases++;
+	if( pool4_stat.peak < pool4_inuse )
+		pool4_stat.peak = pool4_inuse;
+
 	pool4_lock.unlock();
 
-	return ( index < pool4_total );
+	addr.s_addr = htonl( pool4_base + index );
+
+	char txtaddr[ LIBIKE_MAX_TEXTADDR ];
+	iked.text_addr( txtaddr, addr );
+
+	iked.log.txt( LLOG_DEBUG,
+		"ii : address %s aquired from %s pool\n",
+		txtaddr,
+		name() );
+
+	return true;
 }
 
 bool _IKED_XCONF::pool4_rel( in_addr & addr )
 {
 	pool4_lock.lock();
 
-	long index = 0;
-	for( ; index < pool4_total; index++ )
-	{
-		if( pool4_array[ index ].used )
-		{
-			if( addr.s_addr == pool4_array[ index ].addr.s_addr )
-			{
-				pool4_array[ index ].used = false;
-
-				char txtaddr[ LIBIKE_MAX_TEXTADDR ];
-				iked.text_addr( txtaddr, addr );
+	//
+	// the pool is a contiguous range so
+	// the entry is found by its offset
+	//
 
-				iked.log.txt( LLOG_DEBUG,
-					"ii : address %s returned to %s pool\n",
-					txtaddr,
-					name() );
+	long index = long( ntohl( addr.s_addr ) - pool4_base );
 
-				break;
-			}
-		}
+	if( ( pool4_array == NULL ) ||
+		( index < 0 ) || ( index >= pool4_total ) ||
+		!pool4_array[ index ].used )
+	{
+		pool4_lock.unlock();
+		return false;
 	}
 
+	pool4_array[ index ].used = false;
+	pool4_append( index );
+	pool4_inuse--;
+
 	pool4_lock.unlock();
 
-	return ( index < pool4_total );
+	char txtaddr[ LIBIKE_MAX_TEXTADDR ];
+	iked.text_addr( txtaddr, addr );
+
+	iked.log.txt( LLOG_DEBUG,
+		"ii : address %s returned to %s pool\n",
+		txtaddr,
+		name() );
+
+	return true;
+}
+
+void _IKED_XCONF::pool4_stats( POOL4_STATS & stats )
+{
+	pool4_lock.lock();
+
+	stats = pool4_stat;
+	stats.total = pool4_total;
+	stats.inuse = pool4_inuse;
+
+	pool4_lock.unlock();
 }
 
 //
@@ -246,7 +386,7 @@ bool _IKED_XCONF_LOCAL::rslt( IDB_TUNNEL * tunnel )
 	tunnel->xconf.opts &= config.opts;
 
 	if( tunnel->xconf.opts & IPSEC_OPTS_ADDR )
-		pool4_get( tunnel->xconf.addr );
+		pool4_get( tunnel->xconf.addr, tunnel->xauth.user );
 
 	if( tunnel->xconf.opts & IPSEC_OPTS_MASK )
 		tunnel->xconf.mask = config.mask;
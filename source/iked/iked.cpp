@@ -48,6 +48,12 @@ long _IKED_EXEC::func( void * arg )
 	// openssl thread cleanup
 	ERR_remove_state( 0 );
 
+	// release our log ring buffer
+	iked.log.detach();
+
+	// release our packet buffer cache
+	PACKET::pool_detach();
+
 	return result;
 }
 
@@ -57,6 +63,32 @@ bool _IKED::rand_bytes( void * buff, long size )
 	return true;
 }
 
+bool _ITH_EVENT_TIMERLAG::func()
+{
+	//
+	// report the execution timer lag
+	//
+
+	ITH_TIMER_STATS stats;
+	iked.ith_timer.stats( stats );
+
+	iked.log.txt( LLOG_DEBUG,
+		"ii : timer executed %lu events, lag last %li max %li avg %li usecs\n",
+		stats.events,
+		stats.lag_last,
+		stats.lag_max,
+		stats.lag_avg );
+
+	if( ( stats.lag_max > IKED_LAG_WARN ) && ( stats.lag_max > lag_max ) )
+		iked.log.txt( LLOG_INFO,
+			"ww : timer thread is falling behind, max lag %li usecs\n",
+			stats.lag_max );
+
+	lag_max = stats.lag_max;
+
+	return true;
+}
+
 void _IKED::set_files( char * set_path_conf, const char * set_path_log )
 {
 	strcpy_s( path_conf, MAX_PATH, set_path_conf );
@@ -102,14 +134,38 @@ _IKED::_IKED()
 	retry_count = 2;
 	retry_delay = 5;
 
+	ike_workers = 0;
+	ith_ikew = NULL;
+
+	timer_workers = 0;
+	dh_pool_depth = 0;
+
+	xauth_workers = 0;
+	ith_xauth = NULL;
+	idle_xauth = 0;
+	wake_xauth = false;
+	stop_xauth = false;
+
 	sock_ike_open = 0;
 	sock_natt_open = 0;
 
+#ifdef __linux__
+
+	poll_socket = -1;
+
+#endif
+
 	rand_bytes( &ident, 2 );
 
 	lock_run.name( "run" );
 	lock_net.name( "net" );
 	lock_idb.name( "idb" );
+	lock_cert.name( "cert" );
+	lock_xauth.name( "xauth" );
+	cond_xauth.name( "xauth" );
+
+	cert_generation = 0;
+	memset( cert_cache, 0, sizeof( cert_cache ) );
 
 	cond_run.alert();
 	cond_idb.alert();
@@ -341,7 +397,11 @@ long _IKED::init( long setlevel )
 	// initialize our socket interface
 	//
 
-	socket_init();
+	if( socket_init() != LIBIKE_OK )
+	{
+		log.txt( LLOG_ERROR, "!! : failed to initialize socket interface\n" );
+		return LIBIKE_FAILED;
+	}
 
 	//
 	// setup natt port on OSX systems
@@ -411,6 +471,48 @@ long _IKED::init( long setlevel )
 
 void _IKED::loop()
 {
+	//
+	// start our log writer thread
+	//
+
+	if( !log.run() )
+		log.txt( LLOG_ERROR, "!! : unable to start log writer thread\n" );
+
+	//
+	// start our ike worker threads
+	//
+
+	if( ike_workers )
+	{
+		ith_ikew = new ITH_IKEW[ ike_workers ];
+		if( ith_ikew == NULL )
+			ike_workers = 0;
+
+		for( long index = 0; index < ike_workers; index++ )
+			ith_ikew[ index ].exec( &ith_ikew[ index ] );
+	}
+
+	//
+	// start our xauth worker threads
+	//
+
+	if( xauth_workers )
+	{
+		ith_xauth = new ITH_XAUTH[ xauth_workers ];
+		if( ith_xauth == NULL )
+			xauth_workers = 0;
+
+		for( long index = 0; index < xauth_workers; index++ )
+			ith_xauth[ index ].exec( this );
+	}
+
+	//
+	// start our dh key pool thread
+	//
+
+	if( !dh_pool.init( dh_pool_depth ) )
+		log.txt( LLOG_ERROR, "!! : unable to start dh key pool thread\n" );
+
 	//
 	// start our ike network thread
 	//
@@ -429,11 +531,19 @@ void _IKED::loop()
 
 	ith_ikes.exec( this );
 
+	//
+	// schedule our timer lag report
+	//
+
+	event_lag.lag_max = 0;
+	event_lag.delay = IKED_LAG_DELAY;
+	ith_timer.add( &event_lag );
+
 	//
 	// enter event timer loop
 	//
 
-	ith_timer.run();
+	ith_timer.run( timer_workers );
 
 	//
 	// wait for all threads to exit
@@ -445,6 +555,74 @@ void _IKED::loop()
 	// cleanup
 	//
 
+	if( ith_ikew != NULL )
+		delete [] ith_ikew;
+
+	if( ith_xauth != NULL )
+		delete [] ith_xauth;
+
+	//
+	// report our xauth source latency
+	//
+
+	xauth_local.hist_log();
+
+#ifdef OPT_LDAP
+
+	xauth_ldap.hist_log();
+
+#endif
+
+	//
+	// report our address pool usage
+	//
+
+	POOL4_STATS pool4_stats;
+	xconf_local.pool4_stats( pool4_stats );
+
+	if( pool4_stats.leases || pool4_stats.failed )
+		log.txt( LLOG_INFO,
+			"ii : %s address pool, %li of %li in use, %li peak, "
+			"%lu leases, %lu renewed, %lu exhausted\n",
+			xconf_local.name(),
+			pool4_stats.inuse,
+			pool4_stats.total,
+			pool4_stats.peak,
+			pool4_stats.leases,
+			pool4_stats.renewed,
+			pool4_stats.failed );
+
+	//
+	// report our dh key pool usage
+	//
+
+	long dh_group;
+	unsigned long dh_hits;
+	unsigned long dh_misses;
+
+	for( long index = 0; dh_pool.stats( index, dh_group, dh_hits, dh_misses ); index++ )
+		if( dh_hits || dh_misses )
+			log.txt( LLOG_INFO,
+				"ii : dh group %li key pool, %lu hits, %lu misses\n",
+				dh_group,
+				dh_hits,
+				dh_misses );
+
+	dh_pool.done();
+
+	//
+	// report our packet buffer pool usage
+	//
+
+	PACKET_POOL_STATS packet_stats;
+	PACKET::pool_stats( packet_stats );
+
+	log.txt( LLOG_INFO,
+		"ii : packet buffer pool, %li cached, %lu hits, %lu misses\n",
+		packet_stats.cached,
+		packet_stats.hits,
+		packet_stats.misses );
+
 	socket_done();
 	ikes.done();
 	log.close();
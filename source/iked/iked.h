@@ -64,6 +64,7 @@
 #  include <linux/if.h>
 #  include <linux/if_tun.h>
 #  include <linux/if_ether.h>
+#  include <sys/epoll.h>
 # else
 #  include <signal.h>
 #  include <pwd.h>
@@ -94,6 +95,7 @@
 
 #ifdef OPT_LDAP
 # include <ldap.h>
+# include "ldap.pool.h"
 #endif
 
 #include "version.h"
@@ -264,6 +266,7 @@ namespace yy{ class conf_parser; };
 #define CSTATE_SENT_XCONF		0x00000080
 #define CSTATE_RECV_ACK			0x00000100
 #define CSTATE_SENT_ACK			0x00000200
+#define CSTATE_WAIT_XRSLT		0x00000400
 #define CSTATE_USE_PASSCODE		0x80000000
 
 #define LSTATE_CHKPROP			0x00000001		// proposal verified
@@ -326,12 +329,121 @@ typedef class _ITH_PFKEY : public _IKED_EXEC
 
 }ITH_PFKEY;
 
+//
+// received ike packets are queued to a worker
+// selected by the initiator cookie so that all
+// packets for a given phase1 sa are processed
+// in order by the same thread
+//
+
+#define IKED_WORKERS_MAX	64
+#define IKED_RECV_BATCH		32
+#define IKED_SEND_BATCH		32
+
+typedef class _IKED_RECV
+{
+	public:
+
+	PACKET_IKE	packet;
+	IKE_SADDR	saddr_src;
+	IKE_SADDR	saddr_dst;
+	bool		encap;
+
+	_IKED_RECV *	next;	// worker queue link
+
+}IKED_RECV;
+
+typedef class _ITH_IKEW : public _IKED_EXEC
+{
+	virtual long iked_func( void * arg );
+
+	public:
+
+	ITH_LOCK	lock;
+	ITH_COND	cond;
+	IKED_RECV *	head;		// pending packet queue
+	IKED_RECV *	tail;
+	bool		stop;
+
+	_ITH_IKEW();
+
+}ITH_IKEW;
+
+//
+// the execution timer lag is reported once
+// every minute. a warning is logged if the
+// timer fell behind by more than a second
+//
+
+#define IKED_LAG_DELAY		60000
+#define IKED_LAG_WARN		1000000
+
+typedef class _ITH_EVENT_TIMERLAG : public ITH_EVENT
+{
+	public:
+
+	long	lag_max;
+
+	bool	func();
+
+}ITH_EVENT_TIMERLAG;
+
+//
+// successful certificate verifications are
+// cached by a hash of the peer certificates.
+// an entry is only valid for the store that
+// verified it and expires before any ca or
+// crl used to verify it goes stale
+//
+
+#define IKED_CERT_CACHE_SIZE	256
+#define IKED_CERT_CACHE_LIFE	300
+#define IKED_CERT_CHECK_DELAY	30
+
+typedef struct _IKED_CERT_CACHE
+{
+	unsigned char	hash[ SHA_DIGEST_LENGTH ];
+	long			generation;
+	time_t			expire;
+
+}IKED_CERT_CACHE;
+
+//
+// xauth requests are handed to a shared pool
+// of auth worker threads so a slow source will
+// not stall packet processing. once a request
+// has been handled, the worker resumes the
+// config exchange by sending the result
+//
+
+typedef class _IKED_XAUTH_RQST : public IDB_ENTRY
+{
+	public:
+
+	IDB_CFG *		cfg;
+	IDB_PH1 *		ph1;
+
+	IKED_XAUTH *	source;
+	IKE_XAUTH		xauth;
+	BDATA			group;
+
+}IKED_XAUTH_RQST;
+
+typedef class _ITH_XAUTH : public _IKED_EXEC
+{
+	virtual long iked_func( void * arg );
+
+}ITH_XAUTH;
+
 typedef class _IKED
 {
 	friend class _ITH_IKES;
 	friend class _ITH_IKEC;
 	friend class _ITH_NWORK;
 	friend class _ITH_PFKEY;
+	friend class _ITH_IKEW;
+	friend class _ITH_XAUTH;
+	friend class _ITH_EVENT_TIMERLAG;
 
 	friend class _IDB_PEER;
 	friend class _IDB_TUNNEL;
@@ -398,6 +510,10 @@ typedef class _IKED
 
 	long	retry_count;		// packet retry count
 	long	retry_delay;		// packet retry delay
+	long	ike_workers;		// packet worker count
+	long	timer_workers;		// timer worker count
+	long	dh_pool_depth;		// dh key pool depth
+	long	xauth_workers;		// xauth worker count
 
 	PFKI		pfki;			// pfkey interface
 	IKES		ikes;			// ike service interface
@@ -408,8 +524,13 @@ typedef class _IKED
 	ITH_IKEC	ith_ikec;		// client ipc thread
 	ITH_NWORK	ith_nwork;		// network thread
 	ITH_PFKEY	ith_pfkey;		// pfkey thread
+	ITH_IKEW *	ith_ikew;		// packet worker threads
+	ITH_XAUTH *	ith_xauth;		// xauth worker threads
 
 	ITH_TIMER	ith_timer;		// execution timer
+	DH_POOL		dh_pool;		// dh key pool
+
+	ITH_EVENT_TIMERLAG	event_lag;	// timer lag report
 
 	short	ident;				// ip identity
 
@@ -419,12 +540,29 @@ typedef class _IKED
 	ITH_LOCK	lock_run;
 	ITH_LOCK	lock_net;
 	ITH_LOCK	lock_idb;
+	ITH_LOCK	lock_cert;
+	ITH_LOCK	lock_xauth;
+
+	ITH_COND	cond_xauth;			// xauth request condition
+	IDB_LIST	list_xauth;			// xauth request queue
+	long		idle_xauth;			// xauth workers waiting
+	bool		wake_xauth;			// xauth alert pending
+	bool		stop_xauth;			// xauth worker stop flag
+
+	volatile long	cert_generation;	// next cert store generation
+	IKED_CERT_CACHE	cert_cache[ IKED_CERT_CACHE_SIZE ];
 
 #ifdef UNIX
 
 	IDB_LIST	list_socket;		// socket list
 	int			wake_socket[2];		// wakeup socket
 
+#ifdef __linux__
+
+	int			poll_socket;		// socket event poll
+
+#endif
+
 #endif
 
 	IDB_LIST			idb_list_netgrp;
@@ -507,8 +645,19 @@ typedef class _IKED
 #endif
 
 	long	header( PACKET_IP & packet, ETH_HEADER & ethhdr );
-	long	recv_ip( PACKET_IP & packet, ETH_HEADER * ethhdr = NULL );
+	long	recv_ike( IKED_RECV ** recv_list, long & recv_count );
+
+#ifdef UNIX
+
+	void	recv_ike_prep( SOCK_INFO * sock_info, IKED_RECV * recv, msghdr & msg, iovec * iov, uint32_t * marker, unsigned char * ctrl, long ctrl_size );
+	void	recv_ike_done( SOCK_INFO * sock_info, IKED_RECV * recv, msghdr & msg, uint32_t marker, long size );
+
+	SOCK_INFO *	socket_lookup_sock( IKE_SADDR & saddr_l );
+	bool		send_ip_read( PACKET_IP & packet, IKE_SADDR & saddr_src, IKE_SADDR & saddr_dst );
+
+#endif
 	long	send_ip( PACKET_IP & packet, ETH_HEADER * ethhdr = NULL );
+	long	send_ip( IPQUEUE & queue, ETH_HEADER * ethhdr = NULL );
 
 	bool	vnet_init();
 	bool	vnet_get( VNET_ADAPTER ** adapter );
@@ -560,13 +709,22 @@ typedef class _IKED
 	bool	cert_subj( BDATA & cert, BDATA & subj );
 	bool	asn1_text( BDATA & asn1, BDATA & text );
 	bool	text_asn1( BDATA & text, BDATA & asn1 );
-	bool	cert_verify( IDB_LIST_CERT & certs, BDATA & ca, BDATA & cert );
+	bool	cert_verify( IDB_LIST_CERT & certs, IDB_PEER * peer, BDATA & cert );
+
+	IKED_CERT_STORE *	cert_store_new( BDATA & ca );
+	IKED_CERT_STORE *	cert_store_get( IDB_PEER * peer );
+	void				cert_store_put( IKED_CERT_STORE * store );
+
+	void	cert_cache_hash( IDB_LIST_CERT & certs, unsigned char * hash );
+	bool	cert_cache_find( unsigned char * hash, long generation );
+	void	cert_cache_add( unsigned char * hash, long generation, time_t expire );
 
 	long	prvkey_rsa_load( BDATA & prvkey, char * fpath, BDATA & pass );
 	long	prvkey_rsa_load( BDATA & prvkey, BDATA & input, BDATA & pass );
-	bool	pubkey_rsa_read( BDATA & cert, BDATA & pubkey );
-	bool	prvkey_rsa_encrypt( BDATA & prvkey, BDATA & hash, BDATA & sign );
-	bool	pubkey_rsa_decrypt( BDATA & pubkey, BDATA & sign, BDATA & hash );
+	RSA *	prvkey_rsa_get( IDB_PEER * peer );
+	RSA *	pubkey_rsa_get( IDB_PEER * peer, BDATA & cert );
+	bool	prvkey_rsa_encrypt( IDB_PEER * peer, BDATA & hash, BDATA & sign );
+	bool	pubkey_rsa_decrypt( RSA * rsa, BDATA & sign, BDATA & hash );
 
 	// id helper functions
 
@@ -580,7 +738,8 @@ typedef class _IKED
 
 	long	packet_ike_encap( PACKET_IKE & packet_ike, PACKET_IP & packet_ip, IKE_SADDR & src, IKE_SADDR & dst, long natt );
 	long	packet_ike_send( IDB_PH1 * ph1, IDB_XCH * xch, PACKET_IKE & packet, bool retry );
-	long	packet_ike_xmit( IDB_PH1 * ph1, IDB_XCH * xch, PACKET_IKE & packet, bool retry );
+	long	packet_ike_queue( IDB_PH1 * ph1, IDB_XCH * xch, PACKET_IKE & packet );
+	long	packet_ike_xmit( IDB_PH1 * ph1, IDB_XCH * xch );
 	long	packet_ike_encrypt( IDB_PH1 * ph1, PACKET_IKE & packet, BDATA * iv );
 	long	packet_ike_decrypt( IDB_PH1 * ph1, PACKET_IKE & packet, BDATA * iv );
 
@@ -660,6 +819,12 @@ typedef class _IKED
 	long	phase2_gen_keys( IDB_PH1 * ph1, IDB_PH2 * ph2 );
 	long	phase2_gen_keys( IDB_PH1 * ph1, IDB_PH2 * ph2, long dir, IKE_PROPOSAL * proposal, BDATA & shared );
 
+	// xauth helper functions
+
+	bool	xauth_check( IKED_XAUTH * source, IKE_XAUTH & xauth, BDATA & group );
+	void	xauth_queue( IDB_CFG * cfg, IDB_PH1 * ph1 );
+	void	xauth_alert();
+
 	// config exchange helper functions
 
 	bool	config_client_xauth_recv( IDB_CFG * cfg, IDB_PH1 * ph1 );
@@ -671,6 +836,7 @@ typedef class _IKED
 
 	bool	config_server_xauth_recv( IDB_CFG * cfg, IDB_PH1 * ph1 );
 	bool	config_server_xauth_send( IDB_CFG * cfg, IDB_PH1 * ph1 );
+	void	config_server_xauth_rslt( IDB_CFG * cfg, IDB_PH1 * ph1, bool allow );
 	bool	config_server_xconf_pull_recv( IDB_CFG * cfg, IDB_PH1 * ph1 );
 	bool	config_server_xconf_pull_send( IDB_CFG * cfg, IDB_PH1 * ph1 );
 	bool	config_server_xconf_push_recv( IDB_CFG * cfg, IDB_PH1 * ph1 );
@@ -754,6 +920,7 @@ typedef class _IKED
 
 	long	process_ike_send();
 	long	process_ike_recv( PACKET_IKE & packet, IKE_SADDR & saddr_src, IKE_SADDR & saddr_dst );
+	void	process_ike_queue( IKED_RECV * recv );
 
 	//
 	// pfkey process handlers
@@ -789,6 +956,8 @@ typedef class _IKED
 	long	loop_ipc_client( IKEI * ikei );
 
 	long	loop_ike_nwork();
+	long	loop_ike_work( ITH_IKEW * worker );
+	long	loop_xauth_work();
 	long	loop_ike_pfkey();
 
 	public:
@@ -820,6 +989,7 @@ bool cmp_ikeaddr( IKE_SADDR & addr1, IKE_SADDR & addr2, bool port );
 
 bool has_sockaddr( sockaddr * saddr1 );
 bool cmp_sockaddr( sockaddr & saddr1, sockaddr & saddr2, bool port );
+uint32_t key_sockaddr( sockaddr & saddr );
 bool cpy_sockaddr( sockaddr & saddr1, sockaddr & saddr2, bool port );
 bool get_sockport( sockaddr & saddr, u_int16_t & port );
 bool set_sockport( sockaddr & saddr, u_int16_t port );
@@ -463,6 +463,27 @@ typedef class _ITH_EVENT_PH2HARD : public ITH_EVENT
 // ike internal data classes
 //
 
+//
+// LOCK ORDERING :
+//
+// iked.lock_idb guards every list, its entry array
+// and hash indexes. It must be held while entries
+// are looked up, added or removed and while an
+// entry end() or destructor runs, since those
+// cascade into other lists. The IKED_RC_LIST lock()
+// and unlock() methods and all lock = true method
+// parameters refer to this lock.
+//
+// Reference counts and entry flags are updated
+// atomically. A reference that is not the last
+// one can be dropped without taking any lock. A
+// count only reaches zero while iked.lock_idb is
+// held so a concurrent find() cannot revive an
+// entry that is being deleted. inc() never locks
+// since the caller must already hold a reference
+// or iked.lock_idb.
+//
+
 class _IKED_RC_LIST;
 
 #define ENTRY_FLAG_DEAD			1
@@ -473,8 +494,8 @@ typedef class _IKED_RC_ENTRY : public IDB_ENTRY
 {
 	protected:
 
-	long		idb_flags;
-	long		idb_refcount;
+	volatile long	idb_flags;
+	volatile long	idb_refcount;
 
 	inline long chkflags( long flags )
 	{
@@ -483,12 +504,22 @@ typedef class _IKED_RC_ENTRY : public IDB_ENTRY
 
 	inline long setflags( long flags )
 	{
-		return idb_flags |= flags;
+		return ith_atomic_or( &idb_flags, flags );
 	}
 
 	inline long clrflags( long flags )
 	{
-		return idb_flags &= ~flags;
+		return ith_atomic_and( &idb_flags, ~flags );
+	}
+
+	inline long refinc()
+	{
+		return ith_atomic_inc( &idb_refcount );
+	}
+
+	inline long refdec()
+	{
+		return ith_atomic_dec( &idb_refcount );
 	}
 
 	void callend();
@@ -505,7 +536,7 @@ typedef class _IKED_RC_ENTRY : public IDB_ENTRY
 	virtual _IKED_RC_LIST *	list() = 0;
 
 	bool add( bool lock );
-	void inc( bool lock );
+	void inc();
 	bool dec( bool lock, bool setdel = false );
 
 }IKED_RC_ENTRY;
@@ -519,11 +550,50 @@ typedef class _IKED_RC_LIST : public IDB_LIST
 
 	virtual	void	clean();
 
+	virtual void	index_add( IKED_RC_ENTRY * entry );
+	virtual void	index_del( IKED_RC_ENTRY * entry );
+
 	bool	lock();
 	bool	unlock();
 
 }IKED_RC_LIST;
 
+//
+// a persistent x.509 store is built from the
+// peer ca data on first use and shared by all
+// certificate verifications for the peer. it
+// is reference counted so it can be replaced
+// while other threads are still using it
+//
+
+typedef class _IKED_CERT_STORE
+{
+	public:
+
+	X509_STORE *	store;			// openssl certificate store
+	long			generation;		// unique store generation
+	volatile long	refcount;		// store reference count
+
+}IKED_CERT_STORE;
+
+//
+// parsed remote peer public keys are cached
+// by a hash of the certificate they came from.
+// the cache is set associative and the least
+// recently used key in a set is replaced
+//
+
+#define IKED_RSA_CACHE_SETS		64
+#define IKED_RSA_CACHE_WAYS		4
+
+typedef struct _IKED_RSA_CACHE
+{
+	unsigned char	hash[ SHA_DIGEST_LENGTH ];	// certificate hash
+	unsigned long	used;						// last use stamp
+	RSA *			rsa;						// public key
+
+}IKED_RSA_CACHE;
+
 typedef class _IDB_PEER : public IKED_RC_ENTRY, public IKE_PEER
 {
 	private:
@@ -541,6 +611,18 @@ typedef class _IDB_PEER : public IKED_RC_ENTRY, public IKE_PEER
 	BDATA		cert_k;
 	BDATA		psk;
 
+	BDATA		cert_r_path;	// ca file path
+	BDATA		cert_r_pass;	// ca file password
+	time_t		cert_r_time;	// ca file modification time
+	time_t		cert_r_check;	// next ca file check time
+
+	ITH_LOCK			cert_lock;
+	IKED_CERT_STORE *	cert_r_store;
+
+	RSA *			cert_k_rsa;		// parsed private key
+	IKED_RSA_CACHE	cert_r_rsa[ IKED_RSA_CACHE_SETS ][ IKED_RSA_CACHE_WAYS ];
+	unsigned long	cert_r_used;	// rsa cache use stamp
+
 	BDATA			xauth_group;
 	IKED_XAUTH *	xauth_source;
 	IKED_XCONF *	xconf_source;
@@ -548,6 +630,10 @@ typedef class _IDB_PEER : public IKED_RC_ENTRY, public IKE_PEER
 	IDB_LIST_PROPOSAL	proposals;
 	IDB_LIST_NETMAP		netmaps;
 
+	uint32_t	idxkey_addr;	// indexed address key
+	bool		idxwild;		// indexed as a wildcard
+	long		idxorder;		// list order when indexed
+
 	virtual	const char *	name();
 	virtual IKED_RC_LIST *	list();
 
@@ -556,10 +642,31 @@ typedef class _IDB_PEER : public IKED_RC_ENTRY, public IKE_PEER
 
 }IDB_PEER;
 
+//
+// peers with an address are indexed by that
+// address. peers without one match any address
+// and are kept in a separate list. a lookup
+// returns whichever match was added first so
+// the result is the same as a list scan
+//
+
 typedef class _IDB_LIST_PEER : public IKED_RC_LIST
 {
+	protected:
+
+	IDB_HASH	hash_addr;		// indexed by address
+	IDB_LIST	list_wild;		// peers without an address
+	long		next_order;
+
 	public:
 
+	_IDB_LIST_PEER();
+
+	virtual void	index_add( IKED_RC_ENTRY * entry );
+	virtual void	index_del( IKED_RC_ENTRY * entry );
+
+	void	index_addr( bool lock, IDB_PEER * peer );
+
 	IDB_PEER * get( int index );
 
 	bool find(
@@ -624,6 +731,8 @@ typedef class _IDB_TUNNEL : public IKED_RC_ENTRY
 	ITH_EVENT_TUNNATT	event_natt;
 	ITH_EVENT_TUNSTATS	event_stats;
 
+	uint32_t	idxkey_addr;	// indexed address key
+
 	virtual	const char *	name();
 	virtual IKED_RC_LIST *	list();
 
@@ -635,10 +744,34 @@ typedef class _IDB_TUNNEL : public IKED_RC_ENTRY
 
 }IDB_TUNNEL;
 
+//
+// tunnels are indexed by tunnel id and by the
+// remote address. ports float when nat-t is
+// negotiated so only the address is hashed
+// and ports are compared after the lookup
+//
+
 typedef class _IDB_LIST_TUNNEL : public IKED_RC_LIST
 {
+	protected:
+
+	IDB_HASH	hash_tunnelid;	// indexed by tunnel id
+	IDB_HASH	hash_addr;		// indexed by remote address
+
+	bool	match(
+			IDB_TUNNEL * tunnel,
+			long * tunnelid,
+			IKE_SADDR * saddr,
+			bool port,
+			bool suspended );
+
 	public:
 
+	virtual void	index_add( IKED_RC_ENTRY * entry );
+	virtual void	index_del( IKED_RC_ENTRY * entry );
+
+	void	index_addr( bool lock, IDB_TUNNEL * tunnel );
+
 	IDB_TUNNEL * get( int index );
 
 	bool find(
@@ -658,6 +791,15 @@ typedef class _IDB_POLICY : public IKED_RC_ENTRY, public PFKI_SPINFO
 	IPROUTE_ENTRY	route_entry;
 	long			flags;
 
+	IKE_SADDR	idx_src;		// cached endpoint addresses
+	IKE_SADDR	idx_dst;
+	IKE_PH2ID	idx_ids;		// cached selector ids
+	IKE_PH2ID	idx_idd;
+	bool		idx_ipv4;		// selectors are ipv4 prefixes
+
+	uint32_t	idxkey_plcyid;	// indexed policy id key
+	long		idxorder;		// list order when indexed
+
 	virtual	const char *	name();
 	virtual IKED_RC_LIST *	list();
 
@@ -669,10 +811,74 @@ typedef class _IDB_POLICY : public IKED_RC_ENTRY, public PFKI_SPINFO
 
 }IDB_POLICY;
 
+//
+// ipv4 policy selectors are stored in a binary
+// trie keyed by prefix so a lookup only visits
+// the policies that cover the searched address.
+// each node holds the policies whose selector
+// prefix ends at that node
+//
+
+typedef class _IDB_POLICY_NODE
+{
+	public:
+
+	_IDB_POLICY_NODE *	next[ 2 ];
+	IDB_LIST			policies;
+
+	_IDB_POLICY_NODE();
+	~_IDB_POLICY_NODE();
+
+}IDB_POLICY_NODE;
+
+//
+// policies are hashed by sequence, policy id
+// and type with the direction and type folded
+// into each key. selector searches walk a trie
+// for the destination or source id. a lookup
+// returns whichever match was added first so
+// the result is the same as a list scan
+//
+
 typedef class _IDB_LIST_POLICY : public IKED_RC_LIST
 {
+	protected:
+
+	IDB_HASH		hash_seq;		// indexed by sequence
+	IDB_HASH		hash_plcyid;	// indexed by policy id
+	IDB_HASH		hash_type;		// indexed by direction and type
+
+	IDB_POLICY_NODE	trie_src;		// indexed by source id
+	IDB_POLICY_NODE	trie_dst;		// indexed by destination id
+	IDB_LIST		list_other;		// non ipv4 selectors
+
+	long			next_order;
+
+	uint32_t	key( long dir, u_int16_t type, u_int32_t value );
+
+	void	trie_add( IDB_POLICY_NODE * root, IKE_PH2ID & ph2id, IDB_POLICY * policy );
+	void	trie_del( IDB_POLICY_NODE * root, IKE_PH2ID & ph2id, IDB_POLICY * policy );
+
+	bool	match(
+			IDB_POLICY * policy,
+			long dir,
+			u_int16_t type,
+			u_int32_t * seq,
+			u_int32_t * plcyid,
+			IKE_SADDR * src,
+			IKE_SADDR * dst,
+			IKE_PH2ID * ids,
+			IKE_PH2ID * idd );
+
 	public:
 
+	_IDB_LIST_POLICY();
+
+	virtual void	index_add( IKED_RC_ENTRY * entry );
+	virtual void	index_del( IKED_RC_ENTRY * entry );
+
+	void	index_plcyid( bool lock, IDB_POLICY * policy );
+
 	IDB_POLICY * get( int index );
 
 	bool find(
@@ -711,7 +917,8 @@ typedef class _IDB_XCH : public IKED_RC_ENTRY
 
 	uint32_t	msgid;
 	long		lstate;
-	long		xstate;
+
+	volatile long	xstate;
 
 	BDATA		hash_l;
 	BDATA		hash_r;
@@ -748,7 +955,7 @@ typedef class _IDB_XCH_SA : public IDB_XCH
 {
 	public:
 
-	DH *		dh;
+	DH_KEY *	dh;
 	long		dh_size;
 
 	BDATA		xl;
@@ -812,6 +1019,18 @@ typedef class _IDB_PH1 : public IDB_XCH_SA
 	BDATA	skeyid_a;
 	BDATA	skeyid_e;
 
+	//
+	// keyed cipher and hmac templates are set
+	// up once the key material is computed and
+	// copied for each message
+	//
+
+	EVP_CIPHER_CTX	ctx_encrypt;
+	EVP_CIPHER_CTX	ctx_decrypt;
+	HMAC_CTX		ctx_prf_a;
+	HMAC_CTX		ctx_prf_d;
+	bool			ctx_keyed;
+
 	ITH_EVENT_PH1SOFT	event_soft;
 	ITH_EVENT_PH1HARD	event_hard;
 	ITH_EVENT_PH1DEAD	event_dead;
@@ -828,6 +1047,11 @@ typedef class _IDB_PH1 : public IDB_XCH_SA
 
 	bool	setup_dhgrp( IKE_PROPOSAL * proposal );
 	bool	setup_xform( IKE_PROPOSAL * proposal );
+	bool	setup_ctx();
+
+	void	cipher_init( EVP_CIPHER_CTX * ctx, BDATA * iv, int encrypt );
+	void	hmac_init_a( HMAC_CTX * ctx );
+	void	hmac_init_d( HMAC_CTX * ctx );
 
 	void	clean();
 
@@ -842,8 +1066,23 @@ typedef class _IDB_PH1 : public IDB_XCH_SA
 
 typedef class _IDB_LIST_PH1 : public IKED_RC_LIST
 {
+	protected:
+
+	IDB_HASH	hash_cookies;	// indexed by initiator cookie
+	IDB_HASH	hash_tunnel;	// indexed by tunnel
+
+	bool	match(
+			IDB_PH1 * ph1,
+			IDB_TUNNEL * tunnel,
+			XCH_STATUS min,
+			XCH_STATUS max,
+			IKE_COOKIES * cookies );
+
 	public:
 
+	virtual void	index_add( IKED_RC_ENTRY * entry );
+	virtual void	index_del( IKED_RC_ENTRY * entry );
+
 	IDB_PH1 * get( int index );
 
 	bool find(
@@ -882,6 +1121,9 @@ typedef class _IDB_PH2 : public IDB_XCH_SA
 	ITH_EVENT_PH2SOFT	event_soft;
 	ITH_EVENT_PH2HARD	event_hard;
 
+	BDATA		idxkey_spi_l;	// indexed local spi keys
+	BDATA		idxkey_spi_r;	// indexed remote spi keys
+
 	// sub class functions
 
 	virtual	const char *	name();
@@ -904,8 +1146,34 @@ typedef class _IDB_PH2 : public IDB_XCH_SA
 
 typedef class _IDB_LIST_PH2 : public IKED_RC_LIST
 {
+	protected:
+
+	IDB_HASH	hash_tunnel;	// indexed by tunnel
+	IDB_HASH	hash_seqid;		// indexed by inbound and outbound seqid
+	IDB_HASH	hash_msgid;		// indexed by message id
+	IDB_HASH	hash_spi_l;		// indexed by local spi
+	IDB_HASH	hash_spi_r;		// indexed by remote spi
+
+	void	spi_add( IDB_HASH & hash, BDATA & keys, IDB_LIST_PROPOSAL & plist, IDB_PH2 * ph2 );
+	void	spi_del( IDB_HASH & hash, BDATA & keys, IDB_PH2 * ph2 );
+
+	bool	match(
+			IDB_PH2 * ph2,
+			IDB_TUNNEL * tunnel,
+			XCH_STATUS min,
+			XCH_STATUS max,
+			u_int32_t * seqid,
+			uint32_t * msgid,
+			IKE_SPI * spi_l,
+			IKE_SPI * spi_r );
+
 	public:
 
+	virtual void	index_add( IKED_RC_ENTRY * entry );
+	virtual void	index_del( IKED_RC_ENTRY * entry );
+
+	void	index_spi( bool lock, IDB_PH2 * ph2 );
+
 	IDB_PH2	* get( int index );
 
 	bool find(
@@ -0,0 +1,228 @@
+
+/*
+ * Copyright (c) 2007
+ *      Shrew Soft Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Redistributions in any form must be accompanied by information on
+ *    how to obtain complete source code for the software and any
+ *    accompanying software that uses the software.  The source code
+ *    must either be included in the distribution or be available for no
+ *    more than the cost of distribution plus a nominal fee, and must be
+ *    freely redistributable under reasonable conditions.  For an
+ *    executable file, complete source code means the source code for all
+ *    modules it contains.  It does not include source code for modules or
+ *    files that typically accompany the major components of the operating
+ *    system on which the executable file runs.
+ *
+ * THIS SOFTWARE IS PROVIDED BY SHREW SOFT INC ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, OR
+ * NON-INFRINGEMENT, ARE DISCLAIMED.  IN NO EVENT SHALL SHREW SOFT INC
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * AUTHOR : Matthew Grooms
+ *          mgrooms@shrew.net
+ *
+ */
+
+#ifdef OPT_LDAP
+
+#include <string.h>
+#include "ldap.pool.h"
+
+//
+// a pooled connection may have been closed
+// by the server while it sat idle. these
+// errors cause the request to be retried
+// using a new connection
+//
+
+bool ldap_conn_lost( int res )
+{
+	return ( res == LDAP_SERVER_DOWN ) || ( res == LDAP_CONNECT_ERROR );
+}
+
+_IKED_LDAP_POOL::_IKED_LDAP_POOL()
+{
+	conn_max = 4;
+	conn_count = 0;
+
+	conn_lock.name( "ldap pool" );
+}
+
+_IKED_LDAP_POOL::~_IKED_LDAP_POOL()
+{
+	drop_conns();
+}
+
+bool _IKED_LDAP_POOL::get_conn( LDAP ** ld, bool & pooled )
+{
+	time_t now = time( NULL );
+
+	while( true )
+	{
+		//
+		// take the most recently released
+		// connection from the pool
+		//
+
+		conn_lock.lock();
+
+		IKED_LDAP_CONN conn;
+		bool found = false;
+
+		if( conn_count )
+		{
+			conn = conn_list[ --conn_count ];
+			found = true;
+		}
+
+		conn_lock.unlock();
+
+		if( !found )
+			break;
+
+		//
+		// close connections that have sat idle
+		// for too long and rebind connections
+		// that were used to check credentials
+		//
+
+		if( ( now - conn.used ) > LDAP_CONN_IDLE )
+		{
+			ldap_unbind_ext_s( conn.ld, NULL, NULL );
+			continue;
+		}
+
+		if( conn.rebind && !bind_conn( conn.ld ) )
+		{
+			ldap_unbind_ext_s( conn.ld, NULL, NULL );
+			continue;
+		}
+
+		*ld = conn.ld;
+		pooled = true;
+
+		return true;
+	}
+
+	//
+	// open a new connection
+	//
+
+	pooled = false;
+
+	return open_conn( ld );
+}
+
+void _IKED_LDAP_POOL::put_conn( LDAP * ld, bool rebind, bool valid )
+{
+	if( valid )
+	{
+		conn_lock.lock();
+
+		if( ( conn_count < conn_max ) && ( conn_count < LDAP_CONN_MAX ) )
+		{
+			conn_list[ conn_count ].ld = ld;
+			conn_list[ conn_count ].used = time( NULL );
+			conn_list[ conn_count ].rebind = rebind;
+			conn_count++;
+
+			ld = NULL;
+		}
+
+		conn_lock.unlock();
+	}
+
+	if( ld != NULL )
+		ldap_unbind_ext_s( ld, NULL, NULL );
+}
+
+void _IKED_LDAP_POOL::drop_conns()
+{
+	//
+	// empty the pool and close the
+	// connections without holding
+	// the pool lock
+	//
+
+	IKED_LDAP_CONN list[ LDAP_CONN_MAX ];
+
+	conn_lock.lock();
+
+	long count = conn_count;
+	memcpy( list, conn_list, sizeof( IKED_LDAP_CONN ) * count );
+	conn_count = 0;
+
+	conn_lock.unlock();
+
+	for( long index = 0; index < count; index++ )
+		ldap_unbind_ext_s( list[ index ].ld, NULL, NULL );
+}
+
+bool _IKED_LDAP_POOL::search( LDAP ** ld, int & res, char * base, int scope, char * filter, char ** atlist, int sizelimit, LDAPMessage ** lr )
+{
+	struct timeval timeout;
+	timeout.tv_sec = LDAP_SEARCH_SECS;
+	timeout.tv_usec = 0;
+
+	for( long attempt = 0; ; attempt++ )
+	{
+		// obtain an ldap connection
+
+		bool pooled;
+		if( !get_conn( ld, pooled ) )
+			return false;
+
+		res = ldap_search_ext_s( *ld,
+					base,
+					scope,
+					filter,
+					atlist,
+					0,
+					NULL,
+					NULL,
+					&timeout,
+					sizelimit,
+					lr );
+
+		if( !pooled || !ldap_conn_lost( res ) || attempt )
+			break;
+
+		//
+		// the server has gone away, so the
+		// other pooled connections are dead
+		// too. close them all and retry using
+		// a new connection
+		//
+
+		if( *lr != NULL )
+		{
+			ldap_msgfree( *lr );
+			*lr = NULL;
+		}
+
+		put_conn( *ld, false, false );
+		*ld = NULL;
+
+		drop_conns();
+	}
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,101 @@
+
+/*
+ * Copyright (c) 2007
+ *      Shrew Soft Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Redistributions in any form must be accompanied by information on
+ *    how to obtain complete source code for the software and any
+ *    accompanying software that uses the software.  The source code
+ *    must either be included in the distribution or be available for no
+ *    more than the cost of distribution plus a nominal fee, and must be
+ *    freely redistributable under reasonable conditions.  For an
+ *    executable file, complete source code means the source code for all
+ *    modules it contains.  It does not include source code for modules or
+ *    files that typically accompany the major components of the operating
+ *    system on which the executable file runs.
+ *
+ * THIS SOFTWARE IS PROVIDED BY SHREW SOFT INC ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, OR
+ * NON-INFRINGEMENT, ARE DISCLAIMED.  IN NO EVENT SHALL SHREW SOFT INC
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * AUTHOR : Matthew Grooms
+ *          mgrooms@shrew.net
+ *
+ */
+
+#ifndef _LDAP_POOL_H_
+#define _LDAP_POOL_H_
+
+#include <time.h>
+#include <ldap.h>
+#include "libith.h"
+
+//
+// ldap connections are kept in a pool once
+// they have been bound using the search dn.
+// a connection used to check user credentials
+// is bound again before it is reused. pooled
+// connections are closed after sitting idle.
+// when a pooled connection finds the server
+// has gone away, every pooled connection is
+// closed before the search is retried
+//
+
+#define LDAP_CONN_MAX		16
+#define LDAP_CONN_IDLE		60
+#define LDAP_SEARCH_SECS	15
+
+typedef struct _IKED_LDAP_CONN
+{
+	LDAP *	ld;
+	time_t	used;		// time last released
+	bool	rebind;		// bound as a user
+
+}IKED_LDAP_CONN;
+
+typedef class _IKED_LDAP_POOL
+{
+	protected:
+
+	ITH_LOCK		conn_lock;
+
+	IKED_LDAP_CONN	conn_list[ LDAP_CONN_MAX ];
+	long			conn_count;
+
+	virtual bool	open_conn( LDAP ** ld ) = 0;
+	virtual bool	bind_conn( LDAP * ld ) = 0;
+
+	bool	get_conn( LDAP ** ld, bool & pooled );
+	void	put_conn( LDAP * ld, bool rebind, bool valid );
+	void	drop_conns();
+
+	bool	search( LDAP ** ld, int & res, char * base, int scope, char * filter, char ** atlist, int sizelimit, LDAPMessage ** lr );
+
+	public:
+
+	long	conn_max;
+
+	_IKED_LDAP_POOL();
+	virtual ~_IKED_LDAP_POOL();
+
+}IKED_LDAP_POOL;
+
+bool ldap_conn_lost( int res );
+
+#endif
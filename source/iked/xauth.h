@@ -42,13 +42,31 @@
 //
 // XAUTH abstract class
 //
+// when xauth requests are handled by the auth
+// worker threads, no more than conc_max of them
+// are passed to a single source at once. each
+// source records the time taken to handle its
+// requests in a histogram of power of two msec
+// buckets, the last bucket being open ended
+//
+
+#define XAUTH_HIST_SIZE		16
 
 typedef class _IKED_XAUTH
 {
 	public:
 
+	long			conc_max;		// concurrent request limit
+	long			conc_cur;		// concurrent request count
+
+	unsigned long	hist[ XAUTH_HIST_SIZE ];	// request latency histogram
+
+	_IKED_XAUTH();
 	virtual ~_IKED_XAUTH();
 
+	void	hist_add( long msecs );
+	void	hist_log();
+
 	virtual const char * name() = 0;
 
 	virtual bool	auth_pwd( IKE_XAUTH & xauth ) = 0;
@@ -76,11 +94,40 @@ typedef class _IKED_XAUTH_LOCAL : public _IKED_XAUTH
 
 #ifdef OPT_LDAP
 
-typedef class _IKED_XAUTH_LDAP : public _IKED_XAUTH
+//
+// the groups a user dn is a member of are
+// read with a single search and cached so
+// that each group check does not require
+// another server round trip
+//
+
+#define LDAP_CACHE_MAX		256
+#define LDAP_CACHE_LIFE		60
+
+typedef class _IKED_LDAP_GROUPS : public IDB_ENTRY
+{
+	public:
+
+	BDATA	userdn;
+	BDATA	groups;		// null separated group names
+	time_t	expire;
+
+}IKED_LDAP_GROUPS;
+
+typedef class _IKED_XAUTH_LDAP : public _IKED_XAUTH, public _IKED_LDAP_POOL
 {
 	protected:
 
-	bool	open_conn( LDAP ** ld );
+	ITH_LOCK		lock;
+
+	IDB_LIST		cache_list;
+
+	virtual bool	open_conn( LDAP ** ld );
+	virtual bool	bind_conn( LDAP * ld );
+
+	bool	find_groups( BDATA & userdn, BDATA & groups );
+	bool	cache_get( BDATA & userdn, BDATA & groups );
+	void	cache_add( BDATA & userdn, BDATA & groups );
 
 	public:
 
@@ -93,6 +140,7 @@ typedef class _IKED_XAUTH_LDAP : public _IKED_XAUTH
 	BDATA	attr_user;
 	BDATA	attr_group;
 	BDATA	attr_member;
+	long	cache_life;
 
 	_IKED_XAUTH_LDAP();
 	virtual ~_IKED_XAUTH_LDAP();
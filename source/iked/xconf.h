@@ -42,16 +42,52 @@
 //
 // XCONF abstract class
 //
+// free address pool entries are kept on a
+// doubly linked list. released addresses are
+// appended to the tail and remember the xauth
+// user they were last leased to. a user that
+// reconnects is given the same address if it
+// has not been leased to someone else since
+//
+
+#define POOL4_NONE	-1
 
-typedef struct POOL4
+typedef class _POOL4 : public IDB_ENTRY
 {
-	in_addr	addr;
+	public:
+
+	long	prev;		// free list links
+	long	next;
 	bool	used;
+	BDATA	user;		// last lessee
 
 }POOL4;
 
+typedef struct _POOL4_STATS
+{
+	long			total;		// pool size
+	long			inuse;		// current leases
+	long			peak;		// maximum concurrent leases
+	unsigned long	leases;		// leases granted
+	unsigned long	renewed;	// leases of a previous address
+	unsigned long	failed;		// pool exhausted
+
+}POOL4_STATS;
+
 typedef class _IKED_XCONF
 {
+	protected:
+
+	uint32_t	pool4_base;		// first address in host order
+	long		pool4_head;
+	long		pool4_tail;
+	IDB_HASH	pool4_users;	// released entries by lessee
+
+	POOL4_STATS	pool4_stat;
+
+	void	pool4_unlink( long index );
+	void	pool4_append( long index );
+
 	public:
 
 	POOL4 *		pool4_array;
@@ -63,14 +99,16 @@ typedef class _IKED_XCONF
 	IDB_LIST_DOMAIN	domains;
 	BDATA			banner;
 
+	_IKED_XCONF();
 	virtual ~_IKED_XCONF();
 
 	virtual const char * name() = 0;
 	virtual bool	rslt( IDB_TUNNEL * tunnel ) = 0;
 
 	bool	pool4_set( in_addr & base, long bits, long max );
-	bool	pool4_get( in_addr & addr );
+	bool	pool4_get( in_addr & addr, BDATA & user );
 	bool	pool4_rel( in_addr & addr );
+	void	pool4_stats( POOL4_STATS & stats );
 
 }IKED_XCONF;
 
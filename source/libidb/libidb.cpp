@@ -45,9 +45,21 @@
 // basic data class
 //
 
+size_t _BDATA::data_limit = BDATA_LIMIT_SIZE;
+
 _BDATA & _BDATA::operator =( _BDATA & bdata )
 {
-	del();
+	//
+	// keep our existing buffer and only
+	// grow it if the new data won't fit
+	//
+
+	if( &bdata == this )
+		return *this;
+
+	data_size = 0;
+	data_oset = 0;
+
 	set( bdata );
 
 	return *this;
@@ -76,8 +88,12 @@ _BDATA::_BDATA()
 
 _BDATA::_BDATA( _BDATA & bdata )
 {
-	_BDATA();
-	*this = bdata;
+	data_buff = NULL;
+	data_real = 0;
+	data_size = 0;
+	data_oset = 0;
+
+	set( bdata );
 }
 
 _BDATA::~_BDATA()
@@ -85,30 +101,148 @@ _BDATA::~_BDATA()
 	del( true );
 }
 
+#ifdef BDATA_MOVE
+
+_BDATA & _BDATA::operator =( _BDATA && bdata )
+{
+	move( bdata );
+
+	return *this;
+}
+
+_BDATA::_BDATA( _BDATA && bdata )
+{
+	data_buff = NULL;
+	data_real = 0;
+	data_size = 0;
+	data_oset = 0;
+
+	move( bdata );
+}
+
+#endif
+
+size_t _BDATA::limit( size_t new_limit )
+{
+	if( new_limit != ~0 )
+		data_limit = new_limit;
+
+	return data_limit;
+}
+
+unsigned char * _BDATA::buff_alloc( size_t & new_real )
+{
+	return new unsigned char[ new_real ];
+}
+
+void _BDATA::buff_free( unsigned char * buff, size_t real )
+{
+	delete [] buff;
+}
+
+bool _BDATA::alloc( size_t new_real )
+{
+	//
+	// use the fixed buffer until the data
+	// no longer fits and then move to the
+	// heap
+	//
+
+	if( ( data_buff == NULL ) && ( new_real <= BDATA_FIXED_SIZE ) )
+	{
+		data_buff = data_fixed;
+		data_real = BDATA_FIXED_SIZE;
+
+		return true;
+	}
+
+	unsigned char * new_buff = buff_alloc( new_real );
+	if( new_buff == NULL )
+		return false;
+
+	if( data_buff != NULL )
+	{
+		memcpy( new_buff, data_buff, data_real );
+
+		if( data_buff != data_fixed )
+			buff_free( data_buff, data_real );
+	}
+
+	data_buff = new_buff;
+	data_real = new_real;
+
+	return true;
+}
+
 size_t _BDATA::grow( size_t new_real )
 {
-	if( new_real >= ( 1024 * 1024 ) )
+	if( new_real > data_limit )
 		return data_real;
 
 	if( data_real < new_real )
 	{
-		unsigned char * new_buff = new unsigned char[ new_real ];
-		if( new_buff == NULL )
-			return data_real;
+		//
+		// at least double the buffer size
+		// so repeated appends are amortized
+		//
 
-		if( data_buff != NULL )
-		{
-			memcpy( new_buff, data_buff, data_real );
-			delete [] data_buff;
-		}
+		size_t next_real = data_real * 2;
+
+		if( next_real < new_real )
+			next_real = new_real;
 
-		data_buff = new_buff;
-		data_real = new_real;
+		if( next_real > data_limit )
+			next_real = data_limit;
+
+		alloc( next_real );
 	}
 
 	return data_real;
 }
 
+bool _BDATA::reserve( size_t new_real )
+{
+	if( new_real > data_limit )
+		return false;
+
+	if( data_real < new_real )
+		return alloc( new_real );
+
+	return true;
+}
+
+void _BDATA::move( _BDATA & bdata )
+{
+	if( &bdata == this )
+		return;
+
+	del();
+
+	//
+	// a heap buffer is handed over as is
+	// while fixed buffer data is copied
+	//
+
+	if( bdata.data_buff == bdata.data_fixed )
+	{
+		memcpy( data_fixed, bdata.data_fixed, bdata.data_size );
+		data_buff = data_fixed;
+		data_real = BDATA_FIXED_SIZE;
+	}
+	else
+	{
+		data_buff = bdata.data_buff;
+		data_real = bdata.data_real;
+
+		bdata.data_buff = NULL;
+	}
+
+	data_size = bdata.data_size;
+	data_oset = bdata.data_oset;
+
+	bdata.del( true );
+}
+
 size_t _BDATA::size( size_t new_size )
 {
 	if( new_size != ~0 )
@@ -180,7 +314,7 @@ bool _BDATA::hex_encode( bool upper_case )
 		hex_temp.add( temp3, 1 );
 	}
 
-	*this = hex_temp;
+	move( hex_temp );
 
 	return true;
 }
@@ -219,7 +353,7 @@ bool _BDATA::hex_decode()
 
 	hex_temp.size( data_size >> 1 );
 
-	*this = hex_temp;
+	move( hex_temp );
 
 	return true;
 }
@@ -244,7 +378,7 @@ bool _BDATA::base64_encode()
 	b64_temp.size( b64_size + 1 );
 	b64_temp.buff()[ b64_size ] = 0;
 
-	*this = b64_temp;
+	move( b64_temp );
 
 	return true;
 }
@@ -267,7 +401,7 @@ bool _BDATA::base64_decode()
 
 	b64_temp.size( b64_size );
 
-	*this = b64_temp;
+	move( b64_temp );
 
 	return true;
 }
@@ -279,7 +413,7 @@ bool _BDATA::set( _BDATA & bdata, size_t oset )
 
 bool _BDATA::set( int value, size_t size, size_t oset )
 {
-	if( !set( ( void * ) NULL, size ) )
+	if( !set( ( void * ) NULL, size, oset ) )
 		return false;
 
 	memset( data_buff + oset, value, size );
@@ -447,7 +581,8 @@ void _BDATA::del( bool null )
 		if( null )
 			memset( data_buff, 0, data_real );
 
-		delete [] data_buff;
+		if( data_buff != data_fixed )
+			buff_free( data_buff, data_real );
 	}
 
 	data_buff = NULL;
@@ -543,21 +678,44 @@ bool _BDATA::file_save( const char * path )
 
 _IDB_ENTRY::_IDB_ENTRY()
 {
+	idb_list = NULL;
+	idb_index = 0;
+}
+
+_IDB_ENTRY::_IDB_ENTRY( const _IDB_ENTRY & entry )
+{
+	idb_list = NULL;
+	idb_index = 0;
 }
 
 _IDB_ENTRY::~_IDB_ENTRY()
 {
 }
 
+_IDB_ENTRY & _IDB_ENTRY::operator =( const _IDB_ENTRY & entry )
+{
+	// list positions are never copied
+
+	return *this;
+}
+
 _IDB_LIST::_IDB_LIST()
 {
 	entry_list	= NULL;
 	entry_max	= 0;
 	entry_num	= 0;
+	entry_order	= true;
 }
 
 _IDB_LIST::~_IDB_LIST()
 {
+	// release any positions we recorded
+
+	if( !entry_order )
+		for( long index = 0; index < entry_num; index++ )
+			if( entry_list[ index ]->idb_list == this )
+				entry_list[ index ]->idb_list = NULL;
+
 	if( entry_list != NULL )
 		delete [] entry_list;
 
@@ -571,33 +729,40 @@ long _IDB_LIST::count()
 
 void _IDB_LIST::clean()
 {
+	// remove entries from the end of the
+	// list so no pointers need to be moved
+
 	while( count() )
-		delete del_entry( 0 );
+		delete del_entry( count() - 1 );
 }
 
 bool _IDB_LIST::grow()
 {
 	// allocate a new stack of pointers that will
-	// be larger that the last by GROW_SIZE
+	// be twice as large as the last
 
-	IDB_ENTRY ** new_entry_list = new IDB_ENTRY * [ entry_max + GROW_SIZE ];
+	long new_entry_max = entry_max * 2;
+	if( new_entry_max < GROW_SIZE )
+		new_entry_max = GROW_SIZE;
+
+	IDB_ENTRY ** new_entry_list = new IDB_ENTRY * [ new_entry_max ];
 
 	if( new_entry_list == NULL )
 		return false;
 
-	// initialize our new stack of pointers to null and
+	// copy our old pointer stack to our new pointer
+	// stack and initialize the remainder to null
+
+	if( entry_list != NULL )
+		memcpy(
+			new_entry_list,
+			entry_list,
+			entry_max * sizeof( IDB_ENTRY * ) );
 
 	memset(
-		new_entry_list,
+		new_entry_list + entry_max,
 		0,
-		( entry_max + GROW_SIZE ) * sizeof( IDB_ENTRY * ) );
-
-	// copy our old pointer stack to our new pointer stack 
-
-	memcpy(
-		new_entry_list,
-		entry_list,
-		entry_max * sizeof( IDB_ENTRY * ) );
+		( new_entry_max - entry_max ) * sizeof( IDB_ENTRY * ) );
 
 	// free our old pointer stack
 
@@ -610,11 +775,50 @@ bool _IDB_LIST::grow()
 
 	// store our new item_capacity
 
-	entry_max += GROW_SIZE;
+	entry_max = new_entry_max;
 
 	return true;
 }
 
+void _IDB_LIST::del_index( long index )
+{
+	IDB_ENTRY * entry = entry_list[ index ];
+
+	if( entry->idb_list == this )
+		entry->idb_list = NULL;
+
+	if( entry_order )
+	{
+		// copy the trailing pointers in our list
+		// to fill the empty slot
+
+		long trailing_pointers = entry_num - index - 1;
+		if( trailing_pointers )
+			memmove(
+				&entry_list[ index ],
+				&entry_list[ index + 1 ],
+				trailing_pointers * sizeof( IDB_ENTRY * ) );
+	}
+	else
+	{
+		// move the last pointer in our list
+		// into the empty slot
+
+		IDB_ENTRY * last = entry_list[ entry_num - 1 ];
+
+		entry_list[ index ] = last;
+
+		if( last->idb_list == this )
+			last->idb_index = index;
+	}
+
+	// null previously last used pointer in
+	// list and decrement count
+
+	entry_list[ entry_num - 1 ] = 0;
+	entry_num--;
+}
+
 bool _IDB_LIST::add_entry( IDB_ENTRY * entry )
 {
 	// sanity check for valid pointer
@@ -629,6 +833,17 @@ bool _IDB_LIST::add_entry( IDB_ENTRY * entry )
 		if( !grow() )
 			return false;
 
+	// an unordered list records the entry
+	// position so it can be removed without
+	// searching. an entry can only record
+	// its position in one list
+
+	if( !entry_order && ( entry->idb_list == NULL ) )
+	{
+		entry->idb_list = this;
+		entry->idb_index = entry_num;
+	}
+
 	// store our new string in the next available
 	// slot in the stack
 
@@ -648,49 +863,39 @@ bool _IDB_LIST::del_entry( IDB_ENTRY * entry )
 	if( entry == NULL )
 		return false;
 
-	// attempt to match our item to an item
-	// in our stack
+	// use the recorded position if we have
+	// one or search our stack for the item
 
 	long index = 0;
-	while( 1 )
+
+	if( ( entry->idb_list == this ) && ( entry_list[ entry->idb_index ] == entry ) )
+		index = entry->idb_index;
+	else
 	{
-		// check for a match
-		
-		if( entry_list[ index ] == entry )
-			break;
-	
+		while( index < entry_num )
+		{
+			if( entry_list[ index ] == entry )
+				break;
+
+			index++;
+		}
+
 		// if we have exausted all pointers in our
 		// stack then return false
-		
-		if( index == ( entry_num - 1 ) )
+
+		if( index == entry_num )
 			return false;
-			
-		index++;		
 	}
-		
-	// copy the trailing pointers in our list
-	// to fill the empty slot
-	
-	int trailing_pointers = entry_num - index - 1;
-	if( trailing_pointers )
-		memmove(
-			&entry_list[ index ],
-			&entry_list[ index + 1 ],
-			trailing_pointers * sizeof( IDB_ENTRY * ) );
-		
-	// null previously last used pointer in
-	// list and decrement count
-	
-	entry_list[ entry_num - 1 ] = 0;
-	entry_num--;
-	
+
+	del_index( index );
+
 	return true;
 }
 
 IDB_ENTRY * _IDB_LIST::del_entry( int index )
 {
 	// sanity check for valid index
-	
+
 	if( ( index >= entry_num ) ||
 		( index < 0 ) )
 		return NULL;
@@ -699,21 +904,7 @@ IDB_ENTRY * _IDB_LIST::del_entry( int index )
 
 	IDB_ENTRY * entry = entry_list[ index ];
 
-	// copy the trailing pointers in our list
-	// to fill the empty slot
-	
-	int trailing_pointers = entry_num - index - 1;
-	if( trailing_pointers )
-		memmove(
-			&entry_list[ index ],
-			&entry_list[ index + 1 ],
-			trailing_pointers * sizeof( IDB_ENTRY * ) );
-		
-	// null previously last used pointer in
-	// list and decrement count
-	
-	entry_list[ entry_num - 1 ] = 0;
-	entry_num--;
+	del_index( index );
 
 	return entry;
 }
@@ -731,3 +922,230 @@ IDB_ENTRY * _IDB_LIST::get_entry( int index )
 	return entry_list[ index ];
 }
 
+
+//==============================================================================
+// hashed IDB index class
+//
+
+_IDB_HASH::_IDB_HASH()
+{
+	node_list	= NULL;
+	node_max	= 0;
+	node_num	= 0;
+}
+
+_IDB_HASH::~_IDB_HASH()
+{
+	clean();
+
+	if( node_list != NULL )
+		delete [] node_list;
+
+	node_list = NULL;
+}
+
+uint32_t _IDB_HASH::hash( const void * buff, size_t size, uint32_t seed )
+{
+	//
+	// fnv-1a hash of the key data
+	//
+
+	const unsigned char * data = ( const unsigned char * ) buff;
+	uint32_t value = seed;
+
+	for( size_t index = 0; index < size; index++ )
+	{
+		value ^= data[ index ];
+		value *= 16777619U;
+	}
+
+	return value;
+}
+
+long _IDB_HASH::count()
+{
+	return node_num;
+}
+
+void _IDB_HASH::clean()
+{
+	//
+	// free all nodes but leave the
+	// bucket array allocated
+	//
+
+	for( long index = 0; index < node_max; index++ )
+	{
+		IDB_HASH_NODE * node = node_list[ index ];
+		while( node != NULL )
+		{
+			IDB_HASH_NODE * next = node->next;
+			delete node;
+			node = next;
+		}
+
+		node_list[ index ] = NULL;
+	}
+
+	node_num = 0;
+}
+
+bool _IDB_HASH::grow()
+{
+	//
+	// allocate a new bucket array that
+	// is twice the size of the last
+	//
+
+	long new_max = node_max * 2;
+	if( new_max < HASH_INIT_SIZE )
+		new_max = HASH_INIT_SIZE;
+
+	IDB_HASH_NODE ** new_node_list = new IDB_HASH_NODE * [ new_max ];
+	IDB_HASH_NODE ** new_node_tail = new IDB_HASH_NODE * [ new_max ];
+
+	if( ( new_node_list == NULL ) || ( new_node_tail == NULL ) )
+	{
+		if( new_node_list != NULL )
+			delete [] new_node_list;
+
+		if( new_node_tail != NULL )
+			delete [] new_node_tail;
+
+		return false;
+	}
+
+	memset( new_node_list, 0, new_max * sizeof( IDB_HASH_NODE * ) );
+	memset( new_node_tail, 0, new_max * sizeof( IDB_HASH_NODE * ) );
+
+	//
+	// move each node into its new bucket. nodes
+	// are appended so that entries sharing a key
+	// keep the order in which they were added
+	//
+
+	for( long index = 0; index < node_max; index++ )
+	{
+		IDB_HASH_NODE * node = node_list[ index ];
+		while( node != NULL )
+		{
+			IDB_HASH_NODE * next = node->next;
+			long bucket = node->key & ( new_max - 1 );
+
+			node->next = NULL;
+
+			if( new_node_tail[ bucket ] == NULL )
+				new_node_list[ bucket ] = node;
+			else
+				new_node_tail[ bucket ]->next = node;
+
+			new_node_tail[ bucket ] = node;
+
+			node = next;
+		}
+	}
+
+	delete [] new_node_tail;
+
+	if( node_list != NULL )
+		delete [] node_list;
+
+	node_list = new_node_list;
+	node_max = new_max;
+
+	return true;
+}
+
+bool _IDB_HASH::add_entry( uint32_t key, IDB_ENTRY * entry )
+{
+	// sanity check for valid pointer
+
+	if( entry == NULL )
+		return false;
+
+	// keep our load factor at or below one
+
+	if( node_num >= node_max )
+		if( !grow() )
+			return false;
+
+	IDB_HASH_NODE * node = new IDB_HASH_NODE;
+	if( node == NULL )
+		return false;
+
+	node->key = key;
+	node->entry = entry;
+	node->next = NULL;
+
+	// append the node to the bucket chain
+
+	IDB_HASH_NODE ** link = &node_list[ key & ( node_max - 1 ) ];
+	while( *link != NULL )
+		link = &( *link )->next;
+
+	*link = node;
+
+	node_num++;
+
+	return true;
+}
+
+bool _IDB_HASH::del_entry( uint32_t key, IDB_ENTRY * entry )
+{
+	if( node_list == NULL )
+		return false;
+
+	// locate the node in the bucket chain
+
+	IDB_HASH_NODE ** link = &node_list[ key & ( node_max - 1 ) ];
+	while( *link != NULL )
+	{
+		IDB_HASH_NODE * node = *link;
+
+		if( node->entry == entry )
+		{
+			*link = node->next;
+			delete node;
+
+			node_num--;
+
+			return true;
+		}
+
+		link = &node->next;
+	}
+
+	return false;
+}
+
+IDB_ENTRY * _IDB_HASH::get_entry( uint32_t key, IDB_HASH_NODE ** node )
+{
+	if( node_list == NULL )
+		return NULL;
+
+	//
+	// a null node starts a new search,
+	// otherwise continue after the node
+	// returned by the previous call
+	//
+
+	IDB_HASH_NODE * next;
+
+	if( *node == NULL )
+		next = node_list[ key & ( node_max - 1 ) ];
+	else
+		next = ( *node )->next;
+
+	for( ; next != NULL; next = next->next )
+	{
+		if( next->key == key )
+		{
+			*node = next;
+			return next->entry;
+		}
+	}
+
+	*node = NULL;
+
+	return NULL;
+}
@@ -43,6 +43,7 @@
 #define _IDB_H_
 
 #include <stdio.h>
+#include <inttypes.h>
 #include "export.h"
 
 //==============================================================================
@@ -51,6 +52,24 @@
 
 #define BDATA_ALL		~0
 
+//
+// small buffers are stored inside the object
+// and larger buffers grow geometrically so a
+// series of appends only copies the data a
+// few times. no buffer may grow beyond the
+// size limit shared by all instances. derived
+// classes may recycle heap buffers but must
+// allocate them with new [] as buffers can be
+// moved to and released by other instances
+//
+
+#define BDATA_FIXED_SIZE	64
+#define BDATA_LIMIT_SIZE	( 1024 * 1024 )
+
+#if ( __cplusplus >= 201103L ) || ( defined( _MSC_VER ) && ( _MSC_VER >= 1600 ) )
+# define BDATA_MOVE
+#endif
+
 typedef class DLX _BDATA
 {
 	protected:
@@ -60,8 +79,16 @@ typedef class DLX _BDATA
 	size_t			data_size;
 	size_t			data_oset;
 
+	unsigned char	data_fixed[ BDATA_FIXED_SIZE ];
+
+	static size_t	data_limit;
+
+	bool			alloc( size_t new_real );
 	size_t			grow( size_t new_size = ~0 );
 
+	virtual unsigned char *	buff_alloc( size_t & new_real );
+	virtual void			buff_free( unsigned char * buff, size_t real );
+
 	public:
 
 	_BDATA &		operator =( _BDATA & bdata );
@@ -72,8 +99,19 @@ typedef class DLX _BDATA
 	_BDATA( _BDATA & bdata );
 	virtual ~_BDATA();
 
+#ifdef BDATA_MOVE
+
+	_BDATA &		operator =( _BDATA && bdata );
+	_BDATA( _BDATA && bdata );
+
+#endif
+
+	static size_t	limit( size_t new_limit = ~0 );
+
 	size_t			oset( size_t new_oset = ~0 );
 	size_t			size( size_t new_size = ~0 );
+	bool			reserve( size_t new_real );
+	void			move( _BDATA & bdata );
 
 	char *			text();
 	unsigned char *	buff();
@@ -119,24 +157,49 @@ typedef class DLX _BDATA
 // standard IDB list classes
 //==============================================================================
 
+class _IDB_LIST;
+
 typedef class DLX _IDB_ENTRY
 {
+	friend class _IDB_LIST;
+
+	private:
+
+	_IDB_LIST *	idb_list;		// list that recorded our position
+	long		idb_index;		// position in that list
+
 	public:
 
 	_IDB_ENTRY();
+	_IDB_ENTRY( const _IDB_ENTRY & entry );
 	virtual ~_IDB_ENTRY();
 
+	_IDB_ENTRY & operator =( const _IDB_ENTRY & entry );
+
 }IDB_ENTRY;
 
+//
+// lists grow geometrically. an ordered list
+// keeps entries in the order they were added.
+// an unordered list fills a removed slot with
+// its last entry and records entry positions
+// so any entry is removed in constant time
+//
+
 #define GROW_SIZE	16
 
 typedef class DLX _IDB_LIST
 {
+	protected:
+
+	void			del_index( long index );
+
 	public:
 
 	IDB_ENTRY **	entry_list;
 	long			entry_max;
 	long			entry_num;
+	bool			entry_order;
 
 	bool			grow();
 
@@ -152,6 +215,47 @@ typedef class DLX _IDB_LIST
 	IDB_ENTRY * get_entry( int index );
 
 }IDB_LIST;
+
+//==============================================================================
+// hashed IDB index class
+//==============================================================================
+
+typedef struct _IDB_HASH_NODE
+{
+	uint32_t				key;
+	IDB_ENTRY *				entry;
+	struct _IDB_HASH_NODE *	next;
+
+}IDB_HASH_NODE;
+
+#define HASH_INIT_SIZE	64
+#define HASH_INIT_SEED	2166136261U
+
+typedef class DLX _IDB_HASH
+{
+	protected:
+
+	IDB_HASH_NODE **	node_list;
+	long				node_max;
+	long				node_num;
+
+	bool			grow();
+
+	public:
+
+	_IDB_HASH();
+	virtual ~_IDB_HASH();
+
+	static uint32_t	hash( const void * buff, size_t size, uint32_t seed = HASH_INIT_SEED );
+
+	long			count();
+	void			clean();
+
+	bool		add_entry( uint32_t key, IDB_ENTRY * entry );
+	bool		del_entry( uint32_t key, IDB_ENTRY * entry );
+	IDB_ENTRY * get_entry( uint32_t key, IDB_HASH_NODE ** node );
+
+}IDB_HASH;
 /*
 //==============================================================================
 // reference counted IDB classes
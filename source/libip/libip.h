@@ -348,10 +348,42 @@ struct pcap_pkthdr {
 // packet classes
 //
 
+//
+// packet buffers up to a typical mtu in size
+// are recycled through a small per thread
+// cache instead of the heap. a buffer may be
+// released by a different thread than the
+// one that allocated it. a thread should call
+// pool_detach before it exits so its cached
+// buffers are freed and its cache can be
+// claimed by another thread
+//
+
+#define PACKET_POOL_SIZE	2048
+#define PACKET_POOL_MAX		64
+
+typedef struct _PACKET_POOL_STATS
+{
+	long			cached;		// buffers cached by all threads
+	unsigned long	hits;		// buffers taken from a cache
+	unsigned long	misses;		// buffers allocated from the heap
+
+}PACKET_POOL_STATS;
+
 typedef class DLX _PACKET : public _BDATA, public IDB_ENTRY
 {
+	protected:
+
+	virtual unsigned char *	buff_alloc( size_t & new_real );
+	virtual void			buff_free( unsigned char * buff, size_t real );
+
 	public:
 
+	virtual ~_PACKET();
+
+	static void	pool_stats( PACKET_POOL_STATS & stats );
+	static void	pool_detach();
+
 	bool	add_byte( uint8_t data );
 	bool	add_word( uint16_t data, bool hton = true );
 	bool	add_quad( uint32_t data, bool hton = true );
@@ -485,9 +517,11 @@ typedef class DLX _IPQUEUE : private IDB_LIST
 	_IPQUEUE();
 	virtual ~_IPQUEUE();
 
-	bool	add( PACKET_IP & packet );
+	bool	add( PACKET_IP & packet, bool move = false );
 	bool	get( PACKET_IP & packet, long index );
 
+	PACKET_IP *	get( long index );
+
 	long	count();
 	void	clean();
 
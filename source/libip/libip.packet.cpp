@@ -40,6 +40,176 @@
  */
 
 #include "libip.h"
+#include "libith.h"
+
+#ifdef WIN32
+# define POOL_TLS __declspec( thread )
+#else
+# define POOL_TLS __thread
+#endif
+
+//
+// each thread owns a cache and its counters
+// so the common paths touch no shared data.
+// caches are only linked into a global list
+// so they can be summed and reused
+//
+
+typedef struct _PACKET_POOL
+{
+	struct _PACKET_POOL *	next;	// pool list link
+
+	volatile long	owned;		// owned by a thread
+	volatile long	count;		// cached buffer count
+	volatile long	hits;
+	volatile long	misses;
+
+	unsigned char *	list[ PACKET_POOL_MAX ];
+
+}PACKET_POOL;
+
+static POOL_TLS PACKET_POOL *	pool_this;
+
+static PACKET_POOL *	pool_head = NULL;
+static ITH_LOCK			pool_lock;
+
+static PACKET_POOL * pool_get()
+{
+	//
+	// use the cache this thread already owns
+	//
+
+	PACKET_POOL * pool = pool_this;
+
+	if( pool != NULL )
+		return pool;
+
+	//
+	// claim a cache released by another thread
+	//
+
+	pool_lock.lock();
+
+	for( pool = pool_head; pool != NULL; pool = pool->next )
+		if( ith_atomic_cas( &pool->owned, 0, 1 ) )
+			break;
+
+	//
+	// or allocate a new cache
+	//
+
+	if( pool == NULL )
+	{
+		pool = new PACKET_POOL;
+		if( pool != NULL )
+		{
+			memset( pool, 0, sizeof( PACKET_POOL ) );
+			pool->owned = 1;
+
+			pool->next = pool_head;
+			pool_head = pool;
+		}
+	}
+
+	pool_lock.unlock();
+
+	pool_this = pool;
+
+	return pool;
+}
+
+_PACKET::~_PACKET()
+{
+	//
+	// release our buffer while the pool
+	// functions can still be called
+	//
+
+	del( true );
+}
+
+unsigned char * _PACKET::buff_alloc( size_t & new_real )
+{
+	if( new_real > PACKET_POOL_SIZE )
+		return _BDATA::buff_alloc( new_real );
+
+	new_real = PACKET_POOL_SIZE;
+
+	PACKET_POOL * pool = pool_get();
+
+	if( pool != NULL )
+	{
+		if( pool->count > 0 )
+		{
+			pool->hits++;
+			return pool->list[ --pool->count ];
+		}
+
+		pool->misses++;
+	}
+
+	return new unsigned char[ PACKET_POOL_SIZE ];
+}
+
+void _PACKET::buff_free( unsigned char * buff, size_t real )
+{
+	//
+	// only pool sized buffers are cached
+	// and the cache size is limited
+	//
+
+	PACKET_POOL * pool = NULL;
+
+	if( real == PACKET_POOL_SIZE )
+		pool = pool_get();
+
+	if( ( pool == NULL ) || ( pool->count >= PACKET_POOL_MAX ) )
+	{
+		_BDATA::buff_free( buff, real );
+		return;
+	}
+
+	pool->list[ pool->count++ ] = buff;
+}
+
+void _PACKET::pool_stats( PACKET_POOL_STATS & stats )
+{
+	stats.cached = 0;
+	stats.hits = 0;
+	stats.misses = 0;
+
+	pool_lock.lock();
+
+	for( PACKET_POOL * pool = pool_head; pool != NULL; pool = pool->next )
+	{
+		stats.cached += pool->count;
+		stats.hits += pool->hits;
+		stats.misses += pool->misses;
+	}
+
+	pool_lock.unlock();
+}
+
+void _PACKET::pool_detach()
+{
+	PACKET_POOL * pool = pool_this;
+
+	if( pool == NULL )
+		return;
+
+	//
+	// free the cached buffers and release
+	// the cache. its counters are kept so
+	// the totals remain accurate
+	//
+
+	while( pool->count > 0 )
+		delete [] pool->list[ --pool->count ];
+
+	ith_atomic_and( &pool->owned, 0 );
+
+	pool_this = NULL;
+}
 
 bool _PACKET::add_byte( uint8_t data )
 {
@@ -50,13 +50,24 @@ _IPQUEUE::~_IPQUEUE()
 	clean();
 }
 
-bool _IPQUEUE::add( PACKET_IP & packet )
+bool _IPQUEUE::add( PACKET_IP & packet, bool move )
 {
 	PACKET_IP * qpacket = new PACKET_IP;
 	if( qpacket == NULL )
 		return false;
 
-	qpacket->add( packet );
+	//
+	// optionally take over the packet
+	// buffer rather than copying it
+	//
+
+	if( move )
+	{
+		qpacket->move( packet );
+		qpacket->oset( 0 );
+	}
+	else
+		qpacket->add( packet );
 
 	if( !add_entry( qpacket ) )
 	{
@@ -78,6 +89,11 @@ bool _IPQUEUE::get( PACKET_IP & packet, long index )
 	return true;
 }
 
+PACKET_IP * _IPQUEUE::get( long index )
+{
+	return static_cast<PACKET_IP*>( get_entry( index ) );
+}
+
 long _IPQUEUE::count()
 {
 	return IDB_LIST::count();
@@ -386,9 +386,146 @@ bool _ITH_EXEC::exec( void * arg )
 // event execution timer classes
 //==============================================================================
 
-_ITH_TIMER::_ITH_TIMER()
+_ITH_EVENT::_ITH_EVENT()
+{
+	heap_order = 0;
+	heap_index = -1;
+	exec_queue = NULL;
+	exec_next = NULL;
+
+	delay = 0;
+	group = NULL;
+}
+
+_ITH_TIMER_EXEC::_ITH_TIMER_EXEC()
 {
+	timer = NULL;
 	head = NULL;
+	tail = NULL;
+	stop = false;
+
+	cond.name( "timer exec" );
+	done.name( "timer exec" );
+}
+
+void _ITH_TIMER_EXEC::queue( ITH_EVENT * event )
+{
+	//
+	// called with the timer lock held. the
+	// executor drains its queue before it
+	// waits so it is only alerted when the
+	// queue was empty
+	//
+
+	event->exec_queue = this;
+	event->exec_next = NULL;
+
+	bool wake = ( head == NULL );
+
+	if( tail == NULL )
+		head = event;
+	else
+		tail->exec_next = event;
+
+	tail = event;
+
+	if( wake )
+		cond.alert();
+}
+
+void _ITH_TIMER_EXEC::unlink( ITH_EVENT * event )
+{
+	//
+	// called with the timer lock held
+	//
+
+	ITH_EVENT * prev = NULL;
+	ITH_EVENT * next = head;
+
+	while( next != NULL && next != event )
+	{
+		prev = next;
+		next = next->exec_next;
+	}
+
+	if( next == NULL )
+		return;
+
+	if( prev == NULL )
+		head = event->exec_next;
+	else
+		prev->exec_next = event->exec_next;
+
+	if( tail == event )
+		tail = prev;
+
+	event->exec_queue = NULL;
+	event->exec_next = NULL;
+}
+
+long _ITH_TIMER_EXEC::func( void * arg )
+{
+	while( true )
+	{
+		timer->lock.lock();
+
+		ITH_EVENT * event = head;
+		if( event != NULL )
+		{
+			head = event->exec_next;
+			if( head == NULL )
+				tail = NULL;
+
+			event->exec_queue = NULL;
+			event->exec_next = NULL;
+		}
+
+		bool halt = stop;
+
+		timer->lock.unlock();
+
+		//
+		// queued events are always run, even
+		// after a stop request, so an event
+		// never loses its execution. we only
+		// wait once the queue is empty since
+		// alerts may be coalesced
+		//
+
+		if( event == NULL )
+		{
+			if( halt )
+				break;
+
+			if( !cond.wait( -1 ) )
+				cond.reset();
+
+			continue;
+		}
+
+		if( event->func() )
+			timer->add( event );
+	}
+
+	done.alert();
+
+	return 0;
+}
+
+_ITH_TIMER::_ITH_TIMER()
+{
+	heap = NULL;
+	heap_max = 0;
+	heap_num = 0;
+	heap_order = 0;
+
+	exec_list = NULL;
+	exec_count = 0;
+
+	stat_events = 0;
+	stat_lag_last = 0;
+	stat_lag_max = 0;
+	stat_lag_total = 0;
 
 	stop = false;
 	exit = false;
@@ -396,33 +533,39 @@ _ITH_TIMER::_ITH_TIMER()
 
 _ITH_TIMER::~_ITH_TIMER()
 {
-	while( head != NULL )
-	{
-		ITH_ENTRY * next = head->next;
-		delete head;
-		head = next;
-	}
+	for( long index = 0; index < heap_num; index++ )
+		heap[ index ]->heap_index = -1;
+
+	if( heap != NULL )
+		delete [] heap;
 }
 
+//
+// timer values are read from a monotonic
+// clock so they are not affected by changes
+// to the system time. the difference of two
+// timer values is expressed in nanoseconds
+//
+
 #ifdef WIN32
 
 void _ITH_TIMER::tval_cur( ITH_TIMEVAL & tval )
 {
-	SYSTEMTIME stime;
-	memset( &stime, 0, sizeof( stime ) );
-	GetSystemTime( &stime );
+	// tval expressed as 100 nanosecond units
 
-	FILETIME ftime;
-	memset( &ftime, 0, sizeof( ftime ) );
-	SystemTimeToFileTime( &stime, &ftime );
+	LARGE_INTEGER freq;
+	LARGE_INTEGER count;
 
-	memcpy( &tval, &ftime, sizeof( tval ) );
+	QueryPerformanceFrequency( &freq );
+	QueryPerformanceCounter( &count );
+
+	tval.QuadPart =
+		( count.QuadPart / freq.QuadPart ) * 10000000 +
+		( count.QuadPart % freq.QuadPart ) * 10000000 / freq.QuadPart;
 }
 
 void _ITH_TIMER::tval_add( ITH_TIMEVAL & tval, long lval )
 {
-	// ftime expressed as 100 nanosecond units
-
 	ITH_TIMEVAL dval;
 	dval.QuadPart = lval;
 	dval.QuadPart *= 10000;
@@ -430,12 +573,9 @@ void _ITH_TIMER::tval_add( ITH_TIMEVAL & tval, long lval )
 	tval.QuadPart += dval.QuadPart;
 }
 
-long _ITH_TIMER::tval_sub( ITH_TIMEVAL & tval1, ITH_TIMEVAL & tval2 )
+long long _ITH_TIMER::tval_sub( ITH_TIMEVAL & tval1, ITH_TIMEVAL & tval2 )
 {
-	ITH_TIMEVAL dval;
-	dval.QuadPart = tval2.QuadPart - tval1.QuadPart;
-
-	return long( dval.QuadPart / 10000 );
+	return ( long long )( tval2.QuadPart - tval1.QuadPart ) * 100;
 }
 
 bool _ITH_TIMER::wait_time( long msecs )
@@ -449,26 +589,44 @@ bool _ITH_TIMER::wait_time( long msecs )
 
 void _ITH_TIMER::tval_cur( ITH_TIMEVAL & tval )
 {
-	gettimeofday( &tval, NULL );
+
+#ifdef CLOCK_MONOTONIC
+
+	clock_gettime( CLOCK_MONOTONIC, &tval );
+
+#else
+
+	timeval tcur;
+	gettimeofday( &tcur, NULL );
+
+	tval.tv_sec = tcur.tv_sec;
+	tval.tv_nsec = tcur.tv_usec * 1000;
+
+#endif
+
 }
 
 void _ITH_TIMER::tval_add( ITH_TIMEVAL & tval, long delay )
 {
-	// timeval expressed as seconds and microseconds
+	// timespec expressed as seconds and nanoseconds
 
 	tval.tv_sec += delay / 1000;
-	tval.tv_usec += delay % 1000 * 1000;
+	tval.tv_nsec += delay % 1000 * 1000000;
+
+	if( tval.tv_nsec >= 1000000000 )
+	{
+		tval.tv_sec++;
+		tval.tv_nsec -= 1000000000;
+	}
 }
 
-long _ITH_TIMER::tval_sub( ITH_TIMEVAL & tval1, ITH_TIMEVAL & tval2 )
+long long _ITH_TIMER::tval_sub( ITH_TIMEVAL & tval1, ITH_TIMEVAL & tval2 )
 {
-	long sec = tval2.tv_sec - tval1.tv_sec;
-	sec *= 1000;
-
-	long usec = tval2.tv_usec - tval1.tv_usec;
-	usec /= 1000;
+	long long nsec = tval2.tv_sec - tval1.tv_sec;
+	nsec *= 1000000000;
+	nsec += tval2.tv_nsec - tval1.tv_nsec;
 
-	return sec + usec;
+	return nsec;
 }
 
 bool _ITH_TIMER::wait_time( long msecs )
@@ -478,8 +636,114 @@ bool _ITH_TIMER::wait_time( long msecs )
 
 #endif
 
-void _ITH_TIMER::run()
+//
+// the pending events are kept in a binary
+// min heap ordered by scheduled time. events
+// with the same time execute in the order
+// they were scheduled
+//
+
+bool _ITH_TIMER::heap_less( ITH_EVENT * event1, ITH_EVENT * event2 )
+{
+	long long diff = tval_sub( event2->heap_sched, event1->heap_sched );
+	if( diff )
+		return ( diff < 0 );
+
+	return ( long( event1->heap_order - event2->heap_order ) < 0 );
+}
+
+void _ITH_TIMER::heap_set( ITH_EVENT * event, long index )
+{
+	heap[ index ] = event;
+	event->heap_index = index;
+}
+
+void _ITH_TIMER::heap_up( long index )
 {
+	ITH_EVENT * event = heap[ index ];
+
+	while( index > 0 )
+	{
+		long parent = ( index - 1 ) / 2;
+		if( !heap_less( event, heap[ parent ] ) )
+			break;
+
+		heap_set( heap[ parent ], index );
+		index = parent;
+	}
+
+	heap_set( event, index );
+}
+
+void _ITH_TIMER::heap_down( long index )
+{
+	ITH_EVENT * event = heap[ index ];
+
+	while( true )
+	{
+		long child = index * 2 + 1;
+		if( child >= heap_num )
+			break;
+
+		if( ( child + 1 ) < heap_num )
+			if( heap_less( heap[ child + 1 ], heap[ child ] ) )
+				child++;
+
+		if( !heap_less( heap[ child ], event ) )
+			break;
+
+		heap_set( heap[ child ], index );
+		index = child;
+	}
+
+	heap_set( event, index );
+}
+
+void _ITH_TIMER::heap_del( long index )
+{
+	heap[ index ]->heap_index = -1;
+
+	heap_num--;
+
+	if( index == heap_num )
+		return;
+
+	//
+	// move the last event into the empty
+	// slot and restore the heap order
+	//
+
+	heap_set( heap[ heap_num ], index );
+
+	if( ( index > 0 ) && heap_less( heap[ index ], heap[ ( index - 1 ) / 2 ] ) )
+		heap_up( index );
+	else
+		heap_down( index );
+}
+
+void _ITH_TIMER::run( long threads )
+{
+	//
+	// optionally start executor threads.
+	// the timer thread then only keeps
+	// time and hands off due events
+	//
+
+	if( threads > 0 )
+	{
+		exec_list = new ITH_TIMER_EXEC[ threads ];
+		if( exec_list != NULL )
+		{
+			exec_count = threads;
+
+			for( long index = 0; index < exec_count; index++ )
+			{
+				exec_list[ index ].timer = this;
+				exec_list[ index ].exec( NULL );
+			}
+		}
+	}
+
 	lock.lock();
 
 	while( !stop )
@@ -492,14 +756,17 @@ void _ITH_TIMER::run()
 
 		long delay = -1;
 
-		if( head != NULL )
+		if( heap_num )
 		{
 			ITH_TIMEVAL current;
 			tval_cur( current );
-			delay = tval_sub( current, head->sched );
+			long long nsec = tval_sub( current, heap[ 0 ]->heap_sched );
+
+			// round up to whole milliseconds
 
-			if( delay < 0 )
-				delay = 0;
+			delay = 0;
+			if( nsec > 0 )
+				delay = long( ( nsec + 999999 ) / 1000000 );
 		}
 
 		//
@@ -529,7 +796,7 @@ void _ITH_TIMER::run()
 		// that needs to be enabled
 		//
 
-		if( head != NULL )
+		if( heap_num )
 		{
 			ITH_TIMEVAL current;
 			tval_cur( current );
@@ -539,29 +806,79 @@ void _ITH_TIMER::run()
 			// is ready to execute
 			//
 
-			if( tval_sub( current, head->sched ) > 0 )
+			long long nsec = tval_sub( current, heap[ 0 ]->heap_sched );
+			if( nsec > 0 )
 				continue;
 
-			ITH_ENTRY * entry = head;
-			head = head->next;
+			ITH_EVENT * event = heap[ 0 ];
+			heap_del( 0 );
 
 			//
-			// execute the event
+			// record the execution lag
 			//
 
-			lock.unlock();
+			stat_lag_last = long( -nsec / 1000 );
+			stat_lag_total += stat_lag_last;
+			stat_events++;
+
+			if( stat_lag_max < stat_lag_last )
+				stat_lag_max = stat_lag_last;
+
+			//
+			// execute the event inline or
+			// queue it to an executor
+			//
+
+			if( exec_count )
+			{
+				unsigned long group = ( unsigned long ) event->group;
+				if( !group )
+					group = ( unsigned long ) event;
 
-			if( entry->event->func() )
-				add( entry->event );
+				// discard pointer alignment bits
 
-			delete entry;
-			lock.lock();
+				group ^= group >> 4;
+				group ^= group >> 12;
+
+				exec_list[ group % exec_count ].queue( event );
+			}
+			else
+			{
+				lock.unlock();
+
+				if( event->func() )
+					add( event );
+
+				lock.lock();
+			}
 		}
 	}
 
 	exit = true;
 
+	//
+	// stop our executor threads after
+	// they run any queued events
+	//
+
+	for( long index = 0; index < exec_count; index++ )
+	{
+		exec_list[ index ].stop = true;
+		exec_list[ index ].cond.alert();
+	}
+
 	lock.unlock();
+
+	if( exec_list != NULL )
+	{
+		for( long index = 0; index < exec_count; index++ )
+			exec_list[ index ].done.wait( -1 );
+
+		delete [] exec_list;
+
+		exec_list = NULL;
+		exec_count = 0;
+	}
 }
 
 void _ITH_TIMER::end()
@@ -573,39 +890,57 @@ void _ITH_TIMER::end()
 
 bool _ITH_TIMER::add( ITH_EVENT * event )
 {
-	ITH_ENTRY * entry = new ITH_ENTRY;
-	if( entry == NULL )
-		return false;
+	lock.lock();
 
-	entry->event = event;
-	tval_cur( entry->sched );
-	tval_add( entry->sched, event->delay );
+	//
+	// an event can only be scheduled once
+	// and not while it waits to be run by
+	// an executor
+	//
 
-	lock.lock();
+	if( ( event->heap_index >= 0 ) || ( event->exec_queue != NULL ) )
+	{
+		lock.unlock();
+		return false;
+	}
 
-	ITH_ENTRY * prev = NULL;
-	ITH_ENTRY * next = head;
+	//
+	// grow the heap as needed
+	//
 
-	while( next != NULL )
+	if( heap_num == heap_max )
 	{
-		if( tval_sub( next->sched, entry->sched ) <= 0 )
-			break;
+		ITH_EVENT ** new_heap = new ITH_EVENT * [ heap_max + HEAP_GROW_SIZE + heap_max / 2 ];
+		if( new_heap == NULL )
+		{
+			lock.unlock();
+			return false;
+		}
 
-		if( next == NULL )
-			break;
+		if( heap != NULL )
+		{
+			memcpy( new_heap, heap, heap_num * sizeof( ITH_EVENT * ) );
+			delete [] heap;
+		}
 
-		prev = next;
-		next = prev->next;
+		heap = new_heap;
+		heap_max += HEAP_GROW_SIZE + heap_max / 2;
 	}
 
-	entry->next = next;
+	tval_cur( event->heap_sched );
+	tval_add( event->heap_sched, event->delay );
+	event->heap_order = heap_order++;
 
-	if( prev == NULL )
-		head = entry;
-	else
-		prev->next = entry;
+	heap_set( event, heap_num++ );
+	heap_up( heap_num - 1 );
 
-	cond.alert();
+	//
+	// only wake the timer thread when
+	// the next execution time changed
+	//
+
+	if( event->heap_index == 0 )
+		cond.alert();
 
 	lock.unlock();
 
@@ -614,36 +949,45 @@ bool _ITH_TIMER::add( ITH_EVENT * event )
 
 bool _ITH_TIMER::del( ITH_EVENT * event )
 {
-	ITH_ENTRY * prev = NULL;
-	ITH_ENTRY * next = head;
-
 	lock.lock();
 
-	while( next != NULL )
-	{
-		if( next->event == event )
-			break;
+	bool found = false;
 
-		if( next == NULL )
-			break;
+	//
+	// remove the event from the heap or
+	// from the executor queue it is
+	// waiting in
+	//
 
-		prev = next;
-		next = prev->next;
+	if( event->heap_index >= 0 )
+	{
+		heap_del( event->heap_index );
+		found = true;
 	}
-
-	if( next != NULL )
+	else if( event->exec_queue != NULL )
 	{
-		if( prev == NULL )
-			head = next->next;
-		else
-			prev->next = next->next;
-
-		delete next;
+		event->exec_queue->unlink( event );
+		found = true;
 	}
 
 	lock.unlock();
 
-	return ( next != NULL );
+	return found;
+}
+
+void _ITH_TIMER::stats( ITH_TIMER_STATS & stats )
+{
+	lock.lock();
+
+	stats.events = stat_events;
+	stats.lag_last = stat_lag_last;
+	stats.lag_max = stat_lag_max;
+	stats.lag_avg = 0;
+
+	if( stat_events )
+		stats.lag_avg = long( stat_lag_total / ( long long ) stat_events );
+
+	lock.unlock();
 }
 
 //==============================================================================
@@ -96,11 +96,83 @@ typedef LARGE_INTEGER ITH_TIMEVAL;
 
 #ifdef UNIX
 
-typedef timeval ITH_TIMEVAL; 
+typedef timespec ITH_TIMEVAL; 
 #define Sleep( T ) usleep( T * 1000 )
 
 #endif
 
+//==============================================================================
+// atomic integer operations
+//==============================================================================
+
+#ifdef WIN32
+
+inline long ith_atomic_inc( volatile long * value )
+{
+	return InterlockedIncrement( value );
+}
+
+inline long ith_atomic_dec( volatile long * value )
+{
+	return InterlockedDecrement( value );
+}
+
+inline long ith_atomic_add( volatile long * value, long count )
+{
+	return InterlockedExchangeAdd( value, count ) + count;
+}
+
+inline bool ith_atomic_cas( volatile long * value, long oldval, long newval )
+{
+	return ( InterlockedCompareExchange( value, newval, oldval ) == oldval );
+}
+
+inline long ith_atomic_or( volatile long * value, long bits )
+{
+	return ( InterlockedOr( value, bits ) | bits );
+}
+
+inline long ith_atomic_and( volatile long * value, long bits )
+{
+	return ( InterlockedAnd( value, bits ) & bits );
+}
+
+#endif
+
+#ifdef UNIX
+
+inline long ith_atomic_inc( volatile long * value )
+{
+	return __sync_add_and_fetch( value, 1 );
+}
+
+inline long ith_atomic_dec( volatile long * value )
+{
+	return __sync_sub_and_fetch( value, 1 );
+}
+
+inline long ith_atomic_add( volatile long * value, long count )
+{
+	return __sync_add_and_fetch( value, count );
+}
+
+inline bool ith_atomic_cas( volatile long * value, long oldval, long newval )
+{
+	return __sync_bool_compare_and_swap( value, oldval, newval );
+}
+
+inline long ith_atomic_or( volatile long * value, long bits )
+{
+	return __sync_or_and_fetch( value, bits );
+}
+
+inline long ith_atomic_and( volatile long * value, long bits )
+{
+	return __sync_and_and_fetch( value, bits );
+}
+
+#endif
+
 //==============================================================================
 // mutex lock class
 //==============================================================================
@@ -198,53 +270,146 @@ typedef class DLX _ITH_EXEC
 // event execution timer classes
 //==============================================================================
 
+//
+// an event doubles as its own cancellation
+// handle. while scheduled it records its
+// position in the timer heap so it can be
+// removed without searching. events that
+// share a group are never run concurrently
+// by the timer executor threads
+//
+
 typedef class DLX _ITH_EVENT
 {
+	friend class _ITH_TIMER;
+	friend class _ITH_TIMER_EXEC;
+
+	private:
+
+	ITH_TIMEVAL		heap_sched;		// scheduled execution time
+	unsigned long	heap_order;		// scheduling order
+	long			heap_index;		// timer heap index
+
+	class _ITH_TIMER_EXEC *	exec_queue;	// executor while queued
+	_ITH_EVENT *			exec_next;	// executor queue link
+
 	public:
 
-	long delay;
+	long	delay;
+	void *	group;
+
+	_ITH_EVENT();
 
 	virtual	bool func() = 0;
 
 }ITH_EVENT;
 
-typedef struct _ITH_ENRTY
+//
+// timer executor thread. due events are
+// queued to an executor selected by their
+// group so events for the same group run
+// in order on the same thread. the queue
+// is guarded by the timer lock so a queued
+// event can be cancelled like a scheduled
+// one
+//
+
+class _ITH_TIMER;
+
+typedef class DLX _ITH_TIMER_EXEC : public ITH_EXEC
 {
-	_ITH_ENRTY * next;
-	_ITH_EVENT * event;
+	friend class _ITH_TIMER;
+
+	private:
 
-	ITH_TIMEVAL	sched;
+	_ITH_TIMER *	timer;
 
-}ITH_ENTRY;
+	ITH_COND		cond;
+	ITH_COND		done;
+
+	ITH_EVENT *		head;
+	ITH_EVENT *		tail;
+
+	bool			stop;
+
+	long	func( void * arg );
+
+	public:
+
+	_ITH_TIMER_EXEC();
+
+	void	queue( ITH_EVENT * event );
+	void	unlink( ITH_EVENT * event );
+
+}ITH_TIMER_EXEC;
+
+#define HEAP_GROW_SIZE	64
+
+//
+// the execution lag is the time between when
+// an event was scheduled to run and when it
+// was actually run, expressed in microseconds
+//
+
+typedef struct _ITH_TIMER_STATS
+{
+	unsigned long	events;			// executed event count
+	long			lag_last;		// last execution lag
+	long			lag_max;		// maximum execution lag
+	long			lag_avg;		// average execution lag
+
+}ITH_TIMER_STATS;
 
 typedef class DLX _ITH_TIMER
 {
+	friend class _ITH_TIMER_EXEC;
+
 	private:
 
-	ITH_ENTRY *	head;
+	ITH_EVENT **	heap;
+	long			heap_max;
+	long			heap_num;
+	unsigned long	heap_order;
+
 	ITH_LOCK	lock;
 	ITH_COND	cond;
 
+	ITH_TIMER_EXEC *	exec_list;
+	long				exec_count;
+
 	bool	stop;
 	bool	exit;
 
-	void	tval_cur( ITH_TIMEVAL & tval );
-	void	tval_add( ITH_TIMEVAL & tval, long lval = 0 );
-	long	tval_sub( ITH_TIMEVAL & tval1, ITH_TIMEVAL & tval2 );
+	unsigned long	stat_events;
+	long			stat_lag_last;
+	long			stat_lag_max;
+	long long		stat_lag_total;
+
+	void		tval_cur( ITH_TIMEVAL & tval );
+	void		tval_add( ITH_TIMEVAL & tval, long lval = 0 );
+	long long	tval_sub( ITH_TIMEVAL & tval1, ITH_TIMEVAL & tval2 );
 
 	bool	wait_time( long msecs );
 
+	bool	heap_less( ITH_EVENT * event1, ITH_EVENT * event2 );
+	void	heap_set( ITH_EVENT * event, long index );
+	void	heap_up( long index );
+	void	heap_down( long index );
+	void	heap_del( long index );
+
 	public:
 
 	_ITH_TIMER();
 	virtual	~_ITH_TIMER();
 
-	void	run();
+	void	run( long threads = 0 );
 	void	end();
 
 	bool	add( ITH_EVENT * event );
 	bool	del( ITH_EVENT * event );
 
+	void	stats( ITH_TIMER_STATS & stats );
+
 }ITH_TIMER;
 
 //==============================================================================
@@ -40,50 +40,380 @@
 
 #include "liblog.h"
 
+//
+// each thread keeps a reference to the
+// ring buffer it has claimed for writing
+//
+
+#ifdef WIN32
+# define LOG_TLS __declspec( thread )
+#else
+# define LOG_TLS __thread
+#endif
+
+static LOG_TLS LOG_RING * log_ring = NULL;
+
+long _LOG_WRITER::func( void * arg )
+{
+	return log->writer_func();
+}
+
 _LOG::_LOG()
 {
 	fp = NULL;
+
+	log_level = LLOG_NONE;
+	log_flags = 0;
+
+	writer.log = this;
+	writer_run = 0;
+
+	ring_list = NULL;
+
+	drops = 0;
+	drops_seen = 0;
+
+	batch_size = 0;
+
+	stamp_time = 0;
+	stamp_size = 0;
 }
 
 _LOG::~_LOG()
 {
 	close();
+
+	while( ring_list != NULL )
+	{
+		LOG_RING * ring = ring_list;
+		ring_list = ring->next;
+		delete ring;
+	}
+}
+
+LOG_RING * _LOG::ring_get()
+{
+	//
+	// use the ring this thread already owns
+	//
+
+	LOG_RING * ring = log_ring;
+
+	if( ring != NULL )
+	{
+		if( ring->log != this )
+			return NULL;
+
+		return ring;
+	}
+
+	//
+	// claim a ring released by another thread
+	//
+
+	ring_lock.lock();
+
+	for( ring = ring_list; ring != NULL; ring = ring->next )
+		if( ith_atomic_cas( &ring->owned, 0, 1 ) )
+			break;
+
+	//
+	// or allocate a new ring
+	//
+
+	if( ring == NULL )
+	{
+		ring = new LOG_RING;
+		if( ring != NULL )
+		{
+			ring->log = this;
+			ring->head = 0;
+			ring->tail = 0;
+			ring->owned = 1;
+
+			ring->next = ring_list;
+			ring_list = ring;
+		}
+	}
+
+	ring_lock.unlock();
+
+	log_ring = ring;
+
+	return ring;
+}
+
+bool _LOG::ring_put( LOG_RING * ring, char * buff, size_t size )
+{
+	LOG_REC rec;
+	rec.size = ( long ) size;
+	time( &rec.time );
+
+	unsigned long need = ( unsigned long )( sizeof( rec ) + size );
+	unsigned long head = ith_atomic_add( &ring->head, 0 );
+	unsigned long tail = ith_atomic_add( &ring->tail, 0 );
+	unsigned long used = head - tail;
+
+	if( need > ( LOG_RING_SIZE - used ) )
+	{
+		ith_atomic_inc( &drops );
+		return false;
+	}
+
+	//
+	// copy the record header and text into
+	// the ring, wrapping at the buffer end
+	//
+
+	char *	sdata[ 2 ] = { ( char * ) &rec, buff };
+	size_t	ssize[ 2 ] = { sizeof( rec ), size };
+
+	unsigned long oset = head;
+
+	for( long index = 0; index < 2; index++ )
+	{
+		size_t spos = oset & ( LOG_RING_SIZE - 1 );
+		size_t part = LOG_RING_SIZE - spos;
+
+		if( part > ssize[ index ] )
+			part = ssize[ index ];
+
+		memcpy( ring->data + spos, sdata[ index ], part );
+		memcpy( ring->data, sdata[ index ] + part, ssize[ index ] - part );
+
+		oset += ( unsigned long ) ssize[ index ];
+	}
+
+	//
+	// publish the record to the writer and
+	// wake it once the ring is half full
+	//
+
+	ith_atomic_add( &ring->head, ( long ) need );
+
+	if( ( used < ( LOG_RING_SIZE / 2 ) ) && ( ( used + need ) >= ( LOG_RING_SIZE / 2 ) ) )
+		writer_cond.alert();
+
+	return true;
+}
+
+void _LOG::ring_drain()
+{
+	//
+	// called with the log lock held
+	//
+
+	char tbuff[ LOG_MAX_BIN + 1 ];
+
+	ring_lock.lock();
+	LOG_RING * ring = ring_list;
+	ring_lock.unlock();
+
+	for( ; ring != NULL; ring = ring->next )
+	{
+		unsigned long head = ith_atomic_add( &ring->head, 0 );
+		unsigned long tail = ith_atomic_add( &ring->tail, 0 );
+		unsigned long base = tail;
+
+		while( tail != head )
+		{
+			LOG_REC rec;
+
+			char *	tdata[ 2 ] = { ( char * ) &rec, tbuff };
+			size_t	tsize[ 2 ] = { sizeof( rec ), 0 };
+
+			for( long index = 0; index < 2; index++ )
+			{
+				size_t spos = tail & ( LOG_RING_SIZE - 1 );
+				size_t part = LOG_RING_SIZE - spos;
+
+				if( index )
+					tsize[ index ] = rec.size;
+
+				if( part > tsize[ index ] )
+					part = tsize[ index ];
+
+				memcpy( tdata[ index ], ring->data + spos, part );
+				memcpy( tdata[ index ] + part, ring->data, tsize[ index ] - part );
+
+				tail += ( unsigned long ) tsize[ index ];
+			}
+
+			tbuff[ rec.size ] = 0;
+
+			write_buff( tbuff, rec.size, rec.time );
+		}
+
+		ith_atomic_add( &ring->tail, ( long )( tail - base ) );
+	}
+
+	//
+	// report messages that did not fit
+	//
+
+	long count = ith_atomic_add( &drops, 0 );
+
+	if( count != drops_seen )
+	{
+		sprintf_s( tbuff, LOG_MAX_TXT,
+			"!! : %li log messages dropped\n",
+			count - drops_seen );
+
+		write_buff( tbuff, strlen( tbuff ), time( NULL ) );
+
+		drops_seen = count;
+	}
+
+	write_flush();
+}
+
+long _LOG::writer_func()
+{
+	while( ith_atomic_add( &writer_run, 0 ) )
+	{
+		if( !writer_cond.wait( LOG_FLUSH_MSECS ) )
+			writer_cond.reset();
+
+		lock.lock();
+		ring_drain();
+		lock.unlock();
+	}
+
+	writer_done.alert();
+
+	return 0;
+}
+
+bool _LOG::run()
+{
+	if( !ith_atomic_cas( &writer_run, 0, 1 ) )
+		return true;
+
+	if( !writer.exec( NULL ) )
+	{
+		ith_atomic_and( &writer_run, 0 );
+		return false;
+	}
+
+	return true;
+}
+
+void _LOG::end()
+{
+	if( !ith_atomic_cas( &writer_run, 1, 0 ) )
+		return;
+
+	writer_cond.alert();
+	writer_done.wait( -1 );
+
+	//
+	// pick up anything written after the
+	// writer thread last drained. producers
+	// that publish after this point see the
+	// writer retired and drain themselves
+	//
+
+	lock.lock();
+	ring_drain();
+	lock.unlock();
+}
+
+void _LOG::detach()
+{
+	LOG_RING * ring = log_ring;
+
+	if( ( ring == NULL ) || ( ring->log != this ) )
+		return;
+
+	//
+	// the ring may still hold messages but
+	// the writer drains it regardless of
+	// which thread claims it next
+	//
+
+	ith_atomic_and( &ring->owned, 0 );
+
+	log_ring = NULL;
+}
+
+void _LOG::write_text( char * buff, size_t size )
+{
+	//
+	// hand the message to the writer thread
+	//
+
+	if( ith_atomic_add( &writer_run, 0 ) )
+	{
+		LOG_RING * ring = ring_get();
+
+		if( ring != NULL )
+		{
+			ring_put( ring, buff, size );
+
+			//
+			// the writer may have been retired
+			// after the check above and before
+			// the final drain could see this
+			// message, so drain it here
+			//
+
+			if( !ith_atomic_add( &writer_run, 0 ) )
+			{
+				lock.lock();
+				ring_drain();
+				lock.unlock();
+			}
+
+			return;
+		}
+	}
+
+	//
+	// or write it synchronously
+	//
+
+	lock.lock();
+	write_buff( buff, size, time( NULL ) );
+	write_flush();
+	lock.unlock();
 }
 
-bool _LOG::write_buff( char * buff, size_t size )
+bool _LOG::write_buff( char * buff, size_t size, time_t ctime )
 {
 	//
-	// build time stamp
+	// build time stamp, only reformatted
+	// when the second has changed
 	//
 
-	char	tbuff[ LOG_MAX_TXT ];
 	size_t	tlen = 0;
 
 	if( !( log_flags & LOGFLAG_SYSTEM ) )
 	{
-		time_t		ctime;
-		struct tm *	ltime;
-
-		time( &ctime );
+		if( !stamp_size || ( ctime != stamp_time ) )
+		{
+			struct tm *	ltime;
 
 #ifdef WIN32
 
-		struct tm ltm;
-		ltime = &ltm;
-		localtime_s( ltime, &ctime );
+			struct tm ltm;
+			ltime = &ltm;
+			localtime_s( ltime, &ctime );
 
 #endif
 
 #ifdef UNIX
 
-		ltime = localtime( &ctime );
+			struct tm ltm;
+			ltime = localtime_r( &ctime, &ltm );
 
 #endif
 
-		tlen = strftime( tbuff, LOG_MAX_TXT, "%y/%m/%d %H:%M:%S ", ltime );
-	}
+			stamp_size = strftime( stamp_buff, sizeof( stamp_buff ), "%y/%m/%d %H:%M:%S ", ltime );
+			stamp_time = ctime;
+		}
 
-	lock.lock();
+		tlen = stamp_size;
+	}
 
 	//
 	// log buffer to console
@@ -97,7 +427,6 @@ bool _LOG::write_buff( char * buff, size_t size )
 	//
 
 	char *	line = buff;
-	size_t	oset = 0;
 	size_t	llen;
 
 	while( line != NULL && line[ 0 ] )
@@ -116,25 +445,45 @@ bool _LOG::write_buff( char * buff, size_t size )
 			llen = strlen( line );
 
 		if( tlen )
-			write_line( tbuff, tlen );
+			write_line( stamp_buff, tlen );
 
 		write_line( line, llen );
 
 		line = next;
 	}
 
-	lock.unlock();
-
 	return true;
 }
 
 bool _LOG::write_line( char * buff, size_t size )
 {
+#ifdef UNIX
+
+	if( log_flags & LOGFLAG_SYSTEM )
+	{
+		syslog( LOG_NOTICE, "%s", buff );
+		return true;
+	}
+
+#endif
+
+	if( fp == NULL )
+		return true;
+
+	//
+	// lines are collected in the batch
+	// buffer and written out together
+	//
+
+	if( ( batch_size + size ) > LOG_BATCH_SIZE )
+		write_flush();
+
+	if( size > LOG_BATCH_SIZE )
+	{
 #ifdef WIN32
 
-	DWORD dwsize = ( DWORD ) size;
+		DWORD dwsize = ( DWORD ) size;
 
-	if( fp != NULL )
 		WriteFile(
 			fp,
 			buff,
@@ -146,23 +495,54 @@ bool _LOG::write_line( char * buff, size_t size )
 
 #ifdef UNIX
 
-	if( log_flags & LOGFLAG_SYSTEM )
-		syslog( LOG_NOTICE, "%s", buff );
-	else
+		fwrite( buff, size, 1, fp );
+
+#endif
+
+		return true;
+	}
+
+	memcpy( batch_buff + batch_size, buff, size );
+	batch_size += size;
+
+	return true;
+}
+
+void _LOG::write_flush()
+{
+	if( ( fp == NULL ) || !batch_size )
 	{
-		if( fp != NULL )
-		{
-			fwrite( buff, size, 1, fp );
-			fflush( fp );
-		}
+		batch_size = 0;
+		return;
 	}
+
+#ifdef WIN32
+
+	DWORD dwsize = ( DWORD ) batch_size;
+
+	WriteFile(
+		fp,
+		batch_buff,
+		dwsize,
+		&dwsize,
+		NULL );
+
 #endif
 
-	return true;
+#ifdef UNIX
+
+	fwrite( batch_buff, batch_size, 1, fp );
+	fflush( fp );
+
+#endif
+
+	batch_size = 0;
 }
 
 bool _LOG::open( char * path, long level, long flags )
 {
+	lock.lock();
+
 	//
 	// set the log level
 	//
@@ -174,7 +554,12 @@ bool _LOG::open( char * path, long level, long flags )
 
 	if( path )
 	{
-		close();
+		if( fp != NULL )
+		{
+			write_flush();
+			FlushFileBuffers( fp );
+			CloseHandle( fp );
+		}
 
 		fp = CreateFile(
 				path,
@@ -185,8 +570,14 @@ bool _LOG::open( char * path, long level, long flags )
 				FILE_ATTRIBUTE_NORMAL,
 				0 );
 
+		if( fp == INVALID_HANDLE_VALUE )
+			fp = NULL;
+
 		if( fp == NULL )
+		{
+			lock.unlock();
 			return false;
+		}
 	}
 #endif
 
@@ -201,17 +592,27 @@ bool _LOG::open( char * path, long level, long flags )
 			fp = fopen( path, "w" );
 
 			if( fp == NULL )
+			{
+				lock.unlock();
 				return false;
+			}
 		}
 	}
 
 #endif
 
+	lock.unlock();
+
 	return true;
 }
 
 void _LOG::close()
 {
+	end();
+
+	lock.lock();
+
+	write_flush();
 
 #ifdef WIN32
 
@@ -237,29 +638,23 @@ void _LOG::close()
 
 #endif
 	fp = NULL;
+
+	lock.unlock();
 }
 
 void _LOG::txt( long level, const char * fmt, ... )
 {
 	char tbuff[ LOG_MAX_TXT ];
-	char fbuff[ LOG_MAX_TXT ];
 
-	if( level > log_level )
+	if( !enabled( level ) )
 		return;
 
 	va_list list;
 	va_start( list, fmt );
+	vsprintf_s( tbuff, LOG_MAX_TXT, fmt, list );
+	va_end( list );
 
-	if( ( fp != NULL ) || ( log_flags & LOGFLAG_ECHO ) )
-	{
-		size_t	tsize = LOG_MAX_TXT;
-		size_t	tused = 0;
-
-		vsprintf_s( tbuff, LOG_MAX_TXT, fmt, list );
-		sprintf_s( fbuff, tsize, "%s", tbuff );
-
-		write_buff( fbuff, tused );
-	}
+	write_text( tbuff, strlen( tbuff ) );
 }
 
 void _LOG::bin( long level, long blevel, void * bin, size_t len, const char * fmt, ... )
@@ -267,65 +662,63 @@ void _LOG::bin( long level, long blevel, void * bin, size_t len, const char * fm
 	char tbuff[ LOG_MAX_TXT ];
 	char fbuff[ LOG_MAX_BIN ];
 
-	if( level > log_level )
+	if( !enabled( level ) )
 		return;
 
-	va_list list;
-	va_start( list, fmt );
+	// tsize = total buffer size - NLx2 - NULL
 
-	if( ( fp != NULL ) || ( log_flags & LOGFLAG_ECHO ) )
-	{
-		// tsize = total buffer size - NLx2 - NULL
+	size_t	tsize = LOG_MAX_BIN  - 3;
+	size_t	tused = 0;
 
-		size_t	tsize = LOG_MAX_BIN  - 3;
-		size_t	tused = 0;
+	// add our text label
 
-		// add our text label
+	va_list list;
+	va_start( list, fmt );
+	vsprintf_s( tbuff, LOG_MAX_TXT, fmt, list ); 
+	va_end( list );
 
-		vsprintf_s( tbuff, LOG_MAX_TXT, fmt, list ); 
-		tused += sprintf_s( fbuff, tsize, "%s ( %ld bytes )", tbuff, len );
+	tused += sprintf_s( fbuff, tsize, "%s ( %ld bytes )", tbuff, len );
 
-		// check binary log level
+	// check binary log level
 
-		if( blevel <= log_level )
-		{
-			// setup target and source data pointers
+	if( blevel <= log_level )
+	{
+		// setup target and source data pointers
 
-			char *	tdata = fbuff;
-			char *	sdata = ( char * ) bin;
+		char *	tdata = fbuff;
+		char *	sdata = ( char * ) bin;
 
-			// bsize = ( tsize / required chars per line ) * bin bytes per line
+		// bsize = ( tsize / required chars per line ) * bin bytes per line
 
-			size_t	ssize = ( ( tsize - tused ) / 77 ) * 32;
-			size_t	sused = 0;
+		size_t	ssize = ( ( tsize - tused ) / 77 ) * 32;
+		size_t	sused = 0;
 
-			if( ssize > len )
-				ssize = len;
+		if( ssize > len )
+			ssize = len;
 
-			// format and log source bytes
+		// format and log source bytes
 
-			for( ; sused < ssize; sused++ )
-			{
-				if( !( sused & 0x1F ) )
-					tused += sprintf_s( &tdata[ tused ], tsize - tused, "\n0x :" );
+		for( ; sused < ssize; sused++ )
+		{
+			if( !( sused & 0x1F ) )
+				tused += sprintf_s( &tdata[ tused ], tsize - tused, "\n0x :" );
 
-				unsigned char bchar = sdata[ sused ];
+			unsigned char bchar = sdata[ sused ];
 
-				if( !( sused & 0x03 ) )
-					tused += sprintf_s( &tdata[ tused ], tsize - tused, " %02x", bchar );
-				else
-					tused += sprintf_s( &tdata[ tused ], tsize - tused, "%02x", bchar );
+			if( !( sused & 0x03 ) )
+				tused += sprintf_s( &tdata[ tused ], tsize - tused, " %02x", bchar );
+			else
+				tused += sprintf_s( &tdata[ tused ], tsize - tused, "%02x", bchar );
 
-				assert( tsize > tused );
-			}
+			assert( tsize > tused );
 		}
+	}
 
-		// add terminating null and append
+	// add terminating null and append
 
-		tused += sprintf_s( &fbuff[ tused ], tsize - tused, "\n" );
+	tused += sprintf_s( &fbuff[ tused ], tsize - tused, "\n" );
 
-		write_buff( fbuff, tused );
-	}
+	write_text( fbuff, tused );
 
 	return;
 }
@@ -71,8 +71,58 @@
 #define LOGFLAG_ECHO		0x01
 #define LOGFLAG_SYSTEM		0x02
 
+//
+// once the writer thread is running, each
+// thread copies formatted messages into its
+// own ring buffer and returns. the writer
+// drains all rings and batches the output.
+// a message that does not fit in the ring
+// is counted as dropped rather than making
+// the caller wait for the writer
+//
+
+#define LOG_RING_SIZE		( 1024 * 64 )	// must be a power of two
+#define LOG_BATCH_SIZE		( 1024 * 16 )
+#define LOG_FLUSH_MSECS		250
+
+typedef struct _LOG_REC
+{
+	long		size;	// message text size
+	time_t		time;	// message time stamp
+
+}LOG_REC;
+
+typedef struct _LOG_RING
+{
+	struct _LOG *		log;		// owning log
+	struct _LOG_RING *	next;		// log ring list link
+
+	volatile long	head;		// producer position
+	volatile long	tail;		// writer position
+	volatile long	owned;		// owned by a thread
+
+	char	data[ LOG_RING_SIZE ];
+
+}LOG_RING;
+
+struct _LOG;
+
+typedef class DLX _LOG_WRITER : public ITH_EXEC
+{
+	friend struct _LOG;
+
+	private:
+
+	struct _LOG *	log;
+
+	long	func( void * arg );
+
+}LOG_WRITER;
+
 typedef struct DLX _LOG
 {
+	friend class _LOG_WRITER;
+
 	private:
 
 #ifdef WIN32
@@ -95,8 +145,35 @@ typedef struct DLX _LOG
 	long		log_level;
 	long		log_flags;
 
-	bool	write_buff( char * buff, size_t size );
+	LOG_WRITER	writer;
+	ITH_COND	writer_cond;
+	ITH_COND	writer_done;
+
+	volatile long	writer_run;
+
+	LOG_RING *	ring_list;
+	ITH_LOCK	ring_lock;
+
+	volatile long	drops;
+	long			drops_seen;
+
+	char		batch_buff[ LOG_BATCH_SIZE ];
+	size_t		batch_size;
+
+	time_t		stamp_time;
+	char		stamp_buff[ 32 ];
+	size_t		stamp_size;
+
+	LOG_RING *	ring_get();
+	bool		ring_put( LOG_RING * ring, char * buff, size_t size );
+	void		ring_drain();
+
+	void	write_text( char * buff, size_t size );
+	bool	write_buff( char * buff, size_t size, time_t ctime );
 	bool	write_line( char * buff, size_t size );
+	void	write_flush();
+
+	long	writer_func();
 
 	public:
 
@@ -106,6 +183,25 @@ typedef struct DLX _LOG
 	bool	open( char * path, long level, long flags );
 	void	close();
 
+	bool	run();
+	void	end();
+	void	detach();
+
+	//
+	// hot paths should test the level before
+	// building log arguments so that nothing
+	// is formatted for a message that would
+	// be discarded
+	//
+
+	inline bool enabled( long level )
+	{
+		if( level > log_level )
+			return false;
+
+		return ( fp != NULL ) || ( log_flags & LOGFLAG_ECHO );
+	}
+
 	void	txt( long level, const char * fmt, ... );
 	void	bin( long level, long blevel, void * bin, size_t size, const char * fmt, ... );
 
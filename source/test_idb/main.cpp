@@ -0,0 +1,423 @@
+
+/*
+ * Copyright (c) 2007
+ *      Shrew Soft Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Redistributions in any form must be accompanied by information on
+ *    how to obtain complete source code for the software and any
+ *    accompanying software that uses the software.  The source code
+ *    must either be included in the distribution or be available for no
+ *    more than the cost of distribution plus a nominal fee, and must be
+ *    freely redistributable under reasonable conditions.  For an
+ *    executable file, complete source code means the source code for all
+ *    modules it contains.  It does not include source code for modules or
+ *    files that typically accompany the major components of the operating
+ *    system on which the executable file runs.
+ *
+ * THIS SOFTWARE IS PROVIDED BY SHREW SOFT INC ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, OR
+ * NON-INFRINGEMENT, ARE DISCLAIMED.  IN NO EVENT SHALL SHREW SOFT INC
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * AUTHOR : Matthew Grooms
+ *          mgrooms@shrew.net
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include "libidb.h"
+
+#define COOKIE_SIZE		8
+#define LOOKUP_COUNT	10000
+
+//
+// utility functions
+//
+
+static double tstamp()
+{
+	struct timeval tval;
+	gettimeofday( &tval, NULL );
+
+	return ( double ) tval.tv_sec * 1000000.0 + tval.tv_usec;
+}
+
+//
+// test entry class
+//
+
+typedef class _ENTRY_TEST : public IDB_ENTRY
+{
+	public:
+
+	unsigned char	cookie[ COOKIE_SIZE ];
+
+}ENTRY_TEST;
+
+//
+// cookie lookup benchmark
+//
+
+static void bench_lookup( long count )
+{
+	IDB_LIST	list;
+	IDB_HASH	hash;
+
+	ENTRY_TEST * entries = new ENTRY_TEST[ count ];
+
+	for( long index = 0; index < count; index++ )
+	{
+		for( long x = 0; x < COOKIE_SIZE; x++ )
+			entries[ index ].cookie[ x ] = rand() & 0xff;
+
+		list.add_entry( &entries[ index ] );
+		hash.add_entry(
+			IDB_HASH::hash( entries[ index ].cookie, COOKIE_SIZE ),
+			&entries[ index ] );
+	}
+
+	//
+	// linear list scan
+	//
+
+	long found = 0;
+	double tbeg = tstamp();
+
+	for( long lookup = 0; lookup < LOOKUP_COUNT; lookup++ )
+	{
+		ENTRY_TEST * target = &entries[ rand() % count ];
+
+		for( long index = 0; index < list.count(); index++ )
+		{
+			ENTRY_TEST * entry = static_cast<ENTRY_TEST*>( list.get_entry( index ) );
+			if( !memcmp( entry->cookie, target->cookie, COOKIE_SIZE ) )
+			{
+				found++;
+				break;
+			}
+		}
+	}
+
+	double tlist = ( tstamp() - tbeg ) / LOOKUP_COUNT;
+
+	//
+	// hashed index lookup
+	//
+
+	tbeg = tstamp();
+
+	for( long lookup = 0; lookup < LOOKUP_COUNT; lookup++ )
+	{
+		ENTRY_TEST * target = &entries[ rand() % count ];
+
+		uint32_t key = IDB_HASH::hash( target->cookie, COOKIE_SIZE );
+		IDB_HASH_NODE * node = NULL;
+		ENTRY_TEST * entry;
+
+		while( ( entry = static_cast<ENTRY_TEST*>( hash.get_entry( key, &node ) ) ) != NULL )
+		{
+			if( !memcmp( entry->cookie, target->cookie, COOKIE_SIZE ) )
+			{
+				found++;
+				break;
+			}
+		}
+	}
+
+	double thash = ( tstamp() - tbeg ) / LOOKUP_COUNT;
+
+	printf( "%7li entries : list %10.3f us/lookup, hash %7.3f us/lookup ( %li found )\n",
+		count, tlist, thash, found );
+
+	//
+	// verify removal from the index
+	//
+
+	for( long index = 0; index < count; index++ )
+		hash.del_entry(
+			IDB_HASH::hash( entries[ index ].cookie, COOKIE_SIZE ),
+			&entries[ index ] );
+
+	if( hash.count() )
+		printf( "!! : %li entries left in hash index\n", hash.count() );
+
+	delete [] entries;
+}
+
+//
+// list add and remove benchmark
+//
+
+static double bench_list_run( IDB_LIST & list, ENTRY_TEST * entries, long * order, long count )
+{
+	double tbeg = tstamp();
+
+	for( long index = 0; index < count; index++ )
+		list.add_entry( &entries[ index ] );
+
+	for( long index = 0; index < count; index++ )
+		if( !list.del_entry( &entries[ order[ index ] ] ) )
+			printf( "!! : list entry not found\n" );
+
+	if( list.count() )
+		printf( "!! : %li entries left in list\n", list.count() );
+
+	return tstamp() - tbeg;
+}
+
+static void bench_list( long count )
+{
+	ENTRY_TEST * entries = new ENTRY_TEST[ count ];
+	long * order = new long[ count ];
+
+	//
+	// remove entries in a random order
+	//
+
+	for( long index = 0; index < count; index++ )
+		order[ index ] = index;
+
+	for( long index = count - 1; index > 0; index-- )
+	{
+		long swap = rand() % ( index + 1 );
+		long temp = order[ index ];
+		order[ index ] = order[ swap ];
+		order[ swap ] = temp;
+	}
+
+	IDB_LIST list_ordered;
+	IDB_LIST list_unordered;
+	list_unordered.entry_order = false;
+
+	double tordered = bench_list_run( list_ordered, entries, order, count );
+	double tunordered = bench_list_run( list_unordered, entries, order, count );
+
+	printf( "%7li entries : ordered %10.3f ms, unordered %7.3f ms\n",
+		count, tordered / 1000, tunordered / 1000 );
+
+	//
+	// verify an entry in two lists
+	//
+
+	IDB_LIST list_other;
+
+	list_unordered.add_entry( &entries[ 0 ] );
+	list_unordered.add_entry( &entries[ 1 ] );
+	list_other.add_entry( &entries[ 1 ] );
+	list_unordered.del_entry( &entries[ 0 ] );
+
+	if( !list_other.del_entry( &entries[ 1 ] ) ||
+		!list_unordered.del_entry( &entries[ 1 ] ) ||
+		list_unordered.count() || list_other.count() )
+		printf( "!! : shared list entry failed\n" );
+
+	delete [] order;
+	delete [] entries;
+}
+
+//
+// phase1 packet construction benchmark
+//
+
+#define PACKET_COUNT	100000
+
+static void pld_add( BDATA & packet, uint8_t next, size_t size )
+{
+	//
+	// append a generic payload header and
+	// a body written a few bytes at a time
+	// as the payload_add functions do
+	//
+
+	uint16_t plen = htons( ( uint16_t )( size + 4 ) );
+
+	packet.add( next, 1 );
+	packet.add( 0, 1 );
+	packet.add( &plen, 2 );
+
+	for( size_t oset = 0; oset < size; oset += 4 )
+		packet.add( ( int ) oset, 4 );
+}
+
+static void build_ph1( BDATA & packet, bool exact )
+{
+	//
+	// an aggressive mode packet with a four
+	// transform proposal, a 1024 bit public
+	// value, an id, vendor ids and nat-d
+	//
+
+	static const size_t plds[] = { 52, 36, 36, 36, 36, 128, 20, 12, 16, 16, 16, 16, 20, 20 };
+
+	packet.size( 0 );
+	packet.add( 0, 28 );
+
+	for( long index = 0; index < ( long )( sizeof( plds ) / sizeof( plds[ 0 ] ) ); index++ )
+	{
+		//
+		// growing by exactly the size needed
+		// reproduces a copy on each append
+		//
+
+		if( exact )
+			packet.reserve( packet.size() + plds[ index ] + 4 );
+
+		pld_add( packet, ( uint8_t ) index, plds[ index ] );
+	}
+
+	uint32_t size = htonl( ( uint32_t ) packet.size() );
+	packet.set( &size, 4, 24 );
+}
+
+static void bench_packet()
+{
+	BDATA check1;
+	BDATA check2;
+
+	build_ph1( check1, true );
+	build_ph1( check2, false );
+
+	if( check1 != check2 )
+		printf( "!! : packet contents differ\n" );
+
+	//
+	// exact and geometric growth
+	//
+
+	double tbeg = tstamp();
+
+	for( long count = 0; count < PACKET_COUNT; count++ )
+	{
+		BDATA packet;
+		build_ph1( packet, true );
+	}
+
+	double texact = ( tstamp() - tbeg ) / PACKET_COUNT;
+
+	tbeg = tstamp();
+
+	for( long count = 0; count < PACKET_COUNT; count++ )
+	{
+		BDATA packet;
+		build_ph1( packet, false );
+	}
+
+	double tgrow = ( tstamp() - tbeg ) / PACKET_COUNT;
+
+	//
+	// reused and reserved buffers
+	//
+
+	BDATA packet;
+	packet.reserve( 1500 );
+
+	tbeg = tstamp();
+
+	for( long count = 0; count < PACKET_COUNT; count++ )
+		build_ph1( packet, false );
+
+	double treuse = ( tstamp() - tbeg ) / PACKET_COUNT;
+
+	printf( "%7li packets : exact %7.3f us/packet, geometric %7.3f us/packet, reused %7.3f us/packet\n",
+		( long ) PACKET_COUNT, texact, tgrow, treuse );
+
+	//
+	// copied and moved buffers
+	//
+
+	BDATA target;
+
+	tbeg = tstamp();
+
+	for( long count = 0; count < PACKET_COUNT; count++ )
+	{
+		BDATA source( check2 );
+		target = source;
+	}
+
+	double tcopy = ( tstamp() - tbeg ) / PACKET_COUNT;
+
+	tbeg = tstamp();
+
+	for( long count = 0; count < PACKET_COUNT; count++ )
+	{
+		BDATA source( check2 );
+		target.move( source );
+	}
+
+	double tmove = ( tstamp() - tbeg ) / PACKET_COUNT;
+
+	printf( "%7li packets : copy  %7.3f us/packet, move      %7.3f us/packet\n",
+		( long ) PACKET_COUNT, tcopy, tmove );
+
+	if( target != check2 )
+		printf( "!! : moved packet contents differ\n" );
+
+	//
+	// verify small buffer copy and move
+	//
+
+	BDATA small1;
+	small1.add( "cookie", 6 );
+
+	BDATA small2( small1 );
+	BDATA small3;
+	small3.move( small2 );
+
+	if( ( small3 != small1 ) || small2.size() || ( small2.buff() != NULL ) )
+		printf( "!! : small buffer move failed\n" );
+
+	//
+	// verify the size limit
+	//
+
+	size_t limit = BDATA::limit();
+	BDATA::limit( 1024 );
+
+	BDATA large;
+	if( large.size( 2048 ) == 2048 )
+		printf( "!! : size limit not enforced\n" );
+
+	BDATA::limit( limit );
+}
+
+//
+// test program
+//
+
+int main( int argc, char * argv[], char * envp[] )
+{
+	printf( "==== TEST RUN ====\n" );
+
+	srand( 1 );
+
+	bench_lookup( 10000 );
+	bench_lookup( 100000 );
+
+	bench_list( 10000 );
+	bench_list( 50000 );
+
+	bench_packet();
+
+	printf( "==== TEST END ====\n" );
+
+	return 0;
+}
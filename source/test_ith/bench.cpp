@@ -0,0 +1,331 @@
+
+/*
+ * Copyright (c) 2007
+ *      Shrew Soft Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Redistributions in any form must be accompanied by information on
+ *    how to obtain complete source code for the software and any
+ *    accompanying software that uses the software.  The source code
+ *    must either be included in the distribution or be available for no
+ *    more than the cost of distribution plus a nominal fee, and must be
+ *    freely redistributable under reasonable conditions.  For an
+ *    executable file, complete source code means the source code for all
+ *    modules it contains.  It does not include source code for modules or
+ *    files that typically accompany the major components of the operating
+ *    system on which the executable file runs.
+ *
+ * THIS SOFTWARE IS PROVIDED BY SHREW SOFT INC ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, OR
+ * NON-INFRINGEMENT, ARE DISCLAIMED.  IN NO EVENT SHALL SHREW SOFT INC
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * AUTHOR : Matthew Grooms
+ *          mgrooms@shrew.net
+ *
+ */
+
+
+#include <stdlib.h>
+#include <sys/time.h>
+#include "libith.h"
+
+//
+// utility functions
+//
+
+static double tstamp()
+{
+	struct timeval tval;
+	gettimeofday( &tval, NULL );
+
+	return ( double ) tval.tv_sec * 1000000.0 + tval.tv_usec;
+}
+
+//
+// test event class
+//
+
+typedef class _EVENT_BENCH : public ITH_EVENT
+{
+	public:
+
+	bool	func();
+
+}EVENT_BENCH;
+
+bool _EVENT_BENCH::func()
+{
+	return false;
+}
+
+//
+// timer schedule and cancel benchmark
+//
+
+static void bench_timer( long count )
+{
+	ITH_TIMER	timer;
+
+	EVENT_BENCH * events = new EVENT_BENCH[ count ];
+	long * order = new long[ count ];
+
+	for( long index = 0; index < count; index++ )
+	{
+		events[ index ].delay = 1000 + rand() % 3600000;
+		order[ index ] = index;
+	}
+
+	//
+	// cancel in random order
+	//
+
+	for( long index = count - 1; index > 0; index-- )
+	{
+		long other = rand() % ( index + 1 );
+		long temp = order[ index ];
+		order[ index ] = order[ other ];
+		order[ other ] = temp;
+	}
+
+	double tbeg = tstamp();
+
+	for( long index = 0; index < count; index++ )
+		timer.add( &events[ index ] );
+
+	double tadd = ( tstamp() - tbeg ) / count;
+
+	long failed = 0;
+	tbeg = tstamp();
+
+	for( long index = 0; index < count; index++ )
+		if( !timer.del( &events[ order[ index ] ] ) )
+			failed++;
+
+	double tdel = ( tstamp() - tbeg ) / count;
+
+	//
+	// verify cancelled events are gone
+	//
+
+	for( long index = 0; index < count; index++ )
+		if( timer.del( &events[ index ] ) )
+			failed++;
+
+	printf( "%7li events : add %7.3f us/event, del %7.3f us/event ( %li failed )\n",
+		count, tadd, tdel, failed );
+
+	delete [] order;
+	delete [] events;
+}
+
+//
+// executor group serialization test
+//
+
+#define GROUP_COUNT		16
+#define GROUP_EVENTS	8
+#define GROUP_REPEAT	25
+
+static ITH_TIMER *	exec_timer;
+static volatile long	group_busy[ GROUP_COUNT ];
+static volatile long	group_overlap;
+static volatile long	group_runs;
+
+typedef class _EVENT_GROUP : public ITH_EVENT
+{
+	public:
+
+	long	index;
+	long	count;
+
+	bool	func();
+
+}EVENT_GROUP;
+
+bool _EVENT_GROUP::func()
+{
+	if( ith_atomic_inc( &group_busy[ index ] ) != 1 )
+		ith_atomic_inc( &group_overlap );
+
+	usleep( 100 );
+
+	ith_atomic_dec( &group_busy[ index ] );
+
+	if( ith_atomic_inc( &group_runs ) == GROUP_COUNT * GROUP_EVENTS * GROUP_REPEAT )
+		exec_timer->end();
+
+	return ( ++count < GROUP_REPEAT );
+}
+
+static void bench_exec( long threads )
+{
+	ITH_TIMER timer;
+	exec_timer = &timer;
+
+	EVENT_GROUP * events = new EVENT_GROUP[ GROUP_COUNT * GROUP_EVENTS ];
+
+	group_overlap = 0;
+	group_runs = 0;
+
+	for( long index = 0; index < GROUP_COUNT * GROUP_EVENTS; index++ )
+	{
+		events[ index ].index = index % GROUP_COUNT;
+		events[ index ].count = 0;
+		events[ index ].delay = 1;
+		events[ index ].group = ( void * ) &group_busy[ index % GROUP_COUNT ];
+
+		timer.add( &events[ index ] );
+	}
+
+	double tbeg = tstamp();
+
+	timer.run( threads );
+
+	double ttot = ( tstamp() - tbeg ) / 1000;
+
+	printf( "%7li threads : %li events in %7.1f ms ( %li overlapped )\n",
+		threads, group_runs, ttot, group_overlap );
+
+	delete [] events;
+}
+
+//
+// executor queue cancellation test
+//
+
+static volatile long	cancel_runs;
+
+typedef class _EVENT_CANCEL : public ITH_EVENT
+{
+	public:
+
+	long	sleep;
+
+	bool	func();
+
+}EVENT_CANCEL;
+
+bool _EVENT_CANCEL::func()
+{
+	usleep( sleep );
+	ith_atomic_inc( &cancel_runs );
+
+	return false;
+}
+
+typedef class _EXEC_TIMER : public ITH_EXEC
+{
+	public:
+
+	ITH_TIMER *	timer;
+	ITH_COND	done;
+
+	long	func( void * arg );
+
+}EXEC_TIMER;
+
+long _EXEC_TIMER::func( void * arg )
+{
+	timer->run( 1 );
+	done.alert();
+
+	return 0;
+}
+
+static void bench_cancel()
+{
+	ITH_TIMER timer;
+
+	EXEC_TIMER exec;
+	exec.timer = &timer;
+	exec.exec( NULL );
+
+	//
+	// the first event keeps the executor
+	// busy so the others wait in its queue
+	//
+
+	EVENT_CANCEL events[ 3 ];
+
+	cancel_runs = 0;
+
+	for( long index = 0; index < 3; index++ )
+	{
+		events[ index ].sleep = index ? 0 : 200000;
+		events[ index ].delay = 1;
+		events[ index ].group = ( void * ) &cancel_runs;
+
+		timer.add( &events[ index ] );
+		usleep( 10000 );
+	}
+
+	usleep( 50000 );
+
+	long failed = 0;
+
+	// a queued event cannot be added again
+
+	if( timer.add( &events[ 1 ] ) )
+		failed++;
+
+	// but it can be cancelled and rescheduled
+
+	if( !timer.del( &events[ 1 ] ) )
+		failed++;
+
+	if( timer.del( &events[ 1 ] ) )
+		failed++;
+
+	if( !timer.add( &events[ 1 ] ) )
+		failed++;
+
+	usleep( 400000 );
+
+	timer.end();
+	exec.done.wait( -1 );
+
+	if( cancel_runs != 3 )
+		failed++;
+
+	printf( "%7li events : %li executed ( %li failed )\n",
+		3L, cancel_runs, failed );
+}
+
+//
+// test program
+//
+
+int main( int argc, char * argv[], char * envp[] )
+{
+	printf( "==== TEST RUN ====\n" );
+
+	srand( 1 );
+
+	bench_timer( 1000 );
+	bench_timer( 10000 );
+	bench_timer( 100000 );
+
+	bench_exec( 0 );
+	bench_exec( 4 );
+
+	bench_cancel();
+
+	printf( "==== TEST END ====\n" );
+
+	return 0;
+}
@@ -160,6 +160,15 @@ int main( int argc, char * argv[], char * envp[] )
 
 	timer.run();
 
+	ITH_TIMER_STATS stats;
+	timer.stats( stats );
+
+	printf( "%s : %lu events executed, lag max %li avg %li usecs\n",
+		tstamp( str, 50 ),
+		stats.events,
+		stats.lag_max,
+		stats.lag_avg );
+
 	printf( "%s : ==== TEST END ====\n", tstamp( str, 50 ) );
 	printf( "press <Enter> to continue ...\n", tstamp( str, 50 ) );
 
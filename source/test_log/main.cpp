@@ -0,0 +1,318 @@
+
+/*
+ * Copyright (c) 2007
+ *      Shrew Soft Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Redistributions in any form must be accompanied by information on
+ *    how to obtain complete source code for the software and any
+ *    accompanying software that uses the software.  The source code
+ *    must either be included in the distribution or be available for no
+ *    more than the cost of distribution plus a nominal fee, and must be
+ *    freely redistributable under reasonable conditions.  For an
+ *    executable file, complete source code means the source code for all
+ *    modules it contains.  It does not include source code for modules or
+ *    files that typically accompany the major components of the operating
+ *    system on which the executable file runs.
+ *
+ * THIS SOFTWARE IS PROVIDED BY SHREW SOFT INC ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, OR
+ * NON-INFRINGEMENT, ARE DISCLAIMED.  IN NO EVENT SHALL SHREW SOFT INC
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * AUTHOR : Matthew Grooms
+ *          mgrooms@shrew.net
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include "liblog.h"
+
+#define PACKET_COUNT	1000000
+#define PACKET_SIZE		512
+#define PACKET_REFS		4
+#define MAX_TEXTADDR	20
+#define END_THREADS		4
+#define END_COUNT		20000
+#define END_PATH		"/tmp/test_log_end.txt"
+
+static LOG log;
+
+//
+// utility functions
+//
+
+static double tstamp()
+{
+	struct timeval tval;
+	gettimeofday( &tval, NULL );
+
+	return ( double ) tval.tv_sec * 1000000.0 + tval.tv_usec;
+}
+
+static void text_addr( char * text, sockaddr_in * saddr, bool port )
+{
+	unsigned long haddr = ntohl( saddr->sin_addr.s_addr );
+
+	char txtaddr[ MAX_TEXTADDR ];
+
+	sprintf_s( txtaddr, MAX_TEXTADDR,
+		"%lu.%lu.%lu.%lu",
+		0xff & ( haddr >> 24 ),
+		0xff & ( haddr >> 16 ),
+		0xff & ( haddr >>  8 ),
+		0xff & haddr );
+
+	if( port )
+		sprintf_s( text, MAX_TEXTADDR, "%s:%u", txtaddr, ntohs( saddr->sin_port ) );
+	else
+		sprintf_s( text, MAX_TEXTADDR, "%s", txtaddr );
+}
+
+//
+// reference counted object stand in
+//
+
+typedef class _ENTRY
+{
+	public:
+
+	volatile long	refcount;
+
+	virtual const char * name();
+
+}ENTRY;
+
+const char * _ENTRY::name()
+{
+	return "phase1";
+}
+
+//
+// per packet log calls as made by the
+// network and send paths, either with
+// arguments always built or gated by
+// the log level
+//
+
+static void packet_log( ENTRY & entry, sockaddr_in * src, sockaddr_in * dst, unsigned char * data, bool gated )
+{
+	if( !gated || log.enabled( LLOG_DEBUG ) )
+	{
+		char txtaddr_src[ MAX_TEXTADDR ];
+		char txtaddr_dst[ MAX_TEXTADDR ];
+
+		text_addr( txtaddr_src, src, false );
+		text_addr( txtaddr_dst, dst, false );
+
+		log.bin(
+			LLOG_DEBUG,
+			LLOG_DECODE,
+			data,
+			PACKET_SIZE,
+			"<- : recv IKE packet %s:%u -> %s:%u",
+			txtaddr_src, ntohs( src->sin_port ),
+			txtaddr_dst, ntohs( dst->sin_port ) );
+	}
+
+	for( long index = 0; index < PACKET_REFS; index++ )
+	{
+		long count = ith_atomic_inc( &entry.refcount );
+
+		if( !gated || log.enabled( LLOG_LOUD ) )
+			log.txt(
+				LLOG_LOUD,
+				"DB : %s ref increment ( ref count = %i, obj count = %i )\n",
+				entry.name(),
+				count,
+				1 );
+
+		count = ith_atomic_dec( &entry.refcount );
+
+		if( !gated || log.enabled( LLOG_LOUD ) )
+			log.txt(
+				LLOG_LOUD,
+				"DB : %s ref decrement ( ref count = %i, obj count = %i )\n",
+				entry.name(),
+				count,
+				1 );
+	}
+
+	if( !gated || log.enabled( LLOG_DEBUG ) )
+	{
+		char txtaddr_l[ MAX_TEXTADDR ];
+		char txtaddr_r[ MAX_TEXTADDR ];
+
+		text_addr( txtaddr_l, dst, true );
+		text_addr( txtaddr_r, src, true );
+
+		log.bin(
+			LLOG_DEBUG,
+			LLOG_DECODE,
+			data,
+			PACKET_SIZE,
+			"-> : send %s packet %s -> %s",
+			"IKE",
+			txtaddr_l,
+			txtaddr_r );
+	}
+}
+
+//
+// per packet logging cost benchmark
+//
+
+static void bench_packet( long level, bool gated )
+{
+	log.open( ( char * ) "/dev/null", level, 0 );
+
+	ENTRY entry;
+	entry.refcount = 1;
+
+	sockaddr_in src;
+	memset( &src, 0, sizeof( src ) );
+	src.sin_family = AF_INET;
+	src.sin_addr.s_addr = inet_addr( "192.168.10.1" );
+	src.sin_port = htons( 500 );
+
+	sockaddr_in dst = src;
+	dst.sin_addr.s_addr = inet_addr( "10.0.0.1" );
+
+	unsigned char data[ PACKET_SIZE ];
+	memset( data, 0x5a, sizeof( data ) );
+
+	long count = PACKET_COUNT;
+	if( level > LLOG_INFO )
+		count /= 100;
+
+	double tbeg = tstamp();
+
+	for( long index = 0; index < count; index++ )
+		packet_log( entry, &src, &dst, data, gated );
+
+	double ttot = ( tstamp() - tbeg ) * 1000 / count;
+
+	printf( "level %li, %-8s : %9.1f ns/packet\n",
+		level,
+		gated ? "gated" : "ungated",
+		ttot );
+
+	log.close();
+}
+
+//
+// writer shutdown test. every message is
+// either written or reported as dropped,
+// including those published while the
+// writer thread is being stopped
+//
+
+typedef class _EXEC_LOG : public ITH_EXEC
+{
+	public:
+
+	ITH_COND	done;
+
+	long	func( void * arg );
+
+}EXEC_LOG;
+
+long _EXEC_LOG::func( void * arg )
+{
+	for( long index = 0; index < END_COUNT; index++ )
+		log.txt( LLOG_INFO, "ii : message %li\n", index );
+
+	log.detach();
+	done.alert();
+
+	return 0;
+}
+
+static void bench_end()
+{
+	unlink( END_PATH );
+	log.open( ( char * ) END_PATH, LLOG_INFO, 0 );
+	log.run();
+
+	EXEC_LOG execs[ END_THREADS ];
+
+	for( long index = 0; index < END_THREADS; index++ )
+		execs[ index ].exec( NULL );
+
+	usleep( 1000 );
+	log.end();
+
+	for( long index = 0; index < END_THREADS; index++ )
+		execs[ index ].done.wait( -1 );
+
+	log.close();
+
+	//
+	// count written and dropped messages
+	//
+
+	long written = 0;
+	long dropped = 0;
+
+	FILE * fp = fopen( END_PATH, "r" );
+	if( fp != NULL )
+	{
+		char line[ 256 ];
+		while( fgets( line, sizeof( line ), fp ) != NULL )
+		{
+			char * text = strstr( line, "ii : message" );
+			if( text != NULL )
+				written++;
+
+			long count;
+			text = strstr( line, "!! : " );
+			if( text != NULL )
+				if( sscanf( text, "!! : %li", &count ) == 1 )
+					dropped += count;
+		}
+
+		fclose( fp );
+	}
+
+	unlink( END_PATH );
+
+	long total = END_THREADS * END_COUNT;
+
+	printf( "%7li messages : %li written, %li dropped ( %li lost )\n",
+		total, written, dropped, total - written - dropped );
+}
+
+int main( int argc, char * argv[], char * envp[] )
+{
+	printf( "==== TEST RUN ====\n" );
+
+	bench_packet( LLOG_INFO, false );
+	bench_packet( LLOG_INFO, true );
+
+	bench_packet( LLOG_DEBUG, false );
+	bench_packet( LLOG_DEBUG, true );
+
+	bench_end();
+
+	printf( "==== TEST END ====\n" );
+
+	return 0;
+}
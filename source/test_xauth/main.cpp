@@ -0,0 +1,230 @@
+
+/*
+ * Copyright (c) 2007
+ *      Shrew Soft Inc.  All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Redistributions in any form must be accompanied by information on
+ *    how to obtain complete source code for the software and any
+ *    accompanying software that uses the software.  The source code
+ *    must either be included in the distribution or be available for no
+ *    more than the cost of distribution plus a nominal fee, and must be
+ *    freely redistributable under reasonable conditions.  For an
+ *    executable file, complete source code means the source code for all
+ *    modules it contains.  It does not include source code for modules or
+ *    files that typically accompany the major components of the operating
+ *    system on which the executable file runs.
+ *
+ * THIS SOFTWARE IS PROVIDED BY SHREW SOFT INC ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE, OR
+ * NON-INFRINGEMENT, ARE DISCLAIMED.  IN NO EVENT SHALL SHREW SOFT INC
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * AUTHOR : Matthew Grooms
+ *          mgrooms@shrew.net
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "ldap.pool.h"
+
+//
+// in process ldap stub. each connection
+// records the server generation it was
+// opened against and reports the server
+// down once the server has restarted
+//
+
+struct ldap
+{
+	long	generation;
+};
+
+static long	server_gen = 0;
+static bool	server_up = true;
+
+static long	stub_opens = 0;
+static long	stub_closes = 0;
+
+int ldap_search_ext_s( LDAP * ld, const char * base, int scope, const char * filter, char ** attrs, int attrsonly, LDAPControl ** sctrls, LDAPControl ** cctrls, struct timeval * timeout, int sizelimit, LDAPMessage ** res )
+{
+	*res = NULL;
+
+	if( !server_up || ( ld->generation != server_gen ) )
+		return LDAP_SERVER_DOWN;
+
+	return LDAP_SUCCESS;
+}
+
+int ldap_unbind_ext_s( LDAP * ld, LDAPControl ** sctrls, LDAPControl ** cctrls )
+{
+	stub_closes++;
+	delete ld;
+
+	return LDAP_SUCCESS;
+}
+
+int ldap_msgfree( LDAPMessage * lm )
+{
+	return 0;
+}
+
+//
+// connection pool using the stub
+//
+
+typedef class _TEST_POOL : public IKED_LDAP_POOL
+{
+	protected:
+
+	bool	open_conn( LDAP ** ld );
+	bool	bind_conn( LDAP * ld );
+
+	public:
+
+	void	fill( long count );
+	bool	find( int & res );
+	long	pooled();
+
+}TEST_POOL;
+
+bool _TEST_POOL::open_conn( LDAP ** ld )
+{
+	if( !server_up )
+		return false;
+
+	*ld = new ldap;
+	( *ld )->generation = server_gen;
+	stub_opens++;
+
+	return true;
+}
+
+bool _TEST_POOL::bind_conn( LDAP * ld )
+{
+	return server_up && ( ld->generation == server_gen );
+}
+
+void _TEST_POOL::fill( long count )
+{
+	LDAP * list[ LDAP_CONN_MAX ];
+	bool pooled;
+
+	for( long index = 0; index < count; index++ )
+		get_conn( &list[ index ], pooled );
+
+	for( long index = 0; index < count; index++ )
+		put_conn( list[ index ], false, true );
+}
+
+bool _TEST_POOL::find( int & res )
+{
+	LDAP * ld = NULL;
+	LDAPMessage * lr = NULL;
+	char * atlist[ 1 ] = { NULL };
+
+	if( !search( &ld, res, ( char * ) "dc=test", LDAP_SCOPE_ONELEVEL, ( char * ) "(cn=test)", atlist, 0, &lr ) )
+		return false;
+
+	put_conn( ld, false, !ldap_conn_lost( res ) );
+
+	return true;
+}
+
+long _TEST_POOL::pooled()
+{
+	return conn_count;
+}
+
+//
+// test program
+//
+
+static long failed = 0;
+
+static void check( const char * name, bool passed )
+{
+	printf( "%-40s : %s\n", name, passed ? "passed" : "failed" );
+
+	if( !passed )
+		failed++;
+}
+
+int main( int argc, char * argv[], char * envp[] )
+{
+	printf( "==== TEST RUN ====\n" );
+
+	TEST_POOL pool;
+	pool.conn_max = 4;
+
+	int res;
+	bool found;
+
+	//
+	// a search reuses a pooled connection
+	//
+
+	pool.fill( 4 );
+
+	found = pool.find( res );
+
+	check( "search using a pooled connection",
+		found && ( res == LDAP_SUCCESS ) && ( stub_opens == 4 ) && ( pool.pooled() == 4 ) );
+
+	//
+	// once the server has restarted, every
+	// pooled connection is closed and the
+	// search is retried only once using a
+	// new connection
+	//
+
+	server_gen++;
+
+	found = pool.find( res );
+
+	check( "search after a server restart",
+		found && ( res == LDAP_SUCCESS ) && ( stub_opens == 5 ) && ( stub_closes == 4 ) && ( pool.pooled() == 1 ) );
+
+	//
+	// while the server is down the search
+	// fails and no connection is kept
+	//
+
+	server_up = false;
+
+	found = pool.find( res );
+
+	check( "search while the server is down",
+		!found && ( stub_opens == 5 ) && ( stub_closes == 5 ) && ( pool.pooled() == 0 ) );
+
+	//
+	// and succeeds once it is back up
+	//
+
+	server_up = true;
+	server_gen++;
+
+	found = pool.find( res );
+
+	check( "search after the server returns",
+		found && ( res == LDAP_SUCCESS ) && ( stub_opens == 6 ) && ( pool.pooled() == 1 ) );
+
+	printf( "==== TEST END ====\n" );
+
+	return failed ? 1 : 0;
+}